@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>     /* sysconf() */
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>   /* __rdtsc() */
+#   define HAVE_TSC
+#endif
+
+#include "cinic.h"
+
+/*
+ * Parser throughput benchmark.
+ *
+ * Usage: bench [file [min-size-MiB]]
+ *
+ * The contents of FILE (samples/lists_from_hell.ini by default) are
+ * concatenated until the input is at least min-size-MiB (default: 64)
+ * long, and the input is then parsed from memory a number of times.
+ * The best run is reported as throughput and, on x86, bytes per TSC
+ * cycle. The input is then parsed with a view callback (see
+ * Cinic_parse_views()), by a thread per core (see cinic_ctx.threads)
+ * and loaded as a document (see Cinic_load()) the same number of
+ * times, and the best runs reported likewise; as is reloading the
+ * document with Cinic_reparse() after a one-letter edit.
+ *
+ * Global entries are allowed, so that the repeated top of the file is
+ * simply a few extra records in the previous section.
+ */
+
+#define DEFAULT_INPUT   "samples/lists_from_hell.ini"
+#define DEFAULT_MIN_MIB 64
+#define RUNS            5
+
+static uint64_t entries = 0;
+
+int count_cb(uint32_t ln, enum cinic_list_state list, const char *section, const char *k, const char *v){
+    (void)ln; (void)list; (void)section; (void)k; (void)v;
+    ++entries;
+    return 0;
+}
+
+int count_view_cb(void *ud, uint32_t ln, enum cinic_list_state list, const struct cinic_view *section,
+                  const struct cinic_view *k, const struct cinic_view *v)
+{
+    (void)ln; (void)list; (void)section; (void)k; (void)v;
+    ++*(uint64_t *)ud;
+    return 0;
+}
+
+/* read file at path and repeat its contents until at least min bytes long */
+static char *make_input(const char *path, size_t min, size_t *len){
+    FILE *f = fopen(path, "r");
+    if (!f){
+        fprintf(stderr, "Failed to open file:'%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fseek(f, 0, SEEK_END);
+    size_t sz = ftell(f);
+    rewind(f);
+    if (!sz){
+        fprintf(stderr, "Empty input file:'%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t reps = (min + sz - 1) / sz;
+    char *buff = malloc(sz * reps);
+    if (!buff || fread(buff, 1, sz, f) != sz){
+        fprintf(stderr, "Failed to read file:'%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(f);
+
+    /* make sure each copy starts on a new line */
+    if (buff[sz-1] != '\n') buff[sz-1] = '\n';
+    for (size_t i = 1; i < reps; ++i){
+        memcpy(buff + i*sz, buff, sz);
+    }
+    *len = sz * reps;
+    return buff;
+}
+
+/*
+ * Return the first letter of the value of the last record in the len
+ * bytes at input that has one, or NULL. Records that come last win, so
+ * changing its case is always a change to the document.
+ */
+static char *find_edit(char *input, size_t len){
+    for (size_t end = len; end > 0; ){
+        size_t start = end - 1;
+        while (start > 0 && input[start - 1] != '\n') --start;
+
+        char *line = input + start, *v = memchr(line, '=', end - start);
+        while (line < input + end && (*line == ' ' || *line == '\t')) ++line;
+        if (v && isalpha((unsigned char)*line)){
+            while (++v < input + end && *v == ' ');
+            if (v < input + end && isalpha((unsigned char)*v)) return v;
+        }
+        end = start;
+    }
+    return NULL;
+}
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv){
+    const char *path = argc > 1 ? argv[1] : DEFAULT_INPUT;
+    size_t min_mib = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_MIN_MIB;
+    size_t len = 0;
+    char *input = make_input(path, min_mib << 20, &len);
+
+    struct cinic_ctx ctx;
+    Cinic_ctx_init(&ctx, true, true, ".", NULL);
+
+    double best = 0;
+    uint64_t best_cycles = 0;
+    for (int i = 0; i < RUNS; ++i){
+        entries = 0;
+        double start = now();
+#ifdef HAVE_TSC
+        uint64_t c0 = __rdtsc();
+#endif
+        if (Cinic_parse_buffer(&ctx, input, len, count_cb, NULL)){
+            fprintf(stderr, "Parsing failed\n");
+            exit(EXIT_FAILURE);
+        }
+#ifdef HAVE_TSC
+        uint64_t cycles = __rdtsc() - c0;
+#else
+        uint64_t cycles = 0;
+#endif
+        double elapsed = now() - start;
+        if (!i || elapsed < best){
+            best = elapsed;
+            best_cycles = cycles;
+        }
+    }
+
+    double best_views = 0;
+    for (int i = 0; i < RUNS; ++i){
+        uint64_t n = 0;
+        double start = now();
+        if (Cinic_parse_buffer_views(&ctx, input, len, count_view_cb, &n, NULL) || n != entries){
+            fprintf(stderr, "Parsing failed\n");
+            exit(EXIT_FAILURE);
+        }
+        double elapsed = now() - start;
+        if (!i || elapsed < best_views) best_views = elapsed;
+    }
+
+    /* the same again, parsed by a thread per core */
+    struct cinic_ctx par_ctx = ctx;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    par_ctx.threads = ncpus > 1 ? ncpus : 2;
+    double best_par = 0;
+    for (int i = 0; i < RUNS; ++i){
+        uint64_t n = entries;
+        entries = 0;
+        double start = now();
+        if (Cinic_parse_buffer(&par_ctx, input, len, count_cb, NULL) || n != entries){
+            fprintf(stderr, "Parsing failed\n");
+            exit(EXIT_FAILURE);
+        }
+        double elapsed = now() - start;
+        if (!i || elapsed < best_par) best_par = elapsed;
+    }
+
+    double best_load = 0;
+    for (int i = 0; i < RUNS; ++i){
+        double start = now();
+        struct cinic_doc *doc = Cinic_load_buffer(&ctx, input, len, NULL);
+        if (!doc){
+            fprintf(stderr, "Loading failed\n");
+            exit(EXIT_FAILURE);
+        }
+        Cinic_doc_free(doc);
+        double elapsed = now() - start;
+        if (!i || elapsed < best_load) best_load = elapsed;
+    }
+
+    /* the first reparse parses it all; the ones after only the section edited */
+    char *edit = find_edit(input, len);
+    struct cinic_doc *doc = Cinic_load_buffer(&ctx, input, len, NULL);
+    struct cinic_change *changes;
+    size_t nchanges;
+    if (!doc || !edit || Cinic_reparse(&ctx, doc, input, len, &changes, &nchanges, NULL)){
+        fprintf(stderr, "Reparsing failed\n");
+        exit(EXIT_FAILURE);
+    }
+    free(changes);
+    double best_reparse = 0;
+    for (int i = 0; i < RUNS; ++i){
+        *edit ^= 0x20;
+        double start = now();
+        if (Cinic_reparse(&ctx, doc, input, len, &changes, &nchanges, NULL) || !nchanges){
+            fprintf(stderr, "Reparsing failed\n");
+            exit(EXIT_FAILURE);
+        }
+        double elapsed = now() - start;
+        free(changes);
+        if (!i || elapsed < best_reparse) best_reparse = elapsed;
+    }
+    Cinic_doc_free(doc);
+
+    printf("input          : %s x %zu MiB\n", path, len >> 20);
+    printf("entries        : %llu\n", (unsigned long long)entries);
+    printf("best of %d      : %.3f s\n", RUNS, best);
+    printf("throughput     : %.1f MiB/s\n", (len / (double)(1 << 20)) / best);
+    if (best_cycles){
+        printf("bytes/cycle    : %.3f\n", len / (double)best_cycles);
+    }
+    printf("views          : %.1f MiB/s\n", (len / (double)(1 << 20)) / best_views);
+    printf("%-2u threads     : %.1f MiB/s\n", par_ctx.threads, (len / (double)(1 << 20)) / best_par);
+    printf("load + free    : %.1f MiB/s\n", (len / (double)(1 << 20)) / best_load);
+    printf("reparse        : %.1f MiB/s\n", (len / (double)(1 << 20)) / best_reparse);
+
+    free(input);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#!/usr/bin/lua5.3
+
+--
+-- Lua binding throughput benchmark; the counterpart of bench.c.
+--
+-- Usage: bench.lua [file [min-size-MiB]]
+--
+-- The input is made up exactly as by bench.c -- the contents of FILE
+-- (samples/lists_from_hell.ini by default) concatenated until at least
+-- min-size-MiB (default: 64) long -- and written to a temporary file,
+-- which is then turned into tables with cinic.parse() a number of
+-- times. The best run is reported as throughput, to be compared with
+-- that of the C parser on the same input (see `make luabench`).
+--
+
+package.cpath = package.cpath .. ";../out/?.so;./out/?.so;"
+
+local cinic = require("cinic")
+
+local DEFAULT_INPUT   = "samples/lists_from_hell.ini"
+local DEFAULT_MIN_MIB = 64
+local RUNS            = 5
+
+local path = arg[1] or DEFAULT_INPUT
+local min_mib = tonumber(arg[2]) or DEFAULT_MIN_MIB
+
+-- read file at path and repeat its contents until at least min bytes long
+local function make_input(path, min)
+    local f = assert(io.open(path, "rb"))
+    local text = f:read("a")
+    f:close()
+    assert(#text > 0, "Empty input file:'" .. path .. "'")
+
+    -- make sure each copy starts on a new line
+    if text:sub(-1) ~= "\n" then
+        text = text:sub(1, -2) .. "\n"
+    end
+    local reps = (min + #text - 1) // #text
+    return string.rep(text, reps)
+end
+
+local input = make_input(path, min_mib << 20)
+local tmp = os.tmpname()
+local f = assert(io.open(tmp, "wb"))
+f:write(input)
+f:close()
+
+local best
+for i = 1, RUNS do
+    local start = os.clock()
+    local ok, err = pcall(cinic.parse, tmp, true, ".")
+    local elapsed = os.clock() - start
+    if not ok then
+        os.remove(tmp)
+        error("Parsing failed: " .. err)
+    end
+    if not best or elapsed < best then
+        best = elapsed
+    end
+    collectgarbage()
+end
+os.remove(tmp)
+
+print(string.format("input          : %s x %d MiB", path, #input >> 20))
+print(string.format("best of %d      : %.3f s", RUNS, best))
+print(string.format("lua throughput : %.1f MiB/s", (#input / (1 << 20)) / best))
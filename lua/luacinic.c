@@ -7,16 +7,58 @@
 #include <stdio.h>
 #include <assert.h>
 #include <sys/types.h>  /* ssize_t */
-#include <string.h>     /* memset(), strcmp() */
+#include <string.h>     /* memset(), strerror() */
+#include <limits.h>     /* INT_MAX */
 
 #include "cinic.h"
 #include "utils__.h"
 
 /*
- * Convert cinic error number to error string and use that to throw an error in Lua */
-void dispatch_lua_error(lua_State *L, enum cinic_error error, uint32_t ln){
-    assert(error < CINIC_SENTINEL && error > CINIC_SUCCESS);
-    luaL_error(L, "Cinic: failed to parse line %d -- %s\n", ln, Cinic_err2str(error));
+ * Push the message of the lua error to be thrown because parsing the
+ * config file at path failed as described by diag. */
+void push_parse_error(lua_State *L, const char *path, const struct cinic_diag *diag){
+    assert(diag->code < CINIC_SENTINEL && diag->code > CINIC_SUCCESS);
+
+    switch(diag->code){
+    case CINIC_NOMEM:
+        lua_pushstring(L, "Memory allocation error (realloc())");
+        break;
+    case CINIC_IO:
+        lua_pushfstring(L, "Failed to read file:'%s' -- %s", path, strerror(diag->errnum));
+        break;
+    default:
+        lua_pushfstring(L, "Cinic: failed to parse line %d -- %s\n", (int)diag->ln, Cinic_err2str(diag->code));
+        break;
+    }
+}
+
+/*
+ * Set up ctx according to the optional allow_globals and section_delim
+ * arguments, at stack indices 2 and 3, of the cinic functions that take
+ * them; see parse_ini_config_file(). */
+void check_parse_options(lua_State *L, struct cinic_ctx *ctx){
+    /* defaults if unspecified by the caller */
+    bool allow_globals      = false;
+    bool allow_empty_lists  = true;  /* implcitly allow this for lua */
+    const char *ns_delim    = ".";
+
+    /* check initialization flags */
+    if (lua_type(L, 2) != LUA_TNIL){
+        luaL_checktype(L, 2, LUA_TBOOLEAN);
+        allow_globals = lua_toboolean(L,2);
+    }
+    if (lua_type(L, 3) != LUA_TNONE){
+        const char *delim = luaL_checkstring(L, 3);
+        /* must be a single char! */
+        if (strlen(delim) > 1){
+            luaL_error(L, "Invalid delimiter provided: '%s' -- must be a single char", delim);
+        }
+        ns_delim = delim;
+    }
+    /* initialize cinic parser context */
+    if (Cinic_ctx_init(ctx, allow_globals, allow_empty_lists, ns_delim, NULL)){
+        luaL_error(L, "Invalid parser options");
+    }
 }
 
 /*
@@ -30,16 +72,16 @@ void dispatch_lua_error(lua_State *L, enum cinic_error error, uint32_t ln){
  * This function therefore expects the outermost table to already be
  * on the stack. It then tries to get the nested table with key K and
  * if it doesn't exist (or K is associated with something other than
- * a table) it creates it.
+ * a table) it creates it, with room preallocated for nrec fields.
  *
  * The nested table retrieved (already exists) or created (didn't already
  * exist) is always left on top of the stack.
  */
-void get_or_create(lua_State *L, char *k){
+void get_or_create(lua_State *L, char *k, int nrec){
     /* t[k] does not exist or is not a table */
     if (lua_getfield(L, -1, k) != LUA_TTABLE){
         lua_remove(L, -1);  /* pop what we got off the stack -- not a table */
-        lua_newtable(L);    /* create new table */
+        lua_createtable(L, 0, nrec);  /* create new table */
         lua_setfield(L, -2, k); /* assign it to t[k] */
         lua_getfield(L, -1, k); /* and leave it on top of the stack */
     }
@@ -47,71 +89,206 @@ void get_or_create(lua_State *L, char *k){
 }
 
 /*
- * Callback to be called by parse_ini_config_file() on relevant entries.
- *
- * The callback manipulates the lua stack such that tables are created
- * and populated to reflect the parsed .ini config file.
- *
- * The prototype of this function is the same as that of a normal callback
- * called by Cinic_parse(). See config_cb in cinic.h FMI.
+ * Layout of the lua stack while a config is being turned into tables:
+ * the outermost table is always at the bottom, followed by the table
+ * of the current section, then by the entries of the section not yet
+ * added to it: a key and its value for each, the value of a list being
+ * the items found so far, then its array once made.
  *
- * At the end, only the outermost table is left on the stack; the next
- * call to this function repopulates to stack with the (already-created)
- * nested tables or/and creates new nested tables as required.
+ * Tables are only made once all they are to hold is known -- a section
+ * table at the next section title, a list array at the next entry --
+ * so that they can be created with room for all of it in one parse,
+ * rather than being grown (and rehashed) repeatedly while populated.
+ * Until then the outermost table and the section table are nil. If the
+ * stack cannot grow any further, what is pending is added to its
+ * table there and then, and the rest of it follows as found.
  */
-int populate_lua_state(lua_State *L,
-                       uint32_t ln,
-                       enum cinic_list_state list,
-                       char *section,
-                       char *k,
-                       char *v
-                       )
-{
-    say(" ~ populating lua state with (list = %i) section='%s', k='%s', v='%s'\n", list, section, k, v);
+#define LUA_ROOT_IDX    1
+#define LUA_SECTION_IDX 2
+
+/* stack slots that adding what is pending to its table may take */
+#define LUA_FLUSH_SLOTS 4
 
-    /* .ini lists are represented as arrays ie using numeric indices */
-    static LUA_INTEGER idx = 1;
+/*
+ * Push the table representing section, creating as needed the nested
+ * tables for all the namespaces denoted by the section title; the
+ * innermost one is created with room for nrec fields.
+ *
+ * ns_sep is the section title namespace separator (see struct cinic_ctx).
+ * An empty section title denotes the outermost table itself, which
+ * holds global entries; it is created if still nil.
+ */
+void push_section(lua_State *L, const char *ns_sep, const char *section, int nrec){
+    say(" ~ entering section '%s'\n", section);
 
     /* make copy of section title because strtok mangles it */
     uint32_t len = strlen(section)+1;
     char sect[len];
-    memset(sect, 0, len);
     memcpy(sect, section, len);
 
-    /* create as needed nested lua tables to represent all the namespaces denoted
-     * in the .ini section title and place the innermost table on top of the stack */
-    char *s = strtok(sect, SECTION_NS_SEP);
+    if (lua_isnil(L, LUA_ROOT_IDX)){
+        lua_createtable(L, 0, *section ? 0 : nrec);
+        lua_replace(L, LUA_ROOT_IDX);
+    }
+    lua_pushvalue(L, LUA_ROOT_IDX);
+
+    char *s = strtok(sect, ns_sep);
     while (s){
-        get_or_create(L, s);
-        s = strtok(NULL, SECTION_NS_SEP);
+        char *next = strtok(NULL, ns_sep);
+        get_or_create(L, s, next ? 0 : nrec);
+        lua_remove(L, -2);  /* only keep the innermost table */
+        s = next;
     }
+}
 
-    /* k=v pair (aka a record) in an already-started section */
-    if (!list){
-        lua_pushstring(L, v);
-        lua_setfield(L, -2, k);
+/*
+ * State of the conversion of a config into lua tables, shared by
+ * parse_ini_config_file() and populate_lua_state().
+ */
+struct lua_builder{
+    lua_State *L;
+    const char *ns_sep;         /* see push_section() */
+    struct cinic_buff section;  /* title of the current section */
+    int list;                   /* stack index of the key of the current list; 0 if none */
+    bool array;                 /* the array of the current list is made, right after its key */
+    LUA_INTEGER idx;            /* index in the array of the next item of the current list */
+    bool nomem;                 /* an allocation failed */
+};
+
+/*
+ * Add the items of the current list of b still on the stack to its
+ * array, making it if need be, with room for all of them.
+ */
+static void flush_list(struct lua_builder *b){
+    lua_State *L = b->L;
+    int top = lua_gettop(L), first = b->list + 1 + b->array;
+
+    if (!b->array){
+        lua_createtable(L, top - first + 1, 0);
+        lua_insert(L, first);
+        b->array = true;
+        ++first, ++top;
     }
-    /* start of a list/array */
-    else if(list == LIST_HEAD){
-        idx = 1;   /* use numeric indices for arrays */
-        lua_newtable(L);
-        lua_setfield(L, -2, k);
+    for (int i = first; i <= top; ++i){
+        lua_pushvalue(L, i);
+        lua_rawseti(L, b->list + 1, b->idx++);
     }
-    else if(list == LIST_ONGOING || list == LIST_LAST){
-        if (lua_getfield(L, -1, k) != LUA_TTABLE){ /* get array nested in outermost section table */
-            luaL_error(L, "expected table value (array) for key '%s', got something else", k);
+    lua_settop(L, b->list + 1);
+}
+
+/* Finish the current list of b, if any */
+static void close_list(struct lua_builder *b){
+    if (!b->list) return;
+    flush_list(b);
+    b->list = 0;
+}
+
+/*
+ * Add the entries of the current section of b still on the stack to its
+ * table, making it if need be, with room for all of them. There must be
+ * no list left open.
+ */
+static void flush_section(struct lua_builder *b){
+    lua_State *L = b->L;
+    int top = lua_gettop(L);
+    assert(!b->list);
+
+    if (lua_isnil(L, LUA_SECTION_IDX)){
+        /* sections with no entries are left out */
+        if (top == LUA_SECTION_IDX) return;
+        push_section(L, b->ns_sep, buff_str(&b->section), (top - LUA_SECTION_IDX) / 2);
+        lua_replace(L, LUA_SECTION_IDX);
+    }
+    for (int i = LUA_SECTION_IDX + 1; i < top; i += 2){
+        lua_pushvalue(L, i);
+        lua_pushvalue(L, i + 1);
+        lua_rawset(L, LUA_SECTION_IDX);
+    }
+    lua_settop(L, LUA_SECTION_IDX);
+}
+
+/*
+ * Make room on the stack of b for n more slots, besides those needed to
+ * flush what is pending. If it cannot grow, flush what is pending: the
+ * items of the current list, if in a list, or else the entries of the
+ * current section. Return 0, or -1 if there still is not enough room.
+ */
+static int reserve(struct lua_builder *b, int n){
+    if (lua_checkstack(b->L, n + LUA_FLUSH_SLOTS)) return 0;
+    if (b->list) flush_list(b);
+    else flush_section(b);
+    return lua_checkstack(b->L, n + LUA_FLUSH_SLOTS) ? 0 : -1;
+}
+
+/*
+ * Callback to be called by Cinic_parse_events() on everything the
+ * parser finds; see cinic_event_cb in cinic.h.
+ *
+ * The callback manipulates the lua stack such that tables are created
+ * and populated to reflect the parsed .ini config file: entries are
+ * pushed until their section ends, and list items until their list
+ * does, and then added to the table made for them; see LUA_ROOT_IDX.
+ */
+int populate_lua_state(void *ud,
+                       enum cinic_event ev,
+                       uint32_t ln,
+                       enum cinic_list_state list,
+                       const char *k,
+                       const char *v
+                       )
+{
+    struct lua_builder *b = ud;
+    lua_State *L = b->L;
+    say(" ~ populating lua state with (event = %i, list = %i) k='%s', v='%s'\n", ev, list, k, v ? v : "");
+    UNUSED(ln);
+
+    if (ev != CINIC_EV_LIST_ITEM) close_list(b);
+
+    switch(ev){
+    case CINIC_EV_SECTION:
+    {
+        struct cinic_view title = { k, strlen(k) };
+        flush_section(b);
+        if (buff_set(&b->section, &title)){
+            b->nomem = true;
+            return -1;
         }
-        lua_pushinteger(L, idx);
-        lua_pushstring(L, v);
-        lua_settable(L, -3);
-        ++idx;
+        lua_pushnil(L);     /* section table made at the next title */
+        lua_replace(L, LUA_SECTION_IDX);
+        return 0;
     }
-    else{
-        luaL_error(L, "internal logic error when parsing list");
+
+    /* k=v pair (aka a record) */
+    case CINIC_EV_RECORD:
+        if (reserve(b, 2)) goto nomem;
+        lua_pushstring(L, k);
+        lua_pushstring(L, v);
+        break;
+
+    /* start of a list/array: its items follow its key */
+    case CINIC_EV_LIST_HEAD:
+        if (reserve(b, 1)) goto nomem;
+        lua_pushstring(L, k);
+        b->list = lua_gettop(L);
+        b->array = false;
+        b->idx = 1;   /* use numeric indices for arrays */
+        break;
+
+    case CINIC_EV_LIST_ITEM:
+        assert(b->list);
+        if (reserve(b, 1)) goto nomem;
+        lua_pushstring(L, v);
+        break;
+
+    default:
+        break;
     }
 
-    lua_settop(L,1); /* only leave the outermost parent table */
     return 0;
+
+nomem:
+    b->nomem = true;
+    return -1;
 }
 
 /*
@@ -133,9 +310,9 @@ int populate_lua_state(lua_State *L,
  * than being left up to the user:
  *  * empty lists are allowed
  *
- *  See Cinic_parse() in cinic.c for comments on the variables used
- *  in this function. This function is essentially equivalent to
- *  Cinic_parse(), but serves to interface with Lua.
+ * The config is parsed by the same engine as Cinic_parse_ex(), through
+ * Cinic_parse_events(); this function only turns what the parser finds
+ * into tables and its errors into lua errors.
  */
 int parse_ini_config_file(lua_State *L){
     /* get lua params */
@@ -149,160 +326,230 @@ int parse_ini_config_file(lua_State *L){
     }
     memcpy(path, arg, strlen(arg));
 
-    /* defaults if unspecified by the caller */
-    bool allow_globals      = false;
-    bool allow_empty_lists  = true;  /* implcitly allow this for lua */
-    const char *ns_delim    = ".";
+    struct cinic_ctx ctx;
+    check_parse_options(L, &ctx);
 
-    /* check initialization flags */
-    if (lua_type(L, 2) != LUA_TNIL){
-        luaL_checktype(L, 2, LUA_TBOOLEAN);
-        allow_globals = lua_toboolean(L,2);
-    }
-    if (lua_type(L, 3) != LUA_TNONE){
-        const char *delim = luaL_checkstring(L, 3);
-        /* must be a single char! */
-        if (strlen(delim) > 1){
-            luaL_error(L, "Invalid delimiter provided: '%s' -- must be a single char", delim);
+    struct lua_builder b = {
+        .L = L,
+        .ns_sep = ctx.section_ns_sep,
+        .idx = 1
+    };
+
+    /* the lua table to hold the config data, returned at the end, and
+     * that of the global section: made once their sizes are known */
+    lua_settop(L, 0);
+    lua_pushnil(L);
+    lua_pushnil(L);
+
+    struct cinic_diag diag;
+    int rc = Cinic_parse_events(&ctx, path, populate_lua_state, &b, &diag);
+    if (!rc){
+        close_list(&b);
+        flush_section(&b);
+        if (lua_isnil(L, LUA_ROOT_IDX)){
+            lua_newtable(L);
+            lua_replace(L, LUA_ROOT_IDX);
         }
-        ns_delim = delim;
     }
-    /* initialize cinic parser */
-    Cinic_init(allow_globals, allow_empty_lists, ns_delim);
-
-    /* parser state */
-	int rc = 0;
-	char key[MAX_LINE_LEN]     = {0};
-	char val[MAX_LINE_LEN]     = {0};
-	char section[MAX_LINE_LEN] = {0};
-
-    enum cinic_list_state list = NOLIST;    /* to assess list state transitions */
-    bool islast = false;                    /* final list item */
-    uint32_t ln = 0;                        /* line number */
-    uint32_t bytes_read = 0;                /* bytes read by getline; 0 on EOF */
-
-    /* allocated and resized by `getline()` as needed */
-    char *buff__ = NULL;   // pointer must not change; kept intact for eventual free() call
-    char *buff = buff__;   // change this instead
-    size_t buffsz = 0;
-
-	FILE *f = fopen(path, "r");
-	if (!f){
-		luaL_error(L, "Failed to open file:'%s'", path);
-	}
-
-    /* start new lua table to hold the config data; returned at the end */
-    lua_settop(L, 0);
+
+    buff_free(&b.section);
+
+    if (rc){
+        if (b.nomem) diag.code = CINIC_NOMEM;
+        push_parse_error(L, path, &diag);
+        free(path);
+        lua_error(L);
+    }
+
+    free(path);
+    lua_settop(L, LUA_ROOT_IDX);
+    return 1;   /* success */
+}
+
+
+/*
+ * Lazy, read-only view of a parsed config, as returned by cinic.open():
+ * rather than being turned into tables up front, the config is loaded
+ * into a native document (see Cinic_load()) and proxies look sections
+ * and keys up in it as they are indexed. Time and lua heap are only
+ * spent on what is actually accessed.
+ *
+ * Each proxy stands for a section (the outermost one for the global
+ * section) and is a userdata whose user value is a table caching the
+ * lists and nested section proxies already handed out, so that these
+ * are only made once. All the proxies of a document keep the
+ * outermost proxy, which owns the document, alive by holding it at
+ * index 1 of their cache.
+ */
+#define LUA_SECTION_MT "cinic.section"
+
+struct lua_section{
+    struct cinic_doc *doc;  /* shared by all the proxies of a document */
+    bool owner;             /* doc is to be freed along with this proxy */
+    char ns_sep;            /* section title namespace separator */
+    char title[];           /* of the section; "" for the global one */
+};
+
+/*
+ * Push a new proxy for the section title of doc. root is the stack
+ * index of the proxy owning doc, or 0 if the new proxy is to own it.
+ */
+void push_section_proxy(lua_State *L, struct cinic_doc *doc, char ns_sep, const char *title, size_t len, int root){
+    struct lua_section *sect = lua_newuserdata(L, sizeof(*sect) + len + 1);
+    sect->doc = doc;
+    sect->owner = !root;
+    sect->ns_sep = ns_sep;
+    memcpy(sect->title, title, len);
+    sect->title[len] = '\0';
+    luaL_setmetatable(L, LUA_SECTION_MT);
+
     lua_newtable(L);
+    if (root){
+        lua_pushvalue(L, root);
+        lua_rawseti(L, -2, 1);
+    }
+    lua_setuservalue(L, -2);
+}
+
+/*
+ * __index metamethod of section proxies: proxy[key] is the value of
+ * the record key in the section, a table holding the items of the
+ * list key, or a proxy for the section nested in it under the name
+ * key, in that order; else nil.
+ */
+int section_index(lua_State *L){
+    struct lua_section *sect = luaL_checkudata(L, 1, LUA_SECTION_MT);
+    if (lua_type(L, 2) != LUA_TSTRING){
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_settop(L, 2);
+    const char *key = lua_tostring(L, 2);
 
-    /* for each line read from config file */
-    while ( ( bytes_read = read_line(f, &buff__, &buffsz)) ){
-        ++ln;
-        buff = buff__;
-        say(" ~ read line %u: '%s'", ln, buff);
+    const char *v = Cinic_get(sect->doc, sect->title, key);
+    if (v){
+        lua_pushstring(L, v);
+        return 1;
+    }
 
-        /* line too long */
-        if(bytes_read > MAX_LINE_LEN){
-            dispatch_lua_error(L, CINIC_TOOLONG, ln);
+    /* lists and nested sections already handed out */
+    lua_getuservalue(L, 1);  /* 3: cache */
+    lua_pushvalue(L, 2);
+    if (lua_rawget(L, 3) != LUA_TNIL){
+        return 1;
+    }
+    lua_pop(L, 1);
+
+    size_t nitems;
+    const char *const *items = Cinic_get_list(sect->doc, sect->title, key, &nitems);
+    if (items){
+        lua_createtable(L, nitems > INT_MAX ? INT_MAX : (int)nitems, 0);
+        for (size_t i = 0; i < nitems; ++i){
+            lua_pushstring(L, items[i]);
+            lua_rawseti(L, -2, i + 1);
         }
-
-        if (is_empty_line(buff) || is_comment_line(buff) ){
-            continue;
+    }
+    else{
+        /* nested sections are only reached one namespace at a time */
+        if (strchr(key, sect->ns_sep)){
+            lua_pushnil(L);
+            return 1;
+        }
+        if (*sect->title){
+            lua_pushfstring(L, "%s%c%s", sect->title, sect->ns_sep, key);
+        }else{
+            lua_pushvalue(L, 2);
+        }
+        size_t len;
+        const char *title = lua_tolstring(L, -1, &len);
+        if (!Cinic_has_section(sect->doc, title)){
+            lua_pushnil(L);
+            return 1;
         }
+        if (lua_rawgeti(L, 3, 1) == LUA_TNIL){  /* sect is the root */
+            lua_pop(L, 1);
+            lua_pushvalue(L, 1);
+        }
+        push_section_proxy(L, sect->doc, sect->ns_sep, title, len, lua_gettop(L));
+    }
 
-		buff = strip_lws(buff);
-		strip_comment(buff);
-		strip_tws(buff);
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, 3);
+    return 1;
+}
 
-        /* section title line */
-        if(is_section_line(buff, section, MAX_LINE_LEN)){
-            say(" ~ line %u is a section title\n", ln);
-            if (list){
-                dispatch_lua_error(L, CINIC_NESTED, ln);
-            }
-        }
+/* __newindex metamethod of section proxies */
+int section_newindex(lua_State *L){
+    return luaL_error(L, "Cinic: configs opened with cinic.open() are read-only");
+}
 
-        /*  key-value line */
-        else if (is_record_line(buff, key, val, MAX_LINE_LEN)){
-            say(" ~ line %u is a record line\n", ln);
-            if (! *section && !ALLOW_GLOBAL_RECORDS){
-                dispatch_lua_error(L, CINIC_NOSECTION, ln);
-            }else if (list){
-                dispatch_lua_error(L, CINIC_NESTED, ln);
-            }
-			if ( (rc = populate_lua_state(L, ln, list, section, key, val)) ) return rc;
-        }
+/* __tostring metamethod of section proxies */
+int section_tostring(lua_State *L){
+    struct lua_section *sect = luaL_checkudata(L, 1, LUA_SECTION_MT);
+    lua_pushfstring(L, "cinic section: '%s'", sect->title);
+    return 1;
+}
 
-        /* else, try list */
-		else {
-            say(" ~ trying list parsing on line %u\n", ln);
-			char curr_token_buff[MAX_LINE_LEN] = {0};
-			char *next_token = buff; /* initialize */
-            enum cinic_error cerr;
-
-			while ((next_token = get_list_token(next_token, curr_token_buff, MAX_LINE_LEN))){
-                say("---> current token = '%s'\n", curr_token_buff);
-
-                /* list head */
-				if(is_list_head(curr_token_buff, key, MAX_LINE_LEN)){
-                    if ( (cerr = Cinic_get_list_error(list, LIST_HEAD)) ){
-                        dispatch_lua_error(L, cerr, ln);
-                    }
-					list = LIST_HEAD;
-					islast = false;
-				}
-
-                /* opening bracket */
-                else if (is_list_start(curr_token_buff)){
-                    if ( (cerr = Cinic_get_list_error(list, LIST_OPEN)) ){
-                        dispatch_lua_error(L, cerr, ln);
-                    }
-                    list = LIST_OPEN;
-                    continue;
-                }
-
-                /* list entry */
-				else if(is_list_entry(curr_token_buff, val, MAX_LINE_LEN, &islast)){
-                    if ( (cerr = Cinic_get_list_error(list, islast ? LIST_LAST : LIST_ONGOING)) ){
-                        dispatch_lua_error(L, cerr, ln);
-                    }
-					list = islast ? LIST_LAST : LIST_ONGOING; /* reset :  */
-				}
-
-                /* list end */
-				else if(is_list_end(curr_token_buff)){
-                    if ( (cerr = Cinic_get_list_error(list, NOLIST)) ){
-                        dispatch_lua_error(L, cerr, ln);
-                    }
-					list = NOLIST;
-					continue;
-				}
-
-                /* not a list component/token recognized as valid */
-                /* not any kind of line recognized as valid */
-				else{
-                    dispatch_lua_error(L, CINIC_MALFORMED, ln);
-				}
-
-				if ( (rc = populate_lua_state(L, ln, list, section, key, val)) ) return rc;
-			} /* while: list token parsing */
-		} /* if: try list parsing */
-    } /* while getline() */
-
-    fclose(f);
-    free(buff__);
-    return 1;   /* success */
+/* __gc metamethod of section proxies */
+int section_gc(lua_State *L){
+    struct lua_section *sect = luaL_checkudata(L, 1, LUA_SECTION_MT);
+    if (sect->owner){
+        Cinic_doc_free(sect->doc);
+        sect->doc = NULL;
+    }
+    return 0;
+}
+
+const struct luaL_Reg section_meta[] = {
+    {"__index", section_index},
+    {"__newindex", section_newindex},
+    {"__tostring", section_tostring},
+    {"__gc", section_gc},
+    {NULL, NULL}
+};
+
+/*
+ * Load the specified .ini config file and return a lazy, read-only
+ * proxy for it (see struct lua_section): indexing it gives the same
+ * values as indexing the table returned by cinic.parse() would, but
+ * they are only looked up when asked for.
+ *
+ * Takes the same arguments as, and fails like, parse_ini_config_file().
+ * Proxies cannot be iterated over with pairs().
+ */
+int open_ini_config_file(lua_State *L){
+    lua_settop(L, 3);
+    const char *path = luaL_checkstring(L, 1);
+
+    struct cinic_ctx ctx;
+    check_parse_options(L, &ctx);
+
+    struct cinic_diag diag;
+    struct cinic_doc *doc = Cinic_load(&ctx, path, &diag);
+    if (!doc){
+        push_parse_error(L, path, &diag);
+        return lua_error(L);
+    }
+
+    push_section_proxy(L, doc, ctx.section_ns_sep[0], "", 0, 0);
+    return 1;
 }
 
 
 /* Module functions */
 const struct luaL_Reg cinic[] = {
     {"parse", parse_ini_config_file},
+    {"open", open_ini_config_file},
     {NULL, NULL}
 };
 
 /* Open/initialize module */
 int luaopen_cinic(lua_State *L){
+    luaL_newmetatable(L, LUA_SECTION_MT);
+    luaL_setfuncs(L, section_meta, 0);
+    lua_pop(L, 1);
+
     luaL_newlib(L, cinic);
     return 1;
 }
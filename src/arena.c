@@ -0,0 +1,142 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cinic.h"
+#include "utils__.h"
+
+/*
+ * Bump allocator: memory is handed out from a few large blocks, in
+ * order, and is only ever released all at once, by freeing the whole
+ * arena. Allocating is a pointer increment in the common case and
+ * everything allocated from the same arena ends up next to each other.
+ */
+
+/* size of the first block; each new block is twice the previous one */
+#define ARENA_MIN_BLOCK (16U << 10)
+#define ARENA_MAX_BLOCK (1U << 20)
+
+/* alignment of the memory returned by Cinic_arena_alloc() */
+#define ARENA_ALIGN (sizeof(union arena_align))
+
+union arena_align{
+    void *p;
+    long long ll;
+    long double ld;
+    void (*fp)(void);
+};
+
+struct arena_block{
+    struct arena_block *prev;   /* block filled before this one */
+    size_t size;                /* bytes in data */
+    size_t used;                /* bytes of data handed out */
+    union arena_align data[];   /* the memory handed out */
+};
+
+struct cinic_arena{
+    struct arena_block *head;   /* block currently allocated from */
+    size_t next_size;           /* size of the next block to add */
+};
+
+/*
+ * Return a new, empty arena, or NULL if out of memory. */
+struct cinic_arena *Cinic_arena_new(void){
+    struct cinic_arena *a = calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    a->next_size = ARENA_MIN_BLOCK;
+    return a;
+}
+
+/*
+ * Release all memory allocated from arena a, and a itself. a may be
+ * NULL. */
+void Cinic_arena_free(struct cinic_arena *a){
+    if (!a) return;
+
+    struct arena_block *b = a->head;
+    while (b){
+        struct arena_block *prev = b->prev;
+        free(b);
+        b = prev;
+    }
+    free(a);
+}
+
+/*
+ * Add a block of at least size bytes to a. Requests bigger than the
+ * block size get a block of their own, which goes behind the current
+ * one so the space left there is not wasted. Return the block, or NULL
+ * if out of memory.
+ */
+static struct arena_block *arena_grow(struct cinic_arena *a, size_t size){
+    bool own = (size > a->next_size);
+    size_t bsize = own ? size : a->next_size;
+
+    if (bsize > SIZE_MAX - sizeof(struct arena_block)) return NULL;
+    struct arena_block *b = malloc(sizeof(*b) + bsize);
+    if (!b) return NULL;
+    b->size = bsize;
+    b->used = 0;
+
+    if (own && a->head){
+        b->prev = a->head->prev;
+        a->head->prev = b;
+    }else{
+        b->prev = a->head;
+        a->head = b;
+        if (a->next_size < ARENA_MAX_BLOCK) a->next_size *= 2;
+    }
+    return b;
+}
+
+/*
+ * Return size bytes allocated from a, aligned to align (a power of 2
+ * no greater than ARENA_ALIGN), or NULL if out of memory.
+ */
+void *arena_alloc(struct cinic_arena *a, size_t size, size_t align){
+    assert(a && align && !(align & (align - 1)) && align <= ARENA_ALIGN);
+
+    struct arena_block *b = a->head;
+    if (b){
+        size_t off = (b->used + align - 1) & ~(align - 1);
+        if (off <= b->size && size <= b->size - off){
+            b->used = off + size;
+            return (char *)b->data + off;
+        }
+    }
+
+    /* blocks start out suitably aligned */
+    if (!(b = arena_grow(a, size))) return NULL;
+    b->used = size;
+    return b->data;
+}
+
+/*
+ * Return a NUL-terminated copy of the len bytes at s allocated from a,
+ * or NULL if out of memory.
+ */
+char *arena_strndup(struct cinic_arena *a, const char *s, size_t len){
+    if (len == SIZE_MAX) return NULL;
+
+    char *copy = arena_alloc(a, len + 1, 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/*
+ * Return size bytes allocated from a, suitably aligned for any type,
+ * or NULL if out of memory. The memory is released with the arena.
+ */
+void *Cinic_arena_alloc(struct cinic_arena *a, size_t size){
+    return arena_alloc(a, size, ARENA_ALIGN);
+}
+
+/*
+ * Return a copy of the string s allocated from a, or NULL if out of
+ * memory. */
+char *Cinic_arena_strdup(struct cinic_arena *a, const char *s){
+    assert(s);
+    return arena_strndup(a, s, strlen(s));
+}
@@ -0,0 +1,347 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "cinic.h"
+#include "utils__.h"
+
+/*
+ * Cache of documents, keyed by path and checked against the identity
+ * of the file (see struct file_id) on every lookup.
+ *
+ * A document loaded with includes (see cinic_ctx.includes) is only as
+ * fresh as the files and directories it was loaded from, so those are
+ * checked too, against their identity when first read.
+ *
+ * Entries are found through a chained hash table keyed by path, and
+ * kept on a list in order of use, most recent first, so that the least
+ * recently used can be dropped once the cache is over its limits.
+ * Documents are reference counted: one dropped from the cache while
+ * still in use is only freed once the last user hands it back.
+ *
+ * Files are parsed, and the includes of cached documents checked,
+ * without holding the lock, so that a thread loading a big config or
+ * one with many includes does not hold up lookups of others.
+ */
+
+struct cache_entry{
+    struct cache_entry *chain;      /* next in the same hash bucket */
+    struct cache_entry *prev, *next;   /* in order of use, most recent first */
+    uint32_t hash;                  /* str_hash() of path */
+    char *path;
+    struct file_id id;
+    struct cinic_doc *doc;
+    size_t refs;                    /* times handed out and not yet released */
+    bool cached;                    /* still in the cache */
+};
+
+struct cinic_cache{
+    pthread_mutex_t lock;
+    struct cinic_ctx ctx;
+    size_t max_docs, max_bytes;     /* 0 if unlimited */
+    size_t ndocs, nbytes;
+    struct cache_entry **buckets;
+    size_t nbuckets;                /* always a power of 2 */
+    struct cache_entry *first, *last;
+    uint64_t hits, misses;
+};
+
+#define CACHE_MIN_BUCKETS 64
+
+static bool same_file(const struct file_id *a, const struct file_id *b){
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size
+        && a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+/*
+ * Get the identity of the file at path into *id. Return 0 on success,
+ * or else an errno value. */
+int file_id(const char *path, struct file_id *id){
+    struct stat sb;
+    if (stat(path, &sb)) return errno;
+    id->dev = sb.st_dev;
+    id->ino = sb.st_ino;
+    id->size = sb.st_size;
+    id->mtime = sb.st_mtim;
+    return 0;
+}
+
+/*
+ * Return true if none of the files and directories doc was loaded
+ * from, besides the config itself, has changed since. */
+static bool sources_unchanged(const struct cinic_doc *doc){
+    struct file_id id;
+    for (size_t i = 0; i < doc->nsources; ++i){
+        if (file_id(doc->sources[i].path, &id) || !same_file(&doc->sources[i].id, &id)) return false;
+    }
+    return true;
+}
+
+/*
+ * Return true if a and b were loaded from the same files and
+ * directories, as they were at the time, besides the config itself.
+ * Unlike sources_unchanged(), this does not touch the file system. */
+static bool same_sources(const struct cinic_doc *a, const struct cinic_doc *b){
+    if (a->nsources != b->nsources) return false;
+    for (size_t i = 0; i < a->nsources; ++i){
+        if (strcmp(a->sources[i].path, b->sources[i].path) ||
+                !same_file(&a->sources[i].id, &b->sources[i].id))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Return a new, empty cache; see cinic.h. */
+struct cinic_cache *Cinic_cache_new(const struct cinic_ctx *ctx, size_t max_docs, size_t max_bytes){
+    assert(ctx);
+
+    struct cinic_cache *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+
+    c->ctx = *ctx;
+    c->max_docs = max_docs;
+    c->max_bytes = max_bytes;
+    c->nbuckets = CACHE_MIN_BUCKETS;
+    c->buckets = calloc(c->nbuckets, sizeof(*c->buckets));
+    if (!c->buckets || pthread_mutex_init(&c->lock, NULL)){
+        free(c->buckets);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static void entry_free(struct cache_entry *e){
+    Cinic_doc_free(e->doc);
+    free(e->path);
+    free(e);
+}
+
+/*
+ * Give up a reference to e, freeing it if that was the last one and it
+ * is no longer cached. The cache e was in must be locked. */
+static void entry_put(struct cache_entry *e){
+    assert(e->refs);
+    if (!--e->refs && !e->cached) entry_free(e);
+}
+
+/*
+ * Return the entry for path, whose str_hash() is hash, or NULL if there
+ * is none. c must be locked. */
+static struct cache_entry *cache_find(const struct cinic_cache *c, const char *path, uint32_t hash){
+    struct cache_entry *e = c->buckets[hash & (c->nbuckets - 1)];
+    while (e && (e->hash != hash || strcmp(e->path, path))) e = e->chain;
+    return e;
+}
+
+/* move e to the front of the list of entries of c, or put it there */
+static void cache_touch(struct cinic_cache *c, struct cache_entry *e){
+    if (c->first == e) return;
+
+    /* unlink, if linked */
+    if (e->prev) e->prev->next = e->next;
+    if (e->next) e->next->prev = e->prev;
+    if (c->last == e) c->last = e->prev;
+
+    e->prev = NULL;
+    e->next = c->first;
+    if (c->first) c->first->prev = e;
+    c->first = e;
+    if (!c->last) c->last = e;
+}
+
+/*
+ * Take e out of c. e is freed, unless still in use; see
+ * Cinic_cache_release(). c must be locked. */
+static void cache_drop(struct cinic_cache *c, struct cache_entry *e){
+    struct cache_entry **p = &c->buckets[e->hash & (c->nbuckets - 1)];
+    while (*p != e) p = &(*p)->chain;
+    *p = e->chain;
+
+    if (e->prev) e->prev->next = e->next;
+    else c->first = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else c->last = e->prev;
+
+    c->ndocs--;
+    c->nbytes -= e->id.size;
+    e->cached = false;
+    if (!e->refs) entry_free(e);
+}
+
+/*
+ * Double the number of buckets of c, if possible; c then just stays
+ * as it is. c must be locked. */
+static void cache_grow(struct cinic_cache *c){
+    size_t n = 2 * c->nbuckets;
+    struct cache_entry **buckets = calloc(n, sizeof(*buckets));
+    if (!buckets) return;
+
+    for (size_t i = 0; i < c->nbuckets; ++i){
+        struct cache_entry *e = c->buckets[i], *next;
+        for (; e; e = next){
+            next = e->chain;
+            e->chain = buckets[e->hash & (n - 1)];
+            buckets[e->hash & (n - 1)] = e;
+        }
+    }
+    free(c->buckets);
+    c->buckets = buckets;
+    c->nbuckets = n;
+}
+
+/*
+ * Add e to c, dropping the least recently used entries to keep within
+ * the limits of c; e itself is always kept. c must be locked. */
+static void cache_add(struct cinic_cache *c, struct cache_entry *e){
+    if (c->ndocs + 1 > c->nbuckets) cache_grow(c);
+
+    struct cache_entry **bucket = &c->buckets[e->hash & (c->nbuckets - 1)];
+    e->chain = *bucket;
+    *bucket = e;
+    e->cached = true;
+    cache_touch(c, e);
+    c->ndocs++;
+    c->nbytes += e->id.size;
+
+    while (c->last != e && ((c->max_docs && c->ndocs > c->max_docs)
+                            || (c->max_bytes && c->nbytes > c->max_bytes)))
+    {
+        cache_drop(c, c->last);
+    }
+}
+
+/*
+ * Return the document of the file at path, from cache or freshly
+ * loaded; see cinic.h.
+ *
+ * NOTES:
+ *  - cache and path must not be NULL; diag may be NULL
+ */
+const struct cinic_doc *Cinic_cache_get(struct cinic_cache *cache, const char *path, struct cinic_diag *diag){
+    assert(cache && path);
+
+    struct cinic_diag dummy;
+    if (!diag) diag = &dummy;
+    memset(diag, 0, sizeof(*diag));
+
+    struct file_id id;
+    int err = file_id(path, &id);
+    if (err){
+        diag->code = CINIC_IO;
+        diag->errnum = err;
+        return NULL;
+    }
+
+    uint32_t hash = str_hash(path, strlen(path));
+    struct cache_entry *e;
+
+    pthread_mutex_lock(&cache->lock);
+    if ( (e = cache_find(cache, path, hash)) && same_file(&e->id, &id) ){
+        /* hold on to e while its includes are checked, which means a stat() each */
+        e->refs++;
+        bool unchanged = true;
+        if (e->doc->nsources){
+            pthread_mutex_unlock(&cache->lock);
+            unchanged = sources_unchanged(e->doc);
+            pthread_mutex_lock(&cache->lock);
+        }
+        if (unchanged){
+            cache->hits++;
+            if (e->cached) cache_touch(cache, e);
+            pthread_mutex_unlock(&cache->lock);
+            return e->doc;
+        }
+        if (e->cached) cache_drop(cache, e);
+        entry_put(e);
+    }
+    cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    /* load it without holding up lookups of other files */
+    struct cache_entry *fresh = calloc(1, sizeof(*fresh));
+    if (!fresh || !(fresh->path = strdup(path))){
+        free(fresh);
+        diag->code = CINIC_NOMEM;
+        return NULL;
+    }
+    if (!(fresh->doc = Cinic_load(&cache->ctx, path, diag))){
+        entry_free(fresh);
+        return NULL;
+    }
+    fresh->doc->cached = fresh;
+    fresh->hash = hash;
+    fresh->id = id;
+    fresh->refs = 1;
+
+    pthread_mutex_lock(&cache->lock);
+    if ( (e = cache_find(cache, path, hash)) ){
+        if (same_file(&e->id, &id) && same_sources(e->doc, fresh->doc)){
+            /* another thread loaded the same file in the meantime */
+            e->refs++;
+            cache_touch(cache, e);
+            pthread_mutex_unlock(&cache->lock);
+            entry_free(fresh);
+            return e->doc;
+        }
+        cache_drop(cache, e);
+    }
+    cache_add(cache, fresh);
+    pthread_mutex_unlock(&cache->lock);
+    return fresh->doc;
+}
+
+/*
+ * Hand back doc, as got from cache; see cinic.h. */
+void Cinic_cache_release(struct cinic_cache *cache, const struct cinic_doc *doc){
+    assert(cache && doc && doc->cached);
+
+    struct cache_entry *e = doc->cached;
+    pthread_mutex_lock(&cache->lock);
+    entry_put(e);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * Drop the document of path, or all of them, from cache; see cinic.h. */
+void Cinic_cache_invalidate(struct cinic_cache *cache, const char *path){
+    assert(cache);
+
+    pthread_mutex_lock(&cache->lock);
+    if (path){
+        struct cache_entry *e = cache_find(cache, path, str_hash(path, strlen(path)));
+        if (e) cache_drop(cache, e);
+    }else{
+        while (cache->first) cache_drop(cache, cache->first);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void Cinic_cache_stats(struct cinic_cache *cache, uint64_t *hits, uint64_t *misses){
+    assert(cache);
+
+    pthread_mutex_lock(&cache->lock);
+    if (hits) *hits = cache->hits;
+    if (misses) *misses = cache->misses;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * Free cache and the documents in it; see cinic.h. */
+void Cinic_cache_free(struct cinic_cache *cache){
+    if (!cache) return;
+
+    while (cache->first){
+        assert(!cache->first->refs);
+        cache_drop(cache, cache->first);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
@@ -2,53 +2,133 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <string.h>     /* meset(), strlen() */
 #include <sys/types.h>  /* ssize_t */
-#include <ctype.h>      /* ASCII char type functions */
 #include <inttypes.h>   /* PRIu32 etc */
+#include <fcntl.h>      /* open() */
+#include <unistd.h>     /* close() */
+#include <sys/stat.h>   /* fstat() */
+#include <sys/mman.h>   /* mmap(), posix_madvise() */
+#include <pthread.h>
+#include <dirent.h>     /* opendir() */
+#include <glob.h>       /* glob() */
 
 #include "cinic.h"
 #include "utils__.h"
 
 /*
- * By default each key-value entry must appear following a section
- * declaration. Setting this to true makes it legal (where it would
- * otherwise produce an error) to have 'global' key-value entries
- * (or lists) i.e. entries that precede any section declarations.
+ * Character classes.
+ *
+ * Every byte falls in exactly one class. Bracket characters are
+ * classified according to the list brackets in use: '[' and ']' always
+ * delimit section titles, and may or may not also be the list brackets.
  */
-bool ALLOW_GLOBAL_RECORDS=0;
+enum cinic_cclass{
+    CC_OTHER = 0,    /* anything else: never valid outside of a comment */
+    CC_ALLOWED,      /* see is_allowed() */
+    CC_SPACE,        /* whitespace */
+    CC_EQUALS,       /* '=' */
+    CC_COMMA,        /* ',' */
+    CC_END,          /* comment symbol, NUL or end of line: nothing after is significant */
+    CC_SOPEN,        /* '[' that is NOT also the opening list bracket */
+    CC_SCLOSE,       /* ']' that is NOT also the closing list bracket */
+    CC_LOPEN,        /* opening list bracket other than '[' */
+    CC_LCLOSE,       /* closing list bracket other than ']' */
+    CC_BOPEN,        /* '[' used as the opening list bracket too */
+    CC_BCLOSE,       /* ']' used as the closing list bracket too */
+    CC_COUNT
+};
 
 /*
- * By default an empty list (list without elements) produces an error.
- * Setting this to true will make such list occurences in an .ini file
- * legal. This is still discouraged practice though as empty lists
- * are useless.
+ * Initializer for a 256-entry table mapping each byte to its character
+ * class. OPEN and CLOSE are the classes of '[' and ']', respectively.
+ * Bytes not listed (including all non-ASCII ones) are CC_OTHER.
  */
-bool ALLOW_EMPTY_LISTS=0;
+#define CINIC_CCLASS_TABLE(OPEN, CLOSE) { \
+    ['0'] = CC_ALLOWED, ['1'] = CC_ALLOWED, ['2'] = CC_ALLOWED, ['3'] = CC_ALLOWED, ['4'] = CC_ALLOWED, \
+    ['5'] = CC_ALLOWED, ['6'] = CC_ALLOWED, ['7'] = CC_ALLOWED, ['8'] = CC_ALLOWED, ['9'] = CC_ALLOWED, \
+    ['A'] = CC_ALLOWED, ['B'] = CC_ALLOWED, ['C'] = CC_ALLOWED, ['D'] = CC_ALLOWED, ['E'] = CC_ALLOWED, \
+    ['F'] = CC_ALLOWED, ['G'] = CC_ALLOWED, ['H'] = CC_ALLOWED, ['I'] = CC_ALLOWED, ['J'] = CC_ALLOWED, \
+    ['K'] = CC_ALLOWED, ['L'] = CC_ALLOWED, ['M'] = CC_ALLOWED, ['N'] = CC_ALLOWED, ['O'] = CC_ALLOWED, \
+    ['P'] = CC_ALLOWED, ['Q'] = CC_ALLOWED, ['R'] = CC_ALLOWED, ['S'] = CC_ALLOWED, ['T'] = CC_ALLOWED, \
+    ['U'] = CC_ALLOWED, ['V'] = CC_ALLOWED, ['W'] = CC_ALLOWED, ['X'] = CC_ALLOWED, ['Y'] = CC_ALLOWED, \
+    ['Z'] = CC_ALLOWED, \
+    ['a'] = CC_ALLOWED, ['b'] = CC_ALLOWED, ['c'] = CC_ALLOWED, ['d'] = CC_ALLOWED, ['e'] = CC_ALLOWED, \
+    ['f'] = CC_ALLOWED, ['g'] = CC_ALLOWED, ['h'] = CC_ALLOWED, ['i'] = CC_ALLOWED, ['j'] = CC_ALLOWED, \
+    ['k'] = CC_ALLOWED, ['l'] = CC_ALLOWED, ['m'] = CC_ALLOWED, ['n'] = CC_ALLOWED, ['o'] = CC_ALLOWED, \
+    ['p'] = CC_ALLOWED, ['q'] = CC_ALLOWED, ['r'] = CC_ALLOWED, ['s'] = CC_ALLOWED, ['t'] = CC_ALLOWED, \
+    ['u'] = CC_ALLOWED, ['v'] = CC_ALLOWED, ['w'] = CC_ALLOWED, ['x'] = CC_ALLOWED, ['y'] = CC_ALLOWED, \
+    ['z'] = CC_ALLOWED, \
+    ['.'] = CC_ALLOWED, ['-'] = CC_ALLOWED, ['_'] = CC_ALLOWED, ['@'] = CC_ALLOWED, ['/'] = CC_ALLOWED, \
+    ['*'] = CC_ALLOWED, ['?'] = CC_ALLOWED, ['%'] = CC_ALLOWED, ['&'] = CC_ALLOWED, \
+    [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, \
+    ['\r'] = CC_SPACE, \
+    ['\0'] = CC_END, [';'] = CC_END, ['#'] = CC_END, \
+    ['='] = CC_EQUALS, [','] = CC_COMMA, \
+    ['['] = OPEN, [']'] = CLOSE \
+}
 
 /*
- * Set the namespace delimiter in section titles e.g.
- * section.subsection.subsubsection; '.' is the default.
- * Note this is only significant for the lua or C++ wrappers as
- * there the parser returns a table/map where namespace nesting
- * is represented by table/map nesting. In C code however the
- * parser simply calls a user-registered callback and section names
- * are returned as whole strings. It's up to the user whether
- * they want to split it up into a namespace hierarchy or not.
+ * Character classes independent of the list brackets in use; the
+ * starting point for the table of each context (see Cinic_ctx_init()).
  */
-const char *SECTION_NS_SEP = ".";
+static const uint8_t base_cclass[256] = CINIC_CCLASS_TABLE(CC_SOPEN, CC_SCLOSE);
+
+/*
+ * Context used by Cinic_parse(); its settings can be changed via
+ * Cinic_init(). See struct cinic_ctx in cinic.h for the meaning
+ * of each field.
+ */
+static struct cinic_ctx default_ctx = {
+    .allow_globals     = false,
+    .allow_empty_lists = false,
+    .section_ns_sep    = ".",
+    .list_bracket      = {'[', ']'},
+    .cclass            = CINIC_CCLASS_TABLE(CC_BOPEN, CC_BCLOSE)
+};
+
+/* A file being parsed, for include cycles to be caught; see include_file() */
+struct include_frame{
+    dev_t dev;
+    ino_t ino;
+    const struct include_frame *prev;   /* the file that includes this one */
+};
 
 /*
- * By default, lists are opened and closed using square brackets
- * ('[', ']'). The user can however customize this by setting
- * LIST_BRACKET to something else, such as curly braces ('{'. '}').
- * The symbol chosen MUST NOT appear anywhere else in that list.
+ * Per-call parser state.
  *
- * LIST_BRACKET MUST be a 2-char string, with LIST_BRACKET[0]
- * being the opening bracket and LIST_BRACKET[1] being the closing
- * bracket.
+ * Everything that changes while a file is being parsed lives here,
+ * on the stack of the caller of Cinic_parse_ex(), so that concurrent
+ * calls do not share any mutable state.
  */
-const char *LIST_BRACKET = "[]";
+struct cinic_parser{
+    const struct cinic_ctx *ctx;
+    config_cb cb;
+    uint32_t ln;                   /* line number */
+    enum cinic_list_state list;    /* to assess list state transitions */
+    bool islast;                   /* final list item */
+    bool in_section;               /* a section title has been seen */
+    cinic_sink sink;               /* if set, called instead of cb; see emit() */
+    cinic_event_cb ecb;            /* if set, called instead of cb; see emit() */
+    config_view_cb vcb;            /* if set, called instead of cb; see emit() */
+    void *ud;                      /* passed to sink, ecb or vcb */
+    struct cinic_diag *diag;       /* where to report errors; never NULL */
+    bool lint;                     /* collect errors in diags and carry on, instead of stopping */
+    bool resync;                   /* skipping list tokens after an error; see parse_line() */
+    struct cinic_diag *diags;      /* errors collected so far, when linting */
+    size_t ndiags, diags_cap;
+    struct cinic_buff key;         /* NUL-terminated copies of the tokens handed to cb */
+    struct cinic_buff val;
+    struct cinic_buff section;
+    size_t key_len;                /* of the strings in key and section, for vcb */
+    size_t section_len;
+    struct parse_chunk *chunk;     /* if set, events are recorded there instead; see emit() */
+    const char *path;              /* of the file being parsed; NULL for a buffer */
+    unsigned depth;                /* of includes; 0 in the config itself */
+    const struct include_frame *files;  /* being parsed, innermost first */
+    size_t nsections;              /* section events so far, when following includes */
+};
 
 /*
  * Map of cinic error number to error string;
@@ -60,7 +140,7 @@ static const char *cinic_error_strings[] = {
     [CINIC_NOSECTION]         = "entry without section",
     [CINIC_MALFORMED]         = "malformed/syntacticaly incorrect",
     [CINIC_MALFORMED_LIST]    = "malformed/syntacticaly incorrect list",
-    [CINIC_TOOLONG]           = "line length exceeds maximum acceptable length(" tostring(MAX_LINE_LEN) ")",
+    [CINIC_TOOLONG]           = "line length exceeds maximum acceptable length",
     [CINIC_NESTED]            = "illegal nesting (unterminated list?)",
     [CINIC_NOLIST]            = "list item without list",
     [CINIC_EMPTY_LIST]        = "malformed list (empty list?)",
@@ -69,15 +149,20 @@ static const char *cinic_error_strings[] = {
     [CINIC_REDUNDANT_BRACKET] = "malformed list (redundant bracket ?)",
     [CINIC_LIST_NOT_STARTED]  = "malformed list (missing opening bracket ?)",
     [CINIC_LIST_NOT_ENDED]    = "malformed list (unterminated list ?)",
+    [CINIC_IO]                = "failed to read or write file",
+    [CINIC_ABORTED]           = "aborted by callback",
+    [CINIC_BAD_OPTION]        = "invalid parser option",
+    [CINIC_NOMEM]             = "out of memory",
+    [CINIC_BAD_SNAPSHOT]      = "invalid or incompatible snapshot",
+    [CINIC_INCLUDE_CYCLE]     = "file includes itself",
     [CINIC_SENTINEL]          =  NULL
 };
 
 /*
- * Convert errnum to error string. Errnum must be < CINIC_SENTINEL */
+ * Convert errnum to error string. */
 const char *Cinic_err2str(enum cinic_error errnum){
     if (errnum >= CINIC_SENTINEL){  /* guard against out-of-bounds indexing attempt */
-        fprintf(stderr, "Invalid cinic error number: '%d'\n", errnum);
-        exit(13);
+        return "unknown error";
     }
     return cinic_error_strings[errnum];
 }
@@ -88,7 +173,8 @@ const char *Cinic_err2str(enum cinic_error errnum){
  * If the transition from the previous list state to the next one is as
  * expected, return CINIC_SUCCESS. Otherwise return an error number.
  */
-enum cinic_error Cinic_get_list_error(enum cinic_list_state prev, enum cinic_list_state next){
+enum cinic_error Cinic_get_list_error(const struct cinic_ctx *ctx, enum cinic_list_state prev, enum cinic_list_state next){
+    assert(ctx);
     say("Assessing list state transition from  prev=%i to next=%i\n", prev, next);
     switch(prev){
 
@@ -115,7 +201,7 @@ enum cinic_error Cinic_get_list_error(enum cinic_list_state prev, enum cinic_lis
                 return CINIC_NESTED;
             }else if (next == LIST_OPEN){
                 return CINIC_REDUNDANT_BRACKET;
-            }else if (next == NOLIST && !ALLOW_EMPTY_LISTS){
+            }else if (next == NOLIST && !ctx->allow_empty_lists){
                 return CINIC_EMPTY_LIST;
             }else return CINIC_MALFORMED_LIST;
             break;
@@ -142,489 +228,1417 @@ enum cinic_error Cinic_get_list_error(enum cinic_list_state prev, enum cinic_lis
 }
 
 /*
- * Print Cinic error message associated with error, and exit with the same error code. */
-void cinic_exit_print(enum cinic_error error, uint32_t ln){
-    assert(error < CINIC_SENTINEL && error > CINIC_SUCCESS);
-
-    fprintf(stderr, "Cinic: failed to parse line %" PRIu32 " -- %s\n", ln, Cinic_err2str(error));
-    exit(EXIT_FAILURE);
+ * Append a copy of the diagnostic of the parser P to the ones it has
+ * collected so far. Return 0 on success, or -1 if out of memory. */
+static int lint_record(struct cinic_parser *p){
+    if (p->ndiags == p->diags_cap){
+        size_t cap = p->diags_cap ? 2 * p->diags_cap : 16;
+        struct cinic_diag *diags = realloc(p->diags, cap * sizeof(*diags));
+        if (!diags){
+            p->diag->code = CINIC_NOMEM;
+            return -1;
+        }
+        p->diags = diags;
+        p->diags_cap = cap;
+    }
+    p->diags[p->ndiags++] = *p->diag;
+    return 0;
 }
 
 /*
- * Strip leading whitespace from s
- * @destructive.
- * */
-char *strip_lws(char *s){
-    assert(s);
-    while (*s && isspace(*s)) ++s;
-    return s;
-}
+ * Record error in the diagnostic of the parser P, at the 0-based
+ * offset pos in the current line.
+ *
+ * Return -1 if parsing must stop there, or 0 if P is linting and the
+ * error was added to the ones collected so far, in which case the
+ * caller should recover from it and carry on. */
+static int parse_error(struct cinic_parser *p, enum cinic_error error, size_t pos){
+    assert(error < CINIC_SENTINEL && error > CINIC_SUCCESS);
 
-/*
- * Strip trailing whitespace from s.
- * @destructive
- * */
-void strip_tws(char *s){
-    assert(s);
-    if (! *s){  /* empty line */
-        return;
+    p->diag->code = error;
+    p->diag->ln = p->ln;
+    p->diag->col = pos + 1;
+    p->diag->errnum = 0;
+    if (p->depth){
+        snprintf(p->diag->file, sizeof(p->diag->file), "%s", p->path);
     }else{
-        char *end = s + (strlen(s) - 1);  /* char before NUL */
-        while (end >= s && isspace(*end)) --end;
-        *(end+1) = '\0';
+        p->diag->file[0] = '\0';
+    }
+    if (!p->lint || error == CINIC_ABORTED || error == CINIC_NOMEM){
+        return -1;
     }
+    return lint_record(p);
 }
 
 /*
  * Return true if c is a comment symbol (# or ;), else false */
 static inline bool is_comment(unsigned char c){
-    if (c == ';' || c == '#'){
-        return true;
-    }
-    return false;
-}
-
-/*
- * Strip everything after (and including) the first comment
- * symbol found on the line.
- * @destructive
- * */
-void strip_comment(char *s){
-    assert(s);
-    say(" ~ stripping comment from '%s'\n", s);
-    while (*s && !is_comment(*s)) ++s;  /* find comment/NUL */
-    *s = '\0';
+    return (c && base_cclass[c] == CC_END);
 }
 
 /*
  * Return true if c is a valid/acceptable/allowed char, else false.
  *
- * An acceptable char is one that can appear in a e.g. section title.
+ * An acceptable char is one that can appear in a e.g. section title:
+ * ASCII letters and digits, and any of: . - _ @ / * ? % &
  *
  * If ws_allowed is true, then a whitespace character is considered
  * legal. This is useful for example when the value is meant to be
  * a string such as a description of something. Whitespace SHOULD NOT
  * appear in a section title; it's only allowable in record values.
  */
-static inline bool is_allowed(char c, bool ws_allowed){
-    if (c == '.' ||
-        c == '-' ||
-        c == '_' ||
-        c == '@' ||
-        c == '/' ||
-        c == '*' ||
-        c == '?' ||
-        c == '%' ||
-        c == '&' ||
-        isalnum(c) ||
-        (isspace(c) && ws_allowed)
-       )
-    {
-        return true;
-    }
+static inline bool is_allowed(unsigned char c, bool ws_allowed){
+    uint8_t cc = base_cclass[c];
+    return (cc == CC_ALLOWED || (ws_allowed && cc == CC_SPACE));
+}
 
-    return false;
+/*
+ * Wrapper around getline()
+ *
+ * buff should initially be a NULL pointer and buffsz should initially
+ * point to a size_t type that is set to 0.
+ * `getline()` will allocate enough memory to accomodate a string of any
+ * length and will point buff to a chunk of dynamic memory the size of
+ * which is writen to buffsz.
+ *
+ * The user is responsible for freeing *buff.
+ *
+ * <-- @return
+ *     the value returned by getline() except if it's < 0 (EOF or
+ *     error), in which case 0. Use ferror() to tell the two apart.
+ */
+size_t read_line(FILE *f, char **buff, size_t *buffsz){
+    assert(f && buff && buffsz);
+    ssize_t rc = getline(buff, buffsz, f);
+    return (rc < 0) ? 0 : rc;
 }
 
 /*
- * Return the number of occurences of c in the non-NULL string s.
+ * Grow the buffer b so it can hold at least n bytes.
  *
- * if through_comments is false, then this function
- * stops as soon as it runs into a comment symbol,
- * otherwise it keeps going even through a comment.
- * */
-static inline uint32_t char_occurs(char c, char *s, bool through_comments){
-    assert(s);
-    uint32_t count = 0;
+ * Return 0 on success, or -1 if out of memory; b is then left as it was.
+ */
+static int buff_grow(struct cinic_buff *b, size_t n){
+    size_t cap = b->cap ? 2 * b->cap : 64;
+    if (cap < n) cap = n;
+
+    char *s = realloc(b->s, cap);
+    if (!s) return -1;
+    b->s = s;
+    b->cap = cap;
+    return 0;
+}
 
-    while (*s){
-        if (!through_comments && is_comment(*s)) return count;
-        if (*s++ == c) ++count;
-    }
-    return count;
+/*
+ * Copy the string referenced by the view v into the buffer b and
+ * NUL-terminate it, growing b as needed.
+ *
+ * Only as many bytes as the view refers to are copied, so the cost is
+ * proportional to the length of the token. b only ever grows, to the
+ * size of the longest token copied into it.
+ *
+ * Return 0 on success, or -1 if b could not be grown; b is then left
+ * as it was.
+ */
+static inline int buff_copy(struct cinic_buff *b, const struct cinic_view *v){
+    if (v->len >= b->cap && buff_grow(b, v->len + 1)) return -1;
+    memcpy(b->s, v->s, v->len);
+    b->s[v->len] = '\0';
+    return 0;
+}
+
+/* the string in b; the empty string if nothing was ever copied into it */
+static inline const char *buff_cstr(const struct cinic_buff *b){
+    return b->s ? b->s : "";
 }
 
 /*
- * True if line consists of just whitespace, else false */
-bool is_empty_line(char *line){
-    assert(line);
-    line = strip_lws(line);
-    return (*line == '\0');
+ * Exported versions of buff_copy() and buff_cstr(), for the Lua module.
+ */
+int buff_set(struct cinic_buff *b, const struct cinic_view *v){
+    assert(b && v);
+    return buff_copy(b, v);
+}
+
+const char *buff_str(const struct cinic_buff *b){
+    assert(b);
+    return buff_cstr(b);
 }
 
 /*
- * True if line consists of just whitespace and a comment, else false;
+ * Release the memory held by b and reset it to empty. */
+void buff_free(struct cinic_buff *b){
+    assert(b);
+    free(b->s);
+    b->s = NULL;
+    b->cap = 0;
+}
+
+/*
+ * Return the character class (see enum cinic_cclass) of c, according
+ * to the list brackets in use by ctx. */
+static inline uint8_t char_class(const struct cinic_ctx *ctx, unsigned char c){
+    return ctx->cclass[c];
+}
+
+/*
+ * Lexer DFA states.
+ *
+ * LX_START, LX_RUN and LX_RUN_WS are shared by the line and the list
+ * token automatons: a line that is not a section title or record is
+ * lexed as a sequence of list tokens, and its first token is the one
+ * the line automaton was in the middle of when it found out.
+ */
+enum{
+    LX_START = 0,   /* skipping leading whitespace */
+    LX_SEC_OPEN,    /* '[' seen; skipping whitespace before the section title */
+    LX_SEC_NAME,    /* in section title */
+    LX_SEC_WS,      /* whitespace between section title and ']' */
+    LX_SEC_CLOSE,   /* ']' seen; only whitespace may follow */
+    LX_RUN,         /* in key / list item */
+    LX_RUN_WS,      /* whitespace after key / list item */
+    LX_EQ,          /* '=' seen after key; skipping whitespace */
+    LX_VAL,         /* in record value */
+    LX_VAL_WS,      /* whitespace inside or after record value */
+    LX_NSTATES
+};
+
+/*
+ * Lexer DFA actions.
  *
- * Acceptable comment symbols are '#' and ';'. Inline comments are
- * possible. Everything following a comment symbol and until the end
- * of the line is considered part of the comment, and the comment symbol
- * can freely be part of an already-started comment without being escaped.
+ * A transition to one of these ends the scan; the action says what
+ * was found. See lex_finish().
  */
-bool is_comment_line(char *line){
-    assert(line);
-    line = strip_lws(line);
-    /* FALSE if line has ended or the current char is not a comment symbol */
-    return ( *line && is_comment(*line) );
+enum{
+    LA_NONE = 16,   /* nothing (more) on this line */
+    LA_SECTION,     /* section title */
+    LA_RECORD,      /* key = value */
+    LA_NOT_SECTION, /* looked like a section title but isn't */
+    LA_HEAD,        /* list head (key =) */
+    LA_HEAD_AT_VAL, /* list head; what followed it is not a record value */
+    LA_OPEN,        /* opening list bracket */
+    LA_CLOSE,       /* closing list bracket */
+    LA_ITEM,        /* list item followed by a comma */
+    LA_LAST,        /* last list item, at the end of the line */
+    LA_LAST_HERE,   /* last list item, followed by another token */
+    LA_BAD          /* not a valid token */
+};
+
+#define S_ LX_START
+#define SO LX_SEC_OPEN
+#define SN LX_SEC_NAME
+#define SW LX_SEC_WS
+#define SC LX_SEC_CLOSE
+#define RN LX_RUN
+#define RW LX_RUN_WS
+#define EQ LX_EQ
+#define VL LX_VAL
+#define VW LX_VAL_WS
+#define NS LA_NOT_SECTION
+#define HD LA_HEAD
+#define HV LA_HEAD_AT_VAL
+#define LH LA_LAST_HERE
+
+/*
+ * Transition table for classifying a whole line in a single pass.
+ *
+ * Columns are in enum cinic_cclass order:
+ *                 OTHER, ALLOWED, SPACE, EQUALS, COMMA, END, SOPEN, SCLOSE, LOPEN, LCLOSE, BOPEN, BCLOSE */
+static const uint8_t line_dfa[LX_NSTATES][CC_COUNT] = {
+    [LX_START]     = {LA_BAD, RN, S_, LA_BAD, LA_BAD, LA_NONE, SO, LA_BAD, LA_OPEN, LA_CLOSE, SO, LA_CLOSE},
+    [LX_SEC_OPEN]  = {NS, SN, SO, NS, NS, NS, NS, NS, NS, NS, NS, NS},
+    [LX_SEC_NAME]  = {NS, SN, SW, NS, NS, NS, NS, SC, NS, NS, NS, SC},
+    [LX_SEC_WS]    = {NS, NS, SW, NS, NS, NS, NS, SC, NS, NS, NS, SC},
+    [LX_SEC_CLOSE] = {NS, NS, SC, NS, NS, LA_SECTION, NS, NS, NS, NS, NS, NS},
+    [LX_RUN]       = {LA_BAD, RN, RW, EQ, LA_ITEM, LA_LAST, LA_BAD, LA_BAD, LA_BAD, LH, LA_BAD, LH},
+    [LX_RUN_WS]    = {LA_BAD, LH, RW, EQ, LA_ITEM, LA_LAST, LA_BAD, LA_BAD, LA_BAD, LH, LA_BAD, LH},
+    [LX_EQ]        = {HD, VL, EQ, HD, HD, HD, HD, HD, HD, HD, HD, HD},
+    [LX_VAL]       = {HV, VL, VW, HV, HV, LA_RECORD, HV, HV, HV, HV, HV, HV},
+    [LX_VAL_WS]    = {HV, VL, VW, HV, HV, LA_RECORD, HV, HV, HV, HV, HV, HV},
+};
+
+/*
+ * Transition table for lexing the next list token on a line.
+ * Only the LX_START, LX_RUN and LX_RUN_WS states are used.
+ *                 OTHER, ALLOWED, SPACE, EQUALS, COMMA, END, SOPEN, SCLOSE, LOPEN, LCLOSE, BOPEN, BCLOSE */
+static const uint8_t list_dfa[LX_NSTATES][CC_COUNT] = {
+    [LX_START]     = {LA_BAD, RN, S_, LA_BAD, LA_BAD, LA_NONE, LA_BAD, LA_BAD, LA_OPEN, LA_CLOSE, LA_OPEN, LA_CLOSE},
+    [LX_RUN]       = {LA_BAD, RN, RW, HD, LA_ITEM, LA_LAST, LA_BAD, LA_BAD, LA_BAD, LH, LA_BAD, LH},
+    [LX_RUN_WS]    = {LA_BAD, LH, RW, HD, LA_ITEM, LA_LAST, LA_BAD, LA_BAD, LA_BAD, LH, LA_BAD, LH},
+};
+
+#undef S_
+#undef SO
+#undef SN
+#undef SW
+#undef SC
+#undef RN
+#undef RW
+#undef EQ
+#undef VL
+#undef VW
+#undef NS
+#undef HD
+#undef HV
+#undef LH
+
+/* offset never reached in a line; marks states not (yet) visited */
+#define LX_UNSEEN SIZE_MAX
+
+/*
+ * Run the automaton dfa over the len bytes at line, starting at offset
+ * pos, and describe the token found in lx.
+ *
+ * Each byte is looked at exactly once. The only positions recorded are
+ * those at which each state is first and last entered, which is all
+ * that is needed to delimit the tokens.
+ */
+static void lex_run(const struct cinic_ctx *ctx, const uint8_t dfa[][CC_COUNT],
+                    const char *line, size_t len, size_t pos,
+                    struct cinic_lexeme *lx)
+{
+    size_t first[LX_NSTATES], last[LX_NSTATES];
+    uint8_t state = LX_START, next;
+    size_t i = pos;
+
+    for (size_t s = 0; s < LX_NSTATES; ++s) first[s] = LX_UNSEEN;
+
+    for (;; ++i){
+        uint8_t cc = i < len ? char_class(ctx, line[i]) : CC_END;
+        next = dfa[state][cc];
+        if (next == state) continue;
+        if (next >= LA_NONE) break;
+        if (first[next] == LX_UNSEEN) first[next] = i;
+        last[next] = i;
+        state = next;
+    }
+
+    /* end of key / list item, if any: where trailing whitespace or '=' begins */
+    size_t run_end = i;
+    if (first[LX_RUN_WS] < run_end) run_end = first[LX_RUN_WS];
+    if (first[LX_EQ] < run_end)     run_end = first[LX_EQ];
+
+    lx->k.s = lx->v.s = NULL;
+    lx->k.len = lx->v.len = 0;
+    lx->next = i + 1;
+    lx->pos = i;
+
+    switch(next){
+    case LA_NONE:
+        lx->type = LEX_NONE;
+        lx->next = len;
+        break;
+
+    case LA_SECTION:
+        lx->type = LEX_SECTION;
+        lx->pos = first[LX_SEC_OPEN];
+        lx->k.s = line + first[LX_SEC_NAME];
+        lx->k.len = (first[LX_SEC_WS] < first[LX_SEC_CLOSE] ? first[LX_SEC_WS] : first[LX_SEC_CLOSE]) - first[LX_SEC_NAME];
+        break;
+
+    case LA_NOT_SECTION:
+        /* only valid as a list token if the '[' is also the list bracket */
+        lx->type = char_class(ctx, line[first[LX_SEC_OPEN]]) == CC_BOPEN ? LEX_LIST_OPEN : LEX_BAD;
+        lx->pos = first[LX_SEC_OPEN];
+        lx->next = first[LX_SEC_OPEN] + 1;
+        break;
+
+    case LA_RECORD:
+        lx->type = LEX_RECORD;
+        lx->pos = first[LX_RUN];
+        lx->k.s = line + first[LX_RUN];
+        lx->k.len = run_end - first[LX_RUN];
+        lx->v.s = line + first[LX_VAL];
+        lx->v.len = (state == LX_VAL ? i : last[LX_VAL_WS]) - first[LX_VAL];
+        break;
+
+    case LA_HEAD:
+    case LA_HEAD_AT_VAL:
+        lx->type = LEX_LIST_HEAD;
+        lx->pos = first[LX_RUN];
+        lx->k.s = line + first[LX_RUN];
+        lx->k.len = run_end - first[LX_RUN];
+        /* resume right after the '='; list tokens skip leading whitespace */
+        lx->next = (first[LX_EQ] != LX_UNSEEN ? first[LX_EQ] : i) + 1;
+        break;
+
+    case LA_OPEN:
+        lx->type = LEX_LIST_OPEN;
+        break;
+
+    case LA_CLOSE:
+        lx->type = LEX_LIST_CLOSE;
+        break;
+
+    case LA_ITEM:
+    case LA_LAST:
+    case LA_LAST_HERE:
+        lx->type = (next == LA_ITEM) ? LEX_LIST_ITEM : LEX_LIST_LAST;
+        lx->pos = first[LX_RUN];
+        lx->v.s = line + first[LX_RUN];
+        lx->v.len = run_end - first[LX_RUN];
+        if (next != LA_ITEM) lx->next = i;  /* do not consume what follows */
+        break;
+
+    default:
+        lx->type = LEX_BAD;
+        break;
+    }
 }
 
 /*
- * Wrapper around getline()
+ * Classify the LEN-byte line at LINE and extract its tokens in a single
+ * pass, writing the result to lx.
  *
- * This function should never fail; on failure, it exits the program.
- * buff should initially be a NULL pointer and buffsz should initially
- * point to a size_t type that is set to 0.
- * `getline()` will allocate enough memory to accomodate a string of any
- * length and will point buff to a chunk of dynamic memory the size of
- * which is writen to buffsz.
+ * The line can be
+ *  - empty or comment-only (LEX_NONE)
+ *  - a section title (LEX_SECTION; lx->k is the title)
+ *  - a record (LEX_RECORD; lx->k and lx->v are the key and value)
+ *  - anything else, in which case it is lexed as a sequence of list
+ *    tokens, and lx describes the first one. The rest are retrieved
+ *    with lex_list_token(), starting at lx->next.
  *
- * The user is responsible for freeing *buff.
+ * The line need not be NUL-terminated and is never modified; tokens
+ * refer to it. Leading and trailing whitespace and comments are
+ * skipped as part of the same pass.
+ */
+void lex_line(const struct cinic_ctx *ctx, const char *line, size_t len, struct cinic_lexeme *lx){
+    assert(ctx && (line || !len) && lx);
+    lex_run(ctx, line_dfa, line, len, 0, lx);
+}
+
+/*
+ * Lex the list token found at offset pos in the LEN-byte line at LINE,
+ * writing the result to lx. lx->next is set to the offset at which to
+ * look for the token following it. When there are no more tokens on the
+ * line, lx->type is LEX_NONE.
  *
- * <-- @return
- *     the value returned by getline() except if it's < 0; in that case
- *     the program will just exit with error.
+ * A list token is one of: <list head> (LEX_LIST_HEAD; lx->k is the key),
+ * <opening/closing bracket>, <list item> (LEX_LIST_ITEM or, for the last
+ * item in a list, LEX_LIST_LAST; lx->v is the item). Anything else is
+ * LEX_BAD.
  */
-uint32_t read_line(FILE *f, char **buff, size_t *buffsz){
-    assert(f && buff && buffsz);
-    ssize_t rc = getline(buff, buffsz, f);
-    if (rc < 0 /* -1 */){
-        if (!feof(f)){
-            perror("Failed to read line (getline())");
-            exit(EXIT_FAILURE);
-        }else rc=0;  /* EOF */
+void lex_list_token(const struct cinic_ctx *ctx, const char *line, size_t len, size_t pos, struct cinic_lexeme *lx){
+    assert(ctx && (line || !len) && lx);
+    if (pos >= len){
+        lx->type = LEX_NONE;
+        lx->next = len;
+        return;
     }
-    return rc;
+    lex_run(ctx, list_dfa, line, len, pos, lx);
+}
+
+/* What a record is, when following include directives */
+enum include_kind{
+    INCLUDE_NONE = 0,
+    INCLUDE_FILES,      /* include = path or pattern */
+    INCLUDE_DIR         /* include_dir = directory */
+};
+
+static inline enum include_kind include_kind(const struct cinic_view *k){
+    if (k->len == sizeof("include") - 1 && !memcmp(k->s, "include", k->len)){
+        return INCLUDE_FILES;
+    }else if (k->len == sizeof("include_dir") - 1 && !memcmp(k->s, "include_dir", k->len)){
+        return INCLUDE_DIR;
+    }
+    return INCLUDE_NONE;
 }
 
+static int include(struct cinic_parser *p, const struct cinic_lexeme *lx);
+
 /*
- * Copy src to dst (as much of src as fits in buffsz, which must
- * indicate the size of buf) and NUL-terminate either at null_at
- * (if null_at is smaller than buffsz) or otherwize at buffsz-1.
+ * A slice of a buffer being parsed by several threads at once; see
+ * parse_parallel(). The events in it are recorded as the slice is
+ * parsed, and replayed in order to the listener afterwards.
+ */
+struct chunk_event{
+    struct cinic_view k, v;         /* into the buffer being parsed */
+    uint32_t ln;                    /* relative to the start of the chunk */
+    uint32_t pos;
+    uint8_t ev;                     /* enum cinic_event */
+    uint8_t list;                   /* enum cinic_list_state */
+};
+
+struct parse_chunk{
+    size_t start;                   /* offset of the first line in the buffer */
+    uint32_t lines;                 /* number of lines in the chunk */
+    enum cinic_list_state list;     /* list state after the last line */
+    int rc;                         /* as returned by parse_lines() */
+    struct cinic_diag diag;         /* line relative to the start of the chunk */
+    struct chunk_event *events;
+    size_t nevents, cap;
+    bool done;                      /* parsed, and ready to be replayed */
+};
+
+/*
+ * Append the event ev, with the tokens in lx, to the events recorded
+ * by the parser P (see struct parse_chunk). The tokens are views into
+ * the buffer being parsed, so nothing is copied but the views.
+ *
+ * Return 0 on success, or -1 if out of memory. */
+static int record_event(struct cinic_parser *p, enum cinic_event ev, const struct cinic_lexeme *lx){
+    struct parse_chunk *c = p->chunk;
+
+    if (c->nevents == c->cap){
+        size_t cap = c->cap ? 2 * c->cap : 1024;
+        struct chunk_event *events = realloc(c->events, cap * sizeof(*events));
+        if (!events){
+            return parse_error(p, CINIC_NOMEM, lx->pos);
+        }
+        c->events = events;
+        c->cap = cap;
+    }
+    c->events[c->nevents++] = (struct chunk_event){
+        .k = lx->k, .v = lx->v, .ln = p->ln, .pos = lx->pos, .ev = ev, .list = p->list
+    };
+    return 0;
+}
+
+/*
+ * Report the token lx, found on the current line, to whoever is
+ * listening to the parser P: the event sink, which gets the tokens as
+ * views, or else the user callback. A config_cb and a cinic_event_cb
+ * get NUL-terminated copies of the tokens, while a config_view_cb gets
+ * views, so that only the section title and list head, which must
+ * outlive their line, are ever copied. Only a cinic_event_cb is called
+ * for section titles and list heads.
  *
- * buffsz must indicate the size of dst.
+ * Return 0, or the non-zero value returned by the listener (recorded
+ * in p->diag).
  */
-static void cp_to_buff(char dst[], char *src, size_t buffsz, size_t null_at){
-    assert(dst && src);
-    memset(dst, 0, buffsz);
-    strncpy(dst, src, buffsz-1);
-    if (null_at < buffsz){
-        dst[null_at] = '\0';
-    }else{
-        dst[buffsz-1] = '\0';
+static int emit(struct cinic_parser *p, enum cinic_event ev, const struct cinic_lexeme *lx){
+    int rc = 0;
+
+    if (p->chunk){
+        return record_event(p, ev, lx);
+    }
+
+    if (p->ctx->includes){
+        if (ev == CINIC_EV_RECORD && include_kind(&lx->k)){
+            return include(p, lx);
+        }
+        /* sinks do not need the title copied, but include_file() does */
+        if (ev == CINIC_EV_SECTION && p->sink && buff_copy(&p->section, &lx->k)){
+            return parse_error(p, CINIC_NOMEM, lx->pos);
+        }
+        p->nsections += (ev == CINIC_EV_SECTION);
+    }
+
+    if (p->sink){
+        rc = p->sink(p->ud, ev, p->ln, p->list, &lx->k, &lx->v);
+    }
+    else if (p->vcb){
+        struct cinic_view section = { buff_cstr(&p->section), p->section_len };
+        struct cinic_view key = { buff_cstr(&p->key), p->key_len };
+
+        switch(ev){
+        case CINIC_EV_SECTION:
+            if (buff_copy(&p->section, &lx->k)){
+                return parse_error(p, CINIC_NOMEM, lx->pos);
+            }
+            p->section_len = lx->k.len;
+            break;
+        case CINIC_EV_LIST_HEAD:
+            if (buff_copy(&p->key, &lx->k)){
+                return parse_error(p, CINIC_NOMEM, lx->pos);
+            }
+            p->key_len = lx->k.len;
+            break;
+        case CINIC_EV_RECORD:
+            rc = p->vcb(p->ud, p->ln, p->list, &section, &lx->k, &lx->v);
+            break;
+        case CINIC_EV_LIST_ITEM:
+            rc = p->vcb(p->ud, p->ln, p->list, &section, &key, &lx->v);
+            break;
+        }
+    }
+    else if (p->cb || p->ecb){
+        bool nomem = false;
+        switch(ev){
+        case CINIC_EV_SECTION:
+            nomem = buff_copy(&p->section, &lx->k);
+            break;
+        case CINIC_EV_LIST_HEAD:  /* the key must outlive the line */
+            nomem = buff_copy(&p->key, &lx->k);
+            break;
+        case CINIC_EV_RECORD:
+            nomem = buff_copy(&p->key, &lx->k) || buff_copy(&p->val, &lx->v);
+            break;
+        case CINIC_EV_LIST_ITEM:
+            nomem = buff_copy(&p->val, &lx->v);
+            break;
+        }
+        if (nomem){
+            return parse_error(p, CINIC_NOMEM, lx->pos);
+        }
+        if (p->ecb){
+            const char *k = (ev == CINIC_EV_SECTION) ? buff_cstr(&p->section) : p->key.s;
+            const char *v = (ev == CINIC_EV_RECORD || ev == CINIC_EV_LIST_ITEM) ? p->val.s : NULL;
+            rc = p->ecb(p->ud, ev, p->ln, p->list, k, v);
+        }
+        else if (ev == CINIC_EV_RECORD || ev == CINIC_EV_LIST_ITEM){
+            rc = p->cb(p->ln, p->list, buff_cstr(&p->section), p->key.s, p->val.s);
+        }
+    }
+
+    if (rc){
+        parse_error(p, CINIC_ABORTED, lx->pos);
     }
+    return rc;
 }
 
 /*
- * Return true if line is a .ini section title, else False.
+ * Parse a single line read from the config file.
  *
- * IFF line IS an .ini section title, and if name is NOT NULL,
- * the section title string exctracted is written to NAME whose
- * size is specified by buffsz.
+ * LINE is the line, as read (i.e. including any trailing newline and
+ * not NUL-terminated), and LEN its length in bytes. P carries the
+ * parser state from one line to the next. The line is classified and
+ * its tokens extracted in a single pass by lex_line().
  *
- * A section title line is expected to have the following format:
- *  [section.subsection.subsubsection]
+ * Return 0 on success, -1 on a syntax error (recorded in p->diag), or
+ * the non-zero value returned by the user callback, if any.
  *
- * NOTES:
- *  - line must not be NULL
- *  - line must be STRIPPED of comment, and leading and trailing whitespace
+ * When linting, errors are collected instead (see parse_error()) and
+ * the parser resynchronizes: the rest of the line is skipped and, if
+ * the error was in a list, so are all list tokens up to the end of the
+ * list, or to the next section title, record or list head. That way
+ * each mistake is reported once, rather than along with everything
+ * that follows from it.
  */
-bool is_section_line(char *line, char name[], size_t buffsz){
-    assert(line);
-    char *end=NULL, *start=NULL;
-    say(" ~~ is_section_line ? : '%s'\n", line);
+static int parse_line(struct cinic_parser *p, const char *line, size_t len){
+    assert(p && (line || !len));
+    const struct cinic_ctx *ctx = p->ctx;
+    ++p->ln;
+    struct cinic_lexeme lx;
+    enum cinic_error cerr;
+    int rc = 0;
 
-    /* first non-whitespace char must be '[' */
-    if (! *line || *line++ != '[') return false;
+    say(" ~ read line %u: '%.*s'", p->ln, (int)len, line);
 
-    /* section NAME (text between [ ]) must be in the allowable set */
-    line = strip_lws(line);  /* ws between opening bracket and title is allowed */
-    if (! *line || !is_allowed(*line, false)){
-        return false;
-    }else{
-        start = line; /* start of section name */
+    /* line too long */
+    if(ctx->max_line_len && len > ctx->max_line_len){
+        return parse_error(p, CINIC_TOOLONG, ctx->max_line_len);
     }
 
-    /*  go to end of section name; first char after section name must be
-     *  either whitespace or the closing bracket */
-    while (*line && is_allowed(*line, false)) ++line;
-    if (! *line || ( !isspace(*line) && *line != ']' ) ){
-        return false;
-    }else{
-        end = line;  /* section title end: NUL terminate here */
+    lex_line(ctx, line, len, &lx);
+
+    switch(lx.type){
+    /* empty or comment-only line */
+    case LEX_NONE:
+        return 0;
+
+    /* section title line */
+    case LEX_SECTION:
+        say(" ~ line %u is a section title\n", p->ln);
+        if (p->list && !p->resync){
+            if (parse_error(p, CINIC_NESTED, lx.pos)) return -1;
+        }
+        p->list = NOLIST;
+        p->resync = false;
+        p->in_section = true;
+        return emit(p, CINIC_EV_SECTION, &lx);
+
+    /*  key-value line */
+    case LEX_RECORD:
+        say(" ~ line %u is a record line\n", p->ln);
+        if (p->resync){
+            p->list = NOLIST;
+            p->resync = false;
+        }
+        if (!p->in_section && !ctx->allow_globals && !(ctx->includes && include_kind(&lx.k))){
+            return parse_error(p, CINIC_NOSECTION, lx.pos);
+        }else if (p->list){
+            if (parse_error(p, CINIC_NESTED, lx.pos)) return -1;
+            p->list = NOLIST;
+        }
+        return emit(p, CINIC_EV_RECORD, &lx);
+
+    /* else, list tokens */
+    default:
+        say(" ~ trying list parsing on line %u \n", p->ln);
+        break;
     }
 
-    line = strip_lws(line); /* ws between title and closing bracket is allowed */
-    if (! *line || *line++ != ']') return false;
+    for (; lx.type != LEX_NONE; lex_list_token(ctx, line, len, lx.next, &lx)){
+        enum cinic_list_state next;
+
+        /* recovering from an error: skip to the end of the list, or the next one */
+        if (p->resync){
+            if (lx.type == LEX_LIST_CLOSE){
+                p->list = NOLIST;
+                p->resync = false;
+                continue;
+            }else if (lx.type != LEX_LIST_HEAD){
+                continue;
+            }
+            p->list = NOLIST;
+            p->resync = false;
+        }
+
+        switch(lx.type){
+        case LEX_LIST_HEAD:  next = LIST_HEAD; break;
+        case LEX_LIST_OPEN:  next = LIST_OPEN; break;
+        case LEX_LIST_ITEM:  next = LIST_ONGOING; break;
+        case LEX_LIST_LAST:  next = LIST_LAST; break;
+        case LEX_LIST_CLOSE: next = NOLIST; break;
+
+        /* not a list component/token recognized as valid */
+        /* not any kind of line recognized as valid */
+        default:
+            if (parse_error(p, CINIC_MALFORMED, lx.pos)) return -1;
+            p->resync = true;
+            return 0;
+        }
+
+        if ( (cerr = Cinic_get_list_error(ctx, p->list, next)) ){
+            if (parse_error(p, cerr, lx.pos)) return -1;
+
+            /* a closing bracket ends the list, even a misplaced one */
+            if (next == NOLIST){
+                p->list = NOLIST;
+                continue;
+            }
+            p->resync = true;
+            return 0;
+        }
+        p->list = next;
+
+        switch(lx.type){
+        /* list head */
+        case LEX_LIST_HEAD:
+            p->islast = false;
+            rc = emit(p, CINIC_EV_LIST_HEAD, &lx);
+            break;
 
-    /* line has been stripped of leading and trailing ws and any comment,
-     * so it should be ending here */
-    if (*line) return false; /* should be NUL */
+        /* list entry */
+        case LEX_LIST_ITEM:
+        case LEX_LIST_LAST:
+            p->islast = (lx.type == LEX_LIST_LAST);
+            rc = emit(p, CINIC_EV_LIST_ITEM, &lx);
+            break;
+
+        /* brackets */
+        default:
+            break;
+        }
 
-    /* if name != NULL, user wants to extract section name */
-    if (name){
-        cp_to_buff(name, start, buffsz, end-start);
+        if (rc) return rc;
     }
-    return true;
+
+    return 0;
 }
 
 /*
- * True if the line is a key=value entry (i.e. a 'record'), else false.
- *
- * the '=' sign must NOT be part of the key or value; it can
- * only be used as the separator between the key-value pair.
- * It can be freely used as part of a comment, however.
+ * Return a mask with bit i set iff s[i] is c, for each of the
+ * SCAN_BLOCK bytes at S.
  *
- * If k and/or v are not NULL, the key and/or value are written to
- * K and/or V, respectively. Each of k and v (if not NULL) must have
- * size BUFFSZ.
- *
- * NOTES:
- *  - line must not be NULL
- *  - line must be STRIPPED of comment, and leading and trailing whitespace
+ * This is the portable version; the vectorized ones below must return
+ * exactly the same thing.
  */
-bool is_record_line(char *line, char k[], char v[], size_t buffsz){
-    assert(line);
-    say(" ~~ is_record_line? : '%s'\n", line);
-    char *key=NULL, *val=NULL;
-    char *key_end=NULL, *val_end=NULL;
+uint64_t scan_block_scalar(const char *s, char c){
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < SCAN_BLOCK; ++i){
+        mask |= (uint64_t)(s[i] == c) << i;
+    }
+    return mask;
+}
 
-    /* first char must be from the allowable set */
-    if (! *line || !is_allowed(*line, false)) return false;
-    key = line;  /* start of key */
+#ifdef CINIC_X86_SIMD
+__attribute__((target("sse2")))
+uint64_t scan_block_sse2(const char *s, char c){
+    __m128i needle = _mm_set1_epi8(c);
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < SCAN_BLOCK; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+uint64_t scan_block_avx2(const char *s, char c){
+    __m256i needle = _mm256_set1_epi8(c);
+    __m256i lo = _mm256_loadu_si256((const __m256i *)s);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(s + 32));
+    uint32_t mlo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle));
+    uint32_t mhi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle));
+    return (uint64_t)mhi << 32 | mlo;
+}
+#endif
+
+/* the best scan_block_*() function the CPU we are running on supports */
+static uint64_t (*scan_block)(const char *s, char c) = scan_block_scalar;
 
-    /* go to the end of the key */
-    while (*line && is_allowed(*line, false)) ++line;
-    if (! *line) return false;
-    key_end = line;
+#ifdef CINIC_X86_SIMD
+__attribute__((constructor))
+static void scan_block_select(void){
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))      scan_block = scan_block_avx2;
+    else if (__builtin_cpu_supports("sse2")) scan_block = scan_block_sse2;
+}
+#endif
+
+/*
+ * Release the memory held by the parser P, once done with it. */
+static void parser_free(struct cinic_parser *p){
+    buff_free(&p->key);
+    buff_free(&p->val);
+    buff_free(&p->section);
+}
+
+/*
+ * Record in the diagnostic of the parser P that the file being parsed
+ * could not be read, because of errnum. Return -1. */
+static int io_error(struct cinic_parser *p, int errnum){
+    p->diag->code = CINIC_IO;
+    p->diag->ln = 0;
+    p->diag->col = 0;
+    p->diag->errnum = errnum;
+    p->diag->file[0] = '\0';
+    return -1;
+}
+
+/*
+ * Feed each line read from the stream F to the parser P.
+ *
+ * Return 0 on success, -1 on error, or the non-zero value returned
+ * by the user callback, if any.
+ */
+static int parse_stream(struct cinic_parser *p, FILE *f){
+    assert(p && f);
 
-    /* intervening whitespace between key, =, and value is allowed */
-    line = strip_lws(line);
-    if (! *line || *line++ != '=') return false;
-    line = strip_lws(line);
-    if (! *line || !is_allowed(*line, false)) return false;
-    val = line; /* start of value */
+    int rc = 0;
+    size_t bytes_read = 0;                  /* bytes read by getline; 0 on EOF */
 
-    /* go to the end of value */
-    while (*line && is_allowed(*line, true)) ++line;
-    if (*line) return false;
-    val_end = line;
+    /* allocated and resized by `getline()` as needed */
+    char *buff = NULL;
+    size_t buffsz = 0;
 
-    /* user wants key or/and val extracted */
-    if (k){
-        cp_to_buff(k, key, buffsz, key_end - key);
+    /* for each line read from config file */
+    while ( ( bytes_read = read_line(f, &buff, &buffsz)) ){
+        if ( (rc = parse_line(p, buff, bytes_read)) ) break;
     }
-    if (v){
-        cp_to_buff(v, val, buffsz, val_end - val);
+
+    if (!rc && ferror(f)){
+        rc = io_error(p, errno);
     }
 
-    return true;
+    free(buff);
+    return rc;
 }
 
 /*
- * Get list token from the non-NULL line.
+ * Return true if the line of length LEN at LINE is one at which a
+ * buffer can be split for parsing in parallel, else false; see
+ * parse_parallel().
  *
- * This function is used to retrieve list tokens from a line, one by one.
- * The current token is written to buff -- which must not be NULL and whose
- * size must be indicated via buffsz. A pointer to the start of the next
- * token is returned. When there are no more tokens left in line, NULL
- * is returned.
+ * That is a section title line, which does not depend on what comes
+ * before it: it is parsed the same way whatever state the parser is
+ * in, except for being an error if a list is still open.
+ */
+static bool is_split_line(const struct cinic_ctx *ctx, const char *line, size_t len){
+    struct cinic_lexeme lx;
+
+    if (ctx->max_line_len && len > ctx->max_line_len) return false;
+    lex_line(ctx, line, len, &lx);
+    return (lx.type == LEX_SECTION);
+}
+
+/*
+ * Feed each line in the LEN bytes at DATA to the parser P, stopping
+ * before the first line, if any, that starts at or after offset SPLIT
+ * and is a split line (see is_split_line()).
  *
- * This function can be used in a loop, continuing for as long as the
- * return value is != NULL.
+ * Lines are located and lexed in place; nothing is copied but the
+ * tokens handed to the callback.
  *
- * A list token is one of: <list head>, '=', <opening/closing bracket>,
- * <list item (regular or final)>.
+ * Return 0 on success, -1 on error, or the non-zero value returned
+ * by the user callback, if any.
  */
-char *get_list_token(char *line, char buff[], size_t buffsz){
-    assert(line);
-    line = strip_lws(line);
-    strip_comment(line);
-    strip_tws(line);
+static int parse_lines(struct cinic_parser *p, const char *data, size_t len, size_t split){
+    assert(p && (data || !len));
 
-    char *start = line;  /* start of current token */
-    char *end = NULL;
-    char *next = NULL;
+    int rc = 0;
+    size_t start = 0;   /* of the current line */
+    size_t blk = 0;
+
+    /* whole blocks: every line end in the block at once */
+    for (; len - blk >= SCAN_BLOCK; blk += SCAN_BLOCK){
+        for (uint64_t eols = scan_block(data + blk, '\n'); eols; eols &= eols - 1){
+            size_t eol = blk + __builtin_ctzll(eols);
+            if (start >= split && is_split_line(p->ctx, data + start, eol + 1 - start)) return 0;
+            if ( (rc = parse_line(p, data + start, eol + 1 - start)) ) return rc;
+            start = eol + 1;
+        }
+    }
+
+    /* what is left is less than a block */
+    while (start < len){
+        const char *eol = memchr(data + start, '\n', len - start);
+        size_t n = eol ? (size_t)(eol - (data + start)) + 1 : len - start;
+
+        if (start >= split && is_split_line(p->ctx, data + start, n)) break;
+        if ( (rc = parse_line(p, data + start, n)) ) break;
+        start += n;
+    }
+
+    return rc;
+}
+
+/*
+ * Parsing in parallel.
+ *
+ * The buffer is cut into chunks of about PARALLEL_CHUNK bytes, each of
+ * which is parsed by whichever of the threads is free, with the events
+ * recorded rather than handed to the listener. The calling thread then
+ * replays the events of each chunk in turn, in order, to the listener,
+ * just as if the whole buffer had been parsed sequentially: with the
+ * same line numbers, the same errors, and stopping at the first one.
+ *
+ * Chunk i nominally starts at offset i * size, but actually starts at
+ * the first split line (see is_split_line()) at or after that offset,
+ * and ends where chunk i+1 starts: the first split line at or after
+ * (i+1) * size. That is worked out by the thread parsing each chunk,
+ * on its own, since both are a matter of the buffer alone. A chunk can
+ * be empty, if there is no split line at or after its nominal start
+ * and before the start of the next one.
+ *
+ * The state the parser is in at a split line does not matter, as the
+ * line resets it, unless a list is still open: then the line is an
+ * error, which is reported when the chunk before it is replayed.
+ *
+ * At most PARALLEL_AHEAD chunks per thread are parsed ahead of the one
+ * being replayed, to bound the memory the recorded events take.
+ */
+#define PARALLEL_CHUNK (1U << 20)
+#define PARALLEL_AHEAD 2
+
+struct parallel{
+    const struct cinic_ctx *ctx;
+    const char *data;
+    size_t len;
+    size_t size;                    /* nominal size of each chunk */
+    struct parse_chunk *chunks;
+    size_t nchunks;
+    size_t next;                    /* next chunk to be parsed */
+    size_t replayed;                /* number of chunks replayed so far */
+    size_t ahead;                   /* max number of chunks parsed ahead */
+    bool in_section;                /* the parser is in a section at the start */
+    bool stop;                      /* parsing failed; no more chunks */
+    pthread_mutex_t lock;
+    pthread_cond_t work;            /* signalled when chunks are replayed */
+    pthread_cond_t done;            /* signalled when a chunk is parsed */
+};
 
-    /* empty list */
-    if (!*line) return NULL;
+/*
+ * Return the offset of the first split line at or after offset off in
+ * the LEN bytes at DATA, or LEN if there is none. */
+static size_t find_split(const struct cinic_ctx *ctx, const char *data, size_t len, size_t off){
+    /* the first line starting at or after off */
+    if (off && data[off-1] != '\n'){
+        const char *eol = memchr(data + off, '\n', len - off);
+        off = eol ? (size_t)(eol - data) + 1 : len;
+    }
 
-    say(" ~ looking for list token in '%s'\n", line);
-    while (*line && is_allowed(*line, false)) ++line;  /* find end of token */
-    line = strip_lws(line);
+    while (off < len){
+        const char *eol = memchr(data + off, '\n', len - off);
+        size_t n = eol ? (size_t)(eol - (data + off)) + 1 : len - off;
 
-    /* equals sign, opening bracket, or comma */
-    if (*line == '=' || *line == *LIST_BRACKET || *line == ','){
-        end = line;
-        cp_to_buff(buff, start, buffsz, (end-start) + 1);
+        if (is_split_line(ctx, data + off, n)) break;
+        off += n;
     }
-    /* list item */
-    else if(is_allowed(*line, false)){
-        end = line - 1;
-        cp_to_buff(buff, start, buffsz, (end - start) + 1);
+    return off;
+}
+
+/*
+ * Parse the i-th chunk of the buffer of PP; see above. */
+static void parse_chunk(struct parallel *pp, size_t i){
+    struct parse_chunk *c = &pp->chunks[i];
+    struct cinic_parser p = {
+        .ctx = pp->ctx,
+        .ln = 0,
+        .list = NOLIST,
+        .in_section = !i && pp->in_section,
+        .diag = &c->diag,
+        .chunk = c
+    };
+
+    /* where the next chunk starts, relative to this one */
+    size_t split = SIZE_MAX;
+    c->start = i ? find_split(pp->ctx, pp->data, pp->len, i * pp->size) : 0;
+    if (i + 1 < pp->nchunks){
+        size_t next = (i + 1) * pp->size;
+        split = (next > c->start) ? next - c->start : 0;
     }
-    /* closing bracket ... */
-    else if(*line == LIST_BRACKET[1]){
-        if (is_allowed(*start, false)){ /* preceded by list item */
-            end = line-1;
-        }else end = line;  /* without preceding item */
-        cp_to_buff(buff, start, buffsz, (end - start) + 1);
+
+    c->rc = parse_lines(&p, pp->data + c->start, pp->len - c->start, split);
+    c->lines = p.ln;
+    c->list = p.list;
+    parser_free(&p);
+}
+
+static void *parallel_worker(void *arg){
+    struct parallel *pp = arg;
+
+    pthread_mutex_lock(&pp->lock);
+    for (;;){
+        while (!pp->stop && pp->next < pp->nchunks && pp->next >= pp->replayed + pp->ahead){
+            pthread_cond_wait(&pp->work, &pp->lock);
+        }
+        if (pp->stop || pp->next == pp->nchunks) break;
+
+        size_t i = pp->next++;
+        pthread_mutex_unlock(&pp->lock);
+        parse_chunk(pp, i);
+        pthread_mutex_lock(&pp->lock);
+
+        pp->chunks[i].done = true;
+        pthread_cond_broadcast(&pp->done);
     }
-    /* unrecognized token; return to higher-level decider */
-    else{
-        end = start + strlen(start) - 1; /* do not include NUL */
-        cp_to_buff(buff, start, buffsz, (end - start) + 1);
+    pthread_mutex_unlock(&pp->lock);
+    return NULL;
+}
+
+/*
+ * Hand the events recorded in the chunk C of PP, which starts at line
+ * BASE+1, to the listener of the parser P; see above.
+ *
+ * Return 0 on success, -1 on error, or the non-zero value returned
+ * by the user callback, if any.
+ */
+static int replay_chunk(struct cinic_parser *p, const struct parallel *pp, const struct parse_chunk *c, uint32_t base){
+    int rc = 0;
+    struct cinic_lexeme lx;
+
+    if (!c->lines) return 0;
+
+    /* a section title cannot be nested in a list */
+    if (p->list){
+        const char *line = pp->data + c->start;
+        const char *eol = memchr(line, '\n', pp->len - c->start);
+        lex_line(p->ctx, line, eol ? (size_t)(eol - line) + 1 : pp->len - c->start, &lx);
+        p->ln = base + 1;
+        return parse_error(p, CINIC_NESTED, lx.pos);
     }
 
-    if (! *end ){
-        next = NULL;
-    }else{
-        next = end+1;  /* might be empty string with just NUL; handled at the top */
+    for (size_t i = 0; i < c->nevents; ++i){
+        const struct chunk_event *e = &c->events[i];
+        lx.k = e->k;
+        lx.v = e->v;
+        lx.pos = e->pos;
+        p->ln = base + e->ln;
+        p->list = e->list;
+        if ( (rc = emit(p, e->ev, &lx)) ) return rc;
     }
 
-    return next;
+    p->ln = base + c->lines;
+    p->list = c->list;
+    if (c->rc){
+        *p->diag = c->diag;
+        p->diag->ln += base;
+    }
+    return c->rc;
 }
 
 /*
- * true iff the line is the start of a list.
+ * Feed each line in the LEN bytes at DATA to the parser P, parsing
+ * with P->ctx->threads threads; see above.
  *
- * This is of the following form:
- *    listTitle =
- * where whitespace between listTitle and '=' is ignored.
- *
- * If k is not NULL, then it must be a buffer of size buffsz which
- * the list head string is going to be extracted and written into.
- *
- * NOTES:
- *  - line must not be NULL
- *  - line must be STRIPPED of comment, and leading and trailing whitespace
+ * Return 0 on success, -1 on error, or the non-zero value returned
+ * by the user callback, if any.
  */
-bool is_list_head(char *line, char k[], size_t buffsz){
-    assert(line);
-    char *key_start=NULL, *key_end=NULL;
-    say(" ~~ is_list_head ? : '%s'\n", line);
-
-    /* first char must be in the allowable set */
-    if (! *line || !is_allowed(*line, false)) return false;
-    key_start = line;  /* start of key */
+static int parse_parallel(struct cinic_parser *p, const char *data, size_t len){
+    struct parallel pp = {
+        .ctx = p->ctx,
+        .data = data,
+        .len = len,
+        .ahead = PARALLEL_AHEAD * p->ctx->threads,
+        .in_section = p->in_section
+    };
+    pp.nchunks = len / PARALLEL_CHUNK;
+    pp.size = len / pp.nchunks;
+
+    pthread_t *tids = calloc(p->ctx->threads, sizeof(*tids));
+    if (!tids || !(pp.chunks = calloc(pp.nchunks, sizeof(*pp.chunks)))){
+        free(tids);
+        return parse_lines(p, data, len, SIZE_MAX);
+    }
+    pthread_mutex_init(&pp.lock, NULL);
+    pthread_cond_init(&pp.work, NULL);
+    pthread_cond_init(&pp.done, NULL);
 
-    /* go to the end of the key */
-    while (*line && is_allowed(*line, false)) ++line;
-    if (! *line) return false;
-    key_end = line; /* end of key */
+    unsigned nthreads = 0;
+    while (nthreads < p->ctx->threads && !pthread_create(&tids[nthreads], NULL, parallel_worker, &pp)){
+        ++nthreads;
+    }
 
-    /* intervening whitespace between key and = is allowed */
-    line = strip_lws(line);
-    if (! *line || *line++ != '=') return false;
+    int rc = 0;
+    uint32_t base = 0;
+    if (!nthreads){
+        rc = parse_lines(p, data, len, SIZE_MAX);
+    }
+    for (size_t i = 0; nthreads && i < pp.nchunks; ++i){
+        struct parse_chunk *c = &pp.chunks[i];
+
+        pthread_mutex_lock(&pp.lock);
+        while (!c->done) pthread_cond_wait(&pp.done, &pp.lock);
+        pthread_mutex_unlock(&pp.lock);
+
+        rc = replay_chunk(p, &pp, c, base);
+        base += c->lines;
+        free(c->events);
+        c->events = NULL;
+
+        pthread_mutex_lock(&pp.lock);
+        pp.replayed = i + 1;
+        pp.stop = (rc != 0);
+        pthread_cond_broadcast(&pp.work);
+        pthread_mutex_unlock(&pp.lock);
+        if (rc) break;
+    }
 
-    /* line should be ending here */
-    if (*line) return false;
+    for (unsigned i = 0; i < nthreads; ++i){
+        pthread_join(tids[i], NULL);
+    }
+    for (size_t i = 0; i < pp.nchunks; ++i){
+        free(pp.chunks[i].events);
+    }
+    pthread_cond_destroy(&pp.done);
+    pthread_cond_destroy(&pp.work);
+    pthread_mutex_destroy(&pp.lock);
+    free(pp.chunks);
+    free(tids);
+    return rc;
+}
 
-    /* user wants the key name extracted */
-    if (k){
-        cp_to_buff(k, key_start, buffsz, key_end - key_start);
+/*
+ * Feed each line in the LEN bytes at DATA to the parser P.
+ *
+ * Buffers big enough are parsed in parallel if so requested by the
+ * context (see parse_parallel()), unless linting, which carries on
+ * past errors and so needs every line in order.
+ *
+ * Return 0 on success, -1 on error, or the non-zero value returned
+ * by the user callback, if any.
+ */
+static int parse_mem(struct cinic_parser *p, const char *data, size_t len){
+    if (p->ctx->threads > 1 && !p->lint && len >= 2 * PARALLEL_CHUNK){
+        return parse_parallel(p, data, len);
     }
-    return true;
+    return parse_lines(p, data, len, SIZE_MAX);
 }
 
 /*
- * True if the single-char line is a closing bracket to terminate a list.
+ * Feed each line in the file open at FD to the parser P, and close FD.
+ * SB is the fstat() of FD, or NULL if that failed.
  *
- * NOTES:
- *  - line must not be NULL
- *  - line must be STRIPPED of comment, and leading and trailing whitespace
+ * Return 0 on success, -1 on error, or the non-zero value returned
+ * by the user callback, if any.
  */
-bool is_list_end(char *line){
-    assert(line);
-    say(" ~~ is_list_end ? : '%s'\n", line);
+static int parse_fd(struct cinic_parser *p, int fd, const struct stat *sb){
+    int rc = 0;
 
-    /* only char must be closing bracket */
-    if (strlen(line) != 1 || *line != LIST_BRACKET[1]){
-        return false;
+    if (sb && S_ISREG(sb->st_mode) && sb->st_size > 0 && (uintmax_t)sb->st_size <= SIZE_MAX){
+        size_t len = sb->st_size;
+        void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED){
+            close(fd);
+            posix_madvise(data, len, POSIX_MADV_SEQUENTIAL);
+            rc = parse_mem(p, data, len);
+            munmap(data, len);
+            return rc;
+        }
     }
 
-    return true;
+    /* not mappable; fall back to reading it as a stream */
+    FILE *f = fdopen(fd, "r");
+    if (!f){
+        rc = io_error(p, errno);
+        close(fd);
+        return rc;
+    }
+    rc = parse_stream(p, f);
+    fclose(f);
+    return rc;
 }
 
 /*
- * True if the single-char line is an opening bracket to begin a list.
+ * Feed each line in the file at PATH to the parser P.
  *
- * NOTES:
- *  - line must not be NULL
- *  - line must be STRIPPED of comment, and leading and trailing whitespace
+ * Return 0 on success, -1 on error, or the non-zero value returned
+ * by the user callback, if any.
  */
-bool is_list_start(char *line){
-    assert(line);
-    say(" ~~ is_list_start ? : '%s'\n", line);
+static int parse_file(struct cinic_parser *p, const char *path){
+    assert(p && path);
 
-    /* only char must be opening bracket */
-    if (strlen(line) != 1 || *line != *LIST_BRACKET){
-        return false;
+    struct stat sb;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return io_error(p, errno);
     }
+    bool known = !fstat(fd, &sb);
+
+    /* where include directives in it are relative to, and for catching cycles */
+    const char *outer = p->path;
+    const struct include_frame *files = p->files;
+    struct include_frame frame = { known ? sb.st_dev : 0, known ? sb.st_ino : 0, files };
+    p->path = path;
+    if (known) p->files = &frame;
+
+    int rc = parse_fd(p, fd, known ? &sb : NULL);
+    p->path = outer;
+    p->files = files;
+    return rc;
+}
 
-    return true;
+/*
+ * Following include directives; see cinic_ctx.includes in cinic.h.
+ *
+ * The parser parses each file a directive names itself, in place of
+ * the directive, with the state of the file including it put aside and
+ * put back afterwards. Included files are mapped, like any other, so
+ * the views the sink was handed from the file including them stay
+ * valid throughout, and big ones are parsed in parallel as usual.
+ */
+
+/*
+ * Record in the diagnostic of the parser P that the include directive
+ * at offset pos of the current line failed with error (and errnum).
+ *
+ * Return -1 if parsing must stop there, or 0 if linting; see
+ * parse_error(). */
+static int include_error(struct cinic_parser *p, enum cinic_error error, int errnum, size_t pos){
+    int rc = parse_error(p, error, pos);
+    p->diag->errnum = errnum;
+    if (!rc) p->diags[p->ndiags - 1].errnum = errnum;
+    return rc;
+}
+
+/*
+ * Return the path named by the view v in an include directive, taken
+ * from the directory of the file at base (or as it is, if base is NULL
+ * or v is absolute), in a malloc-ed string; or NULL if out of memory. */
+static char *include_path(const char *base, const struct cinic_view *v){
+    const char *slash = base ? strrchr(base, '/') : NULL;
+    size_t dirlen = (slash && !(v->len && v->s[0] == '/')) ? (size_t)(slash - base) + 1 : 0;
+
+    char *path = malloc(dirlen + v->len + 1);
+    if (!path) return NULL;
+    if (dirlen) memcpy(path, base, dirlen);
+    memcpy(path + dirlen, v->s, v->len);
+    path[dirlen + v->len] = '\0';
+    return path;
 }
 
 /*
- * True iff the line represents a list entry, else false.
+ * Tell the sink of the parser P, if any, about the file or directory
+ * at path, with identity id, that the include directive in lx names.
  *
- * A list entry is a contigous string of characters that are in the
- * allowed set. If the string ends with a comma, it's a regular list
- * item, otherwise it's a 'final' list item. All items in a list but
- * the last must be followed by a comma. An arbitrary amount of
- * whitespace can come after the item and before the comma.
- * but can as usual appear as part of the optional comment.
+ * Return 0, or the non-zero value returned by the sink. */
+static int include_source(struct cinic_parser *p, const char *path, const struct file_id *id, const struct cinic_lexeme *lx){
+    if (!p->sink) return 0;
+
+    struct cinic_view k = { path, strlen(path) };
+    struct cinic_view v = { (const char *)id, sizeof(*id) };
+    int rc = p->sink(p->ud, CINIC_EV_INCLUDE, p->ln, NOLIST, &k, &v);
+    if (rc){
+        parse_error(p, CINIC_ABORTED, lx->pos);
+    }
+    return rc;
+}
+
+/*
+ * Parse the file at path, named by the include directive in lx, in
+ * place of the directive.
  *
- * If the value is NOT followed by a coma, it is considered to be a 'final'
- * list item and 'true' is written to 'islast'. The string representing the
- * list item is written to v, which must be a buffer of size buffsz.
+ * Return 0 on success, -1 on error, or the non-zero value returned
+ * by the user callback, if any.
+ */
+static int include_file(struct cinic_parser *p, const char *path, const struct cinic_lexeme *lx){
+    struct file_id id;
+    int rc = file_id(path, &id);
+    if (rc){
+        return include_error(p, CINIC_IO, rc, lx->pos);
+    }
+    for (const struct include_frame *f = p->files; f; f = f->prev){
+        if (f->dev == id.dev && f->ino == id.ino){
+            return include_error(p, CINIC_INCLUDE_CYCLE, 0, lx->pos);
+        }
+    }
+    if ( (rc = include_source(p, path, &id, lx)) ) return rc;
 
- * NOTES:
- *  - line, v, and islast must not be NULL
- *  - line must be STRIPPED of comment, and leading and trailing whitespace
+    /* the section the directive is in, to carry on in afterwards */
+    char *section = strdup(p->in_section ? buff_cstr(&p->section) : "");
+    if (!section){
+        return parse_error(p, CINIC_NOMEM, lx->pos);
+    }
+    uint32_t ln = p->ln;
+    bool in_section = p->in_section;
+    size_t nsections = p->nsections;
+
+    p->ln = 0;
+    p->depth++;
+    rc = parse_file(p, path);
+    p->depth--;
+    p->ln = ln;
+    p->list = NOLIST;
+    p->resync = false;
+    p->in_section = in_section;
+
+    if (rc && p->diag->code == CINIC_IO && !p->diag->ln){
+        /* could not be read, rather than an error in it */
+        rc = include_error(p, CINIC_IO, p->diag->errnum, lx->pos);
+    }
+    if (!rc && p->nsections != nsections){
+        struct cinic_lexeme title = { .k = { section, strlen(section) }, .pos = lx->pos };
+        rc = emit(p, CINIC_EV_SECTION, &title);
+    }
+    free(section);
+    return rc;
+}
+
+/* compare the strings pointed to by a and b, for qsort() */
+static int compare_paths(const void *a, const void *b){
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Return the path of the entry name in the directory at dir, in a
+ * malloc-ed string; or NULL if out of memory. */
+static char *path_join(const char *dir, const char *name){
+    size_t dlen = strlen(dir), nlen = strlen(name);
+    char *path = malloc(dlen + nlen + 2);
+    if (!path) return NULL;
+    memcpy(path, dir, dlen);
+    path[dlen] = '/';
+    memcpy(path + dlen + 1, name, nlen + 1);
+    return path;
+}
+
+/*
+ * Parse each of the regular files named *.ini in the directory at
+ * dir, named by the include directive in lx, in order of name; see
+ * include_file().
  */
-bool is_list_entry(char *line, char v[], size_t buffsz, bool *islast){
-    assert(line);
-    char *val_start = NULL, *val_end = NULL;
-    bool last_in_list = false;
-    say(" ~~ is_list_entry ? : '%s'\n", line);
+static int include_dir(struct cinic_parser *p, const char *dir, const struct cinic_lexeme *lx){
+    struct file_id id;
+    struct stat sb;
+    struct dirent *de;
+    char **paths = NULL;
+    size_t npaths = 0, cap = 0;
+    int rc = 0;
 
-    /* first char must be from the allowable set */
-    if (! *line || !is_allowed(*line, false)) return false;
-    val_start = line;
+    DIR *d = opendir(dir);
+    if (!d){
+        return include_error(p, CINIC_IO, errno, lx->pos);
+    }
+    if (!file_id(dir, &id)){
+        rc = include_source(p, dir, &id, lx);
+    }
 
-    /* go to the end of value */
-    while (*line && is_allowed(*line, false)) ++line;
-    val_end = line;
+    while (!rc && (de = readdir(d))){
+        size_t len = strlen(de->d_name);
+        if (len <= 4 || strcmp(de->d_name + len - 4, ".ini")) continue;
 
-    /* strip any whitespace */
-    line = strip_lws(line);
+        if (npaths == cap){
+            size_t n = cap ? 2 * cap : 16;
+            char **grown = realloc(paths, n * sizeof(*paths));
+            if (!grown){
+                rc = parse_error(p, CINIC_NOMEM, lx->pos);
+                break;
+            }
+            paths = grown;
+            cap = n;
+        }
+        if (!(paths[npaths] = path_join(dir, de->d_name))){
+            rc = parse_error(p, CINIC_NOMEM, lx->pos);
+            break;
+        }
+        ++npaths;
+    }
+    closedir(d);
 
-    /* char here must be either NUL or a comma */
-    if (*line && *line != ','){
-        return false;
+    if (npaths) qsort(paths, npaths, sizeof(*paths), compare_paths);
+    for (size_t i = 0; !rc && i < npaths; ++i){
+        if (!stat(paths[i], &sb) && S_ISREG(sb.st_mode)){
+            rc = include_file(p, paths[i], lx);
+        }
     }
-    else if (! *line){
-        last_in_list = true;
-    }else if (*line == ','){
-        last_in_list = false;
-        ++line;
+    for (size_t i = 0; i < npaths; ++i){
+        free(paths[i]);
     }
+    free(paths);
+    return rc;
+}
 
-    /* line should be ending here */
-    assert(! *line);
+/*
+ * Parse the file at pattern, named by the include directive in lx; or,
+ * if pattern is a glob(3) pattern, each of the regular files it
+ * matches, in order. See include_file().
+ */
+static int include_files(struct cinic_parser *p, const char *pattern, const struct cinic_lexeme *lx){
+    struct file_id id;
+    struct stat sb;
+    glob_t g;
+    int rc = 0;
 
-    /* user wants value extracted and line mangled to that end */
-    if (v){
-        cp_to_buff(v, val_start, buffsz, val_end - val_start);
+    if (!strpbrk(pattern, "*?[")){
+        return include_file(p, pattern, lx);
     }
 
-    /* user wants to know if this value is the last in the list or not */
-    if (islast) *islast = last_in_list;
+    /* files coming and going in the directory matched in change what is included */
+    const char *slash = strrchr(pattern, '/');
+    char *dir = slash ? strndup(pattern, slash > pattern ? (size_t)(slash - pattern) : 1) : strdup(".");
+    if (!dir){
+        return parse_error(p, CINIC_NOMEM, lx->pos);
+    }
+    if (!strpbrk(dir, "*?[") && !file_id(dir, &id)){
+        rc = include_source(p, dir, &id, lx);
+    }
+    free(dir);
+    if (rc) return rc;
+
+    switch (glob(pattern, 0, NULL, &g)){
+    case 0:
+        for (size_t i = 0; !rc && i < g.gl_pathc; ++i){
+            if (!stat(g.gl_pathv[i], &sb) && S_ISREG(sb.st_mode)){
+                rc = include_file(p, g.gl_pathv[i], lx);
+            }
+        }
+        break;
+    case GLOB_NOMATCH:
+        break;
+    case GLOB_NOSPACE:
+        rc = parse_error(p, CINIC_NOMEM, lx->pos);
+        break;
+    default:
+        rc = include_error(p, CINIC_IO, errno, lx->pos);
+        break;
+    }
+    globfree(&g);
+    return rc;
+}
 
-    return true;
+/*
+ * Follow the include directive in lx, in place of it.
+ *
+ * Return 0 on success, -1 on error, or the non-zero value returned
+ * by the user callback, if any.
+ */
+static int include(struct cinic_parser *p, const struct cinic_lexeme *lx){
+    char *target = include_path(p->path, &lx->v);
+    if (!target){
+        return parse_error(p, CINIC_NOMEM, lx->pos);
+    }
+
+    int rc = (include_kind(&lx->k) == INCLUDE_DIR) ? include_dir(p, target, lx)
+                                                     : include_files(p, target, lx);
+    free(target);
+    return rc;
 }
 
 /*
- * Parse the .ini config file found at PATH.
+ * Parse the .ini config file found at PATH according to CTX.
  *
  * For each line parsed that is NOT a comment / an empty line
  * / a section title / a list head / a list opening or closing
@@ -633,169 +1647,416 @@ bool is_list_entry(char *line, char v[], size_t buffsz, bool *islast){
  * items: in this case, the callback gets called for each item in
  * the list on that line.
  *
- * On error, the program EXITS with error. Error conditions are
- * not recoverable from. The .ini config file should instead be
- * fixed and made syntactically compliant.
+ * On error, parsing stops and -1 is returned; the details are stored
+ * in DIAG, if not NULL. Parsing cannot resume after an error: the
+ * .ini config file should instead be fixed and made syntactically
+ * compliant. Nothing is printed.
  * The following cause errors:
  *  - lines that exceed the maximum permissible length
- *  - global record lines IFF ALLOW_GLOBAL_RECORDS is false
- *  - empty lists IFF ALLOW_EMPTY_LISTS is false
+ *  - global record lines IFF ctx->allow_globals is false
+ *  - empty lists IFF ctx->allow_empty_lists is false
  *  - malformed list entries
  *  - lines that are not recognized as syntactically correct
+ *  - failure to open or read the file (CINIC_IO)
  *
- * Beyond these fatal errors, the callback can itself also signal an
+ * Beyond these errors, the callback can itself also signal an
  * error condition by returning a non-zero value. If such a value is
- * returned, Cinic_parse will return immediately with the same value.
+ * returned, Cinic_parse_ex will return immediately with the same value
+ * and diag->code is set to CINIC_ABORTED.
+ *
+ * Regular files are mapped into memory and scanned in place, which
+ * avoids copying every line through stdio. Anything that cannot be
+ * mapped (pipes, character devices, files in procfs that report a
+ * size of 0, etc) is read line by line as a stream instead.
+ * As with any mapped file, the file must not be truncated while it is
+ * being parsed.
+ *
+ * All parser state is local to this call and ctx is only read from,
+ * so concurrent calls do not interfere with each other.
  *
  * NOTES:
- *  - cb and path must not be NULL
+ *  - ctx, cb and path must not be NULL; diag may be NULL
  *  - path must specify the absolute path to an .ini config file
  */
-int Cinic_parse(const char *path, config_cb cb){
-    assert(path && cb);
+int Cinic_parse_ex(const struct cinic_ctx *ctx, const char *path, config_cb cb, struct cinic_diag *diag){
+    assert(ctx && path && cb);
+
+    struct cinic_diag dummy;
+    struct cinic_parser p = {
+        .ctx = ctx,
+        .cb = cb,
+        .ln = 0,
+        .list = NOLIST,
+        .islast = false,
+        .diag = diag ? diag : &dummy
+    };
+    memset(p.diag, 0, sizeof(*p.diag));
+
+    int rc = parse_file(&p, path);
+    parser_free(&p);
+    return rc;
+}
 
-    int rc = 0;
-    char key[MAX_LINE_LEN]     = {0};
-    char val[MAX_LINE_LEN]     = {0};
-    char section[MAX_LINE_LEN] = {0};
+/*
+ * Parse the .ini config held in the LEN bytes at DATA, according to CTX.
+ *
+ * This behaves exactly like Cinic_parse_ex() -- including the callback
+ * and error semantics -- except the config is read from memory rather
+ * than from a file. DATA need not be NUL-terminated; lines are
+ * delimited by '\n' and the last line need not end in one.
+ *
+ * NOTES:
+ *  - ctx and cb must not be NULL; data may only be NULL if len is 0
+ *  - diag may be NULL
+ */
+int Cinic_parse_buffer(const struct cinic_ctx *ctx, const char *data, size_t len, config_cb cb, struct cinic_diag *diag){
+    assert(ctx && cb && (data || !len));
+
+    struct cinic_diag dummy;
+    struct cinic_parser p = {
+        .ctx = ctx,
+        .cb = cb,
+        .ln = 0,
+        .list = NOLIST,
+        .islast = false,
+        .diag = diag ? diag : &dummy
+    };
+    memset(p.diag, 0, sizeof(*p.diag));
+
+    int rc = parse_mem(&p, data, len);
+    parser_free(&p);
+    return rc;
+}
 
-    enum cinic_list_state list = NOLIST;    /* to assess list state transitions */
-    bool islast = false;                    /* final list item */
-    uint32_t ln = 0;                        /* line number */
-    uint32_t bytes_read = 0;                /* bytes read by getline; 0 on EOF */
+/*
+ * Like Cinic_parse_ex(), but call CB, along with UD, on every event;
+ * see cinic_event_cb in cinic.h.
+ *
+ * NOTES:
+ *  - ctx, path and cb must not be NULL; ud and diag may be NULL
+ */
+int Cinic_parse_events(const struct cinic_ctx *ctx, const char *path, cinic_event_cb cb, void *ud, struct cinic_diag *diag){
+    assert(ctx && path && cb);
+
+    struct cinic_diag dummy;
+    struct cinic_parser p = {
+        .ctx = ctx,
+        .ecb = cb,
+        .ud = ud,
+        .list = NOLIST,
+        .diag = diag ? diag : &dummy
+    };
+    memset(p.diag, 0, sizeof(*p.diag));
+
+    int rc = parse_file(&p, path);
+    parser_free(&p);
+    return rc;
+}
 
-    /* allocated and resized by `getline()` as needed */
-    char *buff__ = NULL;   // pointer must not change; kept intact for eventual free() call
-    char *buff = buff__;   // change this instead
-    size_t buffsz = 0;
+/*
+ * Like Cinic_parse_events(), but parse the config held in the LEN
+ * bytes at DATA.
+ */
+int Cinic_parse_buffer_events(const struct cinic_ctx *ctx, const char *data, size_t len, cinic_event_cb cb, void *ud, struct cinic_diag *diag){
+    assert(ctx && cb && (data || !len));
+
+    struct cinic_diag dummy;
+    struct cinic_parser p = {
+        .ctx = ctx,
+        .ecb = cb,
+        .ud = ud,
+        .list = NOLIST,
+        .diag = diag ? diag : &dummy
+    };
+    memset(p.diag, 0, sizeof(*p.diag));
+
+    int rc = parse_mem(&p, data, len);
+    parser_free(&p);
+    return rc;
+}
 
-    FILE *f = fopen(path, "r");
-    if (!f){
-        fprintf(stderr, "Failed to open file:'%s'\n", path);
-        exit(EXIT_FAILURE);
+/*
+ * Like Cinic_parse_ex(), but call CB, along with UD, with views of the
+ * tokens; see config_view_cb in cinic.h.
+ *
+ * NOTES:
+ *  - ctx, path and cb must not be NULL; ud and diag may be NULL
+ */
+int Cinic_parse_views(const struct cinic_ctx *ctx, const char *path, config_view_cb cb, void *ud, struct cinic_diag *diag){
+    assert(ctx && path && cb);
+
+    struct cinic_diag dummy;
+    struct cinic_parser p = {
+        .ctx = ctx,
+        .vcb = cb,
+        .ud = ud,
+        .list = NOLIST,
+        .diag = diag ? diag : &dummy
+    };
+    memset(p.diag, 0, sizeof(*p.diag));
+
+    int rc = parse_file(&p, path);
+    parser_free(&p);
+    return rc;
+}
+
+/*
+ * Like Cinic_parse_views(), but parse the config held in the LEN bytes
+ * at DATA.
+ */
+int Cinic_parse_buffer_views(const struct cinic_ctx *ctx, const char *data, size_t len, config_view_cb cb, void *ud, struct cinic_diag *diag){
+    assert(ctx && cb && (data || !len));
+
+    struct cinic_diag dummy;
+    struct cinic_parser p = {
+        .ctx = ctx,
+        .vcb = cb,
+        .ud = ud,
+        .list = NOLIST,
+        .diag = diag ? diag : &dummy
+    };
+    memset(p.diag, 0, sizeof(*p.diag));
+
+    int rc = parse_mem(&p, data, len);
+    parser_free(&p);
+    return rc;
+}
+
+/*
+ * Like Cinic_parse_ex(), but report every event to SINK, along with UD,
+ * instead of calling back a config_cb. See cinic_sink in utils__.h.
+ *
+ * NOTES:
+ *  - ctx, path and sink must not be NULL; diag may be NULL
+ */
+int parse_file_events(const struct cinic_ctx *ctx, const char *path, cinic_sink sink, void *ud, struct cinic_diag *diag){
+    assert(ctx && path && sink);
+
+    struct cinic_diag dummy;
+    struct cinic_parser p = {
+        .ctx = ctx,
+        .sink = sink,
+        .ud = ud,
+        .list = NOLIST,
+        .diag = diag ? diag : &dummy
+    };
+    memset(p.diag, 0, sizeof(*p.diag));
+
+    int rc = parse_file(&p, path);
+    if (!rc) rc = sink(ud, CINIC_EV_END, p.ln, p.list, NULL, NULL);
+    parser_free(&p);
+    return rc;
+}
+
+/*
+ * Like parse_file_events(), but parse the config held in the LEN bytes
+ * at DATA. If PATH is not NULL, DATA was read from the file there:
+ * include directives are then relative to it, as if parsing PATH.
+ */
+int parse_buffer_events(const struct cinic_ctx *ctx, const char *data, size_t len, const char *path,
+                        cinic_sink sink, void *ud, struct cinic_diag *diag)
+{
+    assert(ctx && sink && (data || !len));
+
+    struct cinic_diag dummy;
+    struct cinic_parser p = {
+        .ctx = ctx,
+        .sink = sink,
+        .ud = ud,
+        .list = NOLIST,
+        .diag = diag ? diag : &dummy,
+        .path = path
+    };
+    memset(p.diag, 0, sizeof(*p.diag));
+
+    struct stat sb;
+    struct include_frame frame;
+    if (path && !stat(path, &sb)){
+        frame = (struct include_frame){ sb.st_dev, sb.st_ino, NULL };
+        p.files = &frame;
     }
 
-    /* for each line read from config file */
-    while ( ( bytes_read = read_line(f, &buff__, &buffsz)) ){
-        ++ln;
-        buff = buff__;
-        say(" ~ read line %u: '%s'", ln, buff);
-
-        /* line too long */
-        if(bytes_read > MAX_LINE_LEN){
-            cinic_exit_print(CINIC_TOOLONG, ln);
-        }
+    int rc = parse_mem(&p, data, len);
+    if (!rc) rc = sink(ud, CINIC_EV_END, p.ln, p.list, NULL, NULL);
+    parser_free(&p);
+    return rc;
+}
 
-        if (is_empty_line(buff) || is_comment_line(buff) ){
-            continue;
-        }
+/*
+ * Set up the parser P to lint according to CTX: nothing is called
+ * back and errors are collected in P rather than stopping parsing.
+ * SCRATCH is where each error is put together before being collected.
+ */
+static void lint_init(struct cinic_parser *p, const struct cinic_ctx *ctx, struct cinic_diag *scratch){
+    memset(p, 0, sizeof(*p));
+    memset(scratch, 0, sizeof(*scratch));
+    p->ctx = ctx;
+    p->list = NOLIST;
+    p->lint = true;
+    p->diag = scratch;
+}
 
-        buff = strip_lws(buff);
-        strip_comment(buff);
-        strip_tws(buff);
+/*
+ * Hand the errors collected by the parser P over to the caller of
+ * Cinic_lint() / Cinic_lint_buffer(). RC is what parsing returned.
+ */
+static int lint_finish(struct cinic_parser *p, int rc, struct cinic_diag **diags, size_t *ndiags){
+    /* failed to read the whole config: say why, if there is room */
+    if (rc && p->diag->code == CINIC_IO){
+        lint_record(p);
+    }
+    *diags = p->diags;
+    *ndiags = p->ndiags;
+    parser_free(p);
+    return rc ? -1 : 0;
+}
 
-        /* section title line */
-        if(is_section_line(buff, section, MAX_LINE_LEN)){
-            say(" ~ line %u is a section title\n", ln);
-            if (list){
-                cinic_exit_print(CINIC_NESTED, ln);
-            }
-        }
+/*
+ * Check the .ini config file found at PATH is valid according to CTX,
+ * and report everything that is wrong with it.
+ *
+ * Unlike Cinic_parse_ex(), parsing does not stop at the first error:
+ * the parser resynchronizes after each one (see parse_line()) and goes
+ * on to the end of the file, in a single pass. Nothing is called back.
+ *
+ * On return, *DIAGS points to an array of *NDIAGS diagnostics, in the
+ * order found, or NULL if there are none. The caller must free() it.
+ *
+ * Return 0 if the whole config was checked -- whether any errors were
+ * found or not -- or -1 if that was not possible: if the file could
+ * not be read, the last diagnostic says why (CINIC_IO); otherwise,
+ * memory ran out. In both cases, the diagnostics collected up to that
+ * point are still returned.
+ *
+ * NOTES:
+ *  - ctx, path, diags and ndiags must not be NULL
+ */
+int Cinic_lint(const struct cinic_ctx *ctx, const char *path, struct cinic_diag **diags, size_t *ndiags){
+    assert(ctx && path && diags && ndiags);
 
-        /*  key-value line */
-        else if (is_record_line(buff, key, val, MAX_LINE_LEN)){
-            say(" ~ line %u is a record line\n", ln);
-            if (! *section && !ALLOW_GLOBAL_RECORDS){
-                cinic_exit_print(CINIC_NOSECTION, ln);
-            }else if (list){
-                cinic_exit_print(CINIC_NESTED, ln);
-            }
-            if ( (rc = cb(ln, list, section, key, val)) ) return rc;
-        }
+    struct cinic_parser p;
+    struct cinic_diag scratch;
+    lint_init(&p, ctx, &scratch);
 
-        /* else, try list */
-        else {
-            say(" ~ trying list parsing on line %u \n", ln);
-            char curr_token_buff[MAX_LINE_LEN] = {0};
-            char *next_token = buff; /* initialize */
-            enum cinic_error cerr;
-
-            while ((next_token = get_list_token(next_token, curr_token_buff, MAX_LINE_LEN))){
-                say("---> current token = '%s'\n", curr_token_buff);
-
-                /* list head */
-                if(is_list_head(curr_token_buff, key, MAX_LINE_LEN)){
-                    if ( (cerr = Cinic_get_list_error(list, LIST_HEAD)) ){
-                        cinic_exit_print(cerr, ln);
-                    }
-                    list = LIST_HEAD;
-                    islast = false;
-                    continue;
-                }
-
-                /* opening bracket */
-                else if (is_list_start(curr_token_buff)){
-                    if ( (cerr = Cinic_get_list_error(list, LIST_OPEN)) ){
-                        cinic_exit_print(cerr, ln);
-                    }
-                    list = LIST_OPEN;
-                    continue;
-                }
-
-                /* list entry */
-                else if(is_list_entry(curr_token_buff, val, MAX_LINE_LEN, &islast)){
-                    if ( (cerr = Cinic_get_list_error(list, islast ? LIST_LAST : LIST_ONGOING)) ){
-                        cinic_exit_print(cerr, ln);
-                    }
-                    list = islast ? LIST_LAST : LIST_ONGOING; /* reset :  */
-                }
-
-                /* list end */
-                else if(is_list_end(curr_token_buff)){
-                    if ( (cerr = Cinic_get_list_error(list, NOLIST)) ){
-                        cinic_exit_print(cerr, ln);
-                    }
-                    list = NOLIST;
-                    continue;
-                }
-
-                /* not a list component/token recognized as valid */
-                /* not any kind of line recognized as valid */
-                else{
-                    cinic_exit_print(CINIC_MALFORMED, ln);
-                }
-
-                if ( (rc = cb(ln, list, section, key, val)) ) return rc;
-            } /* while: list token parsing */
-        } /* if: try list parsing */
-    } /* while getline() */
+    return lint_finish(&p, parse_file(&p, path), diags, ndiags);
+}
 
-    fclose(f);
-    free(buff__);
-    return 0;     /* success */
+/*
+ * Like Cinic_lint(), but check the config held in the LEN bytes at DATA.
+ *
+ * NOTES:
+ *  - ctx, diags and ndiags must not be NULL; data may only be NULL if
+ *    len is 0
+ */
+int Cinic_lint_buffer(const struct cinic_ctx *ctx, const char *data, size_t len, struct cinic_diag **diags, size_t *ndiags){
+    assert(ctx && (data || !len) && diags && ndiags);
+
+    struct cinic_parser p;
+    struct cinic_diag scratch;
+    lint_init(&p, ctx, &scratch);
+
+    return lint_finish(&p, parse_mem(&p, data, len), diags, ndiags);
 }
 
 /*
- * Initialize Cinic internal state.
+ * Parse the .ini config file found at PATH using the default context.
  *
- * There are various internal variables that can be used to customize
- * parsing behavior. See the declaration in cinic.h.
+ * See Cinic_parse_ex() FMI; the default context can be configured
+ * via Cinic_init(). Unlike Cinic_parse_ex(), errors are also reported
+ * on stderr.
+ */
+int Cinic_parse(const char *path, config_cb cb){
+    struct cinic_diag diag;
+    int rc = Cinic_parse_ex(&default_ctx, path, cb, &diag);
+
+    switch(diag.code){
+    case CINIC_SUCCESS:
+    case CINIC_ABORTED:
+        break;
+    case CINIC_IO:
+        fprintf(stderr, "Failed to read file:'%s' -- %s\n", path, strerror(diag.errnum));
+        break;
+    default:
+        fprintf(stderr, "Cinic: failed to parse line %" PRIu32 " -- %s\n", diag.ln, Cinic_err2str(diag.code));
+        break;
+    }
+    return rc;
+}
+
+/*
+ * True if the 2-char string b can be used as list brackets.
  *
- * Some other variables are not settable through this init function but
- * could be modified manually, including:
- *  - LIST_BRACKET
+ * The brackets must be distinct from each other and from anything else
+ * that is significant to the parser: characters that can appear in keys
+ * and values, whitespace, comment symbols, '=' and ','. The opening
+ * bracket can be '[' and the closing bracket can be ']', but not the
+ * other way around, as those delimit section titles.
  */
-void Cinic_init(bool allow_globals,
-                bool allow_empty_lists,
-                const char *section_delim
-                )
+static bool valid_list_brackets(const char *b){
+    for (int i = 0; i < 2; ++i){
+        unsigned char c = b[i];
+        if (is_allowed(c, true) || is_comment(c) || c == '=' || c == ','){
+            return false;
+        }
+    }
+    return (b[0] != b[1] && b[0] != ']' && b[1] != '[');
+}
+
+/*
+ * Initialize a parser context.
+ *
+ * See struct cinic_ctx in cinic.h for the meaning of the fields.
+ */
+int Cinic_ctx_init(struct cinic_ctx *ctx,
+                   bool allow_globals,
+                   bool allow_empty_lists,
+                   const char *section_delim,
+                   const char *list_brackets
+                   )
 {
-    ALLOW_GLOBAL_RECORDS = allow_globals;
-    ALLOW_EMPTY_LISTS = allow_empty_lists;
+    assert(ctx && section_delim);
+
+    if (!list_brackets){
+        list_brackets = "[]";
+    }
 
+    /* a section delimiter must be a single char */
     if (strlen(section_delim) > 1){
-        fprintf(stderr, "Invalid section delimiter specified: '%s' -- must be a single char\n", section_delim);
-        exit(EXIT_FAILURE);
+        return CINIC_BAD_OPTION;
+    }
+    /* list brackets must be 2 distinct punctuation chars */
+    if (strlen(list_brackets) != 2 || !valid_list_brackets(list_brackets)){
+        return CINIC_BAD_OPTION;
     }
-    SECTION_NS_SEP = section_delim;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->allow_globals = allow_globals;
+    ctx->allow_empty_lists = allow_empty_lists;
+    ctx->section_ns_sep[0] = *section_delim;
+    ctx->list_bracket[0] = list_brackets[0];
+    ctx->list_bracket[1] = list_brackets[1];
+
+    /* the lexer tells brackets apart by their class; see enum cinic_cclass */
+    unsigned char open = list_brackets[0], close = list_brackets[1];
+    memcpy(ctx->cclass, base_cclass, sizeof(ctx->cclass));
+    ctx->cclass[open]  = (open == '[')  ? CC_BOPEN  : CC_LOPEN;
+    ctx->cclass[close] = (close == ']') ? CC_BCLOSE : CC_LCLOSE;
+    return 0;
+}
+
+/*
+ * Initialize the default Cinic context used by Cinic_parse().
+ *
+ * There are various internal variables that can be used to customize
+ * parsing behavior. See struct cinic_ctx in cinic.h.
+ *
+ * The list brackets are not settable through this init function but
+ * can be set for a specific context via Cinic_ctx_init().
+ */
+int Cinic_init(bool allow_globals,
+               bool allow_empty_lists,
+               const char *section_delim
+               )
+{
+    return Cinic_ctx_init(&default_ctx, allow_globals, allow_empty_lists, section_delim, NULL);
 }
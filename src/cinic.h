@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>     /* size_t */
 
 /* ===============================================================================*\
  |  BSD 2-Clause License                                                           |
@@ -36,9 +37,6 @@
 /* compare 2 strings - a and b; ret=true if equal */
 #define matches(a, b) (!strcmp(a, b))
 
-/* maximum allowable line length in config file */
-#define MAX_LINE_LEN 1024U
-
 /*
  * Used to communicate the state of a list. The parser is line-oriented
  * and it does NOT parse the whole file in one go or ahead of time.
@@ -75,16 +73,152 @@ enum cinic_error{
     CINIC_REDUNDANT_BRACKET,
     CINIC_LIST_NOT_STARTED,
     CINIC_LIST_NOT_ENDED,
+    CINIC_IO,             /* a file could not be read or written; see cinic_diag.errnum */
+    CINIC_ABORTED,        /* the callback returned non-zero */
+    CINIC_BAD_OPTION,     /* invalid argument to Cinic_ctx_init() */
+    CINIC_NOMEM,          /* memory allocation failed */
+    CINIC_BAD_SNAPSHOT,   /* not a snapshot, or one this version cannot read; see Cinic_snapshot_open() */
+    CINIC_INCLUDE_CYCLE,  /* a file includes itself, directly or not; see cinic_ctx.includes */
     CINIC_SENTINEL        /* max index in cinic_error_strings */
 };
 
 /*
- * Callback to be called by Cinic_parse (and Cinic_parse_string)
+ * Details of why parsing failed, filled in by Cinic_parse_ex() and
+ * Cinic_parse_buffer().
+ *
+ * ln and col are 1-based and point at the offending token, so that
+ * the error can be reported or the config rejected without having to
+ * re-read it. They are 0 when not applicable (e.g. for CINIC_IO).
+ *
+ * Errors in a file included by the config (see cinic_ctx.includes) are
+ * in that file, whose path is then in file; it is empty for errors in
+ * the config itself. A file that cannot be included is reported at the
+ * directive that names it.
+ */
+#define CINIC_DIAG_PATH 256
+
+struct cinic_diag{
+    enum cinic_error code;  /* CINIC_SUCCESS if parsing did not fail */
+    uint32_t ln;            /* line number */
+    uint32_t col;           /* column (byte offset in the line + 1) */
+    int errnum;             /* errno value, for CINIC_IO */
+    char file[CINIC_DIAG_PATH];     /* included file the error is in; truncated if longer */
+};
+
+/*
+ * Parser configuration.
+ *
+ * All the options that influence parsing live here rather than in
+ * process-wide globals, so that a context can be set up once and handed
+ * to any number of concurrent Cinic_parse_ex() calls: the parser only
+ * ever reads from it and keeps all of its own state on the stack of the
+ * calling thread.
+ *
+ * Use Cinic_ctx_init() to populate a context.
+ */
+struct cinic_ctx{
+    /*
+     * By default each key-value entry must appear following a section
+     * declaration. Setting this to true makes it legal (where it would
+     * otherwise produce an error) to have 'global' key-value entries
+     * (or lists) i.e. entries that precede any section declarations.
+     */
+    bool allow_globals;
+
+    /*
+     * By default an empty list (list without elements) produces an error.
+     * Setting this to true will make such list occurences in an .ini file
+     * legal. This is still discouraged practice though as empty lists
+     * are useless.
+     */
+    bool allow_empty_lists;
+
+    /*
+     * The namespace delimiter in section titles e.g.
+     * section.subsection.subsubsection; '.' is the default.
+     * Note this is only significant for the lua or C++ wrappers as
+     * there the parser returns a table/map where namespace nesting
+     * is represented by table/map nesting. In C code however the
+     * parser simply calls a user-registered callback and section names
+     * are returned as whole strings.
+     * This is a NUL-terminated single-char string.
+     */
+    char section_ns_sep[2];
+
+    /*
+     * By default, lists are opened and closed using square brackets
+     * ('[', ']'). This can be customized to something else, such as
+     * curly braces ('{'. '}'). The symbol chosen MUST NOT appear
+     * anywhere else in that list.
+     *
+     * list_bracket[0] is the opening bracket and list_bracket[1]
+     * is the closing bracket. NOT NUL-terminated.
+     */
+    char list_bracket[2];
+
+    /*
+     * Lines longer than this many bytes (including the newline) are
+     * rejected with CINIC_TOOLONG. 0, the default, means there is no
+     * limit. This can be set directly, after Cinic_ctx_init(), e.g. to
+     * bound how much memory parsing an untrusted config can take.
+     */
+    size_t max_line_len;
+
+    /*
+     * If not NULL, documents loaded with this context (see Cinic_load())
+     * take their section titles and keys from this intern table rather
+     * than keeping copies of their own. NULL by default. See
+     * Cinic_intern_new().
+     */
+    struct cinic_intern *intern;
+
+    /*
+     * If greater than 1, configs read from memory or from mapped files
+     * (see Cinic_parse_ex()) that are big enough are parsed by this
+     * many threads at once, each taking a run of whole sections. The
+     * callbacks are still called from the calling thread, one at a time,
+     * in file order, with the same line numbers and errors as otherwise.
+     * Cinic_load_many() loads up to this many files at once instead.
+     * 0 by default; can be set directly, after Cinic_ctx_init().
+     */
+    unsigned threads;
+
+    /*
+     * If true, records with the key include or include_dir are not
+     * handed to the callback but are directives, which the parser
+     * follows, parsing what they name in their place:
+     *  - include = path   the file at path, or each of the files it
+     *                     matches, in order, if a glob(3) pattern
+     *  - include_dir = d  each of the files named *.ini in directory d,
+     *                     in order of name
+     * Relative paths are taken from the directory of the file the
+     * directive is in. Included files start out in the section the
+     * directive is in, and the section the directive is in carries on
+     * after them; for that, callbacks that are told about sections get
+     * told about it again (with an empty title for global entries).
+     * Directives are allowed outside of sections whatever allow_globals,
+     * and can be nested; a file including itself, directly or not, is
+     * an error (CINIC_INCLUDE_CYCLE). Line numbers are those in the file
+     * each entry is in. false by default; can be set directly, after
+     * Cinic_ctx_init().
+     */
+    bool includes;
+
+    /*
+     * Class of each byte value, as used by the lexer. Internal: filled
+     * in by Cinic_ctx_init() according to the list brackets.
+     */
+    uint8_t cclass[256];
+};
+
+/*
+ * Callback to be called by Cinic_parse (and Cinic_parse_buffer)
  * on every .ini config line being parsed. The callback will
  * get called with the arguments shown below.
  *
- * Note error conditions cause the program to exit with an error/diagnostic
- * message. The callback does NOT get to recover from errors or ignore them.
+ * Returning non-zero stops parsing; the parser returns that same value.
+ * Note the callback does NOT get to recover from or ignore syntax
+ * errors: parsing stops at the first one.
  */
 typedef
 int (* config_cb)(
@@ -101,10 +235,10 @@ int (* config_cb)(
  * The parsing is carried out line by line and for each
  * relevant entry config_cb is called.
  *  - Empty lines and lines containing only a comment are skipped.
- *  - lines not understood result in a fatal error. The callback
- *    does not get to ignore or recover from such errors. Instead,
- *    the config line should be fixed to be syntactically
- *    correct/understood.
+ *  - lines not understood stop parsing: a diagnostic message is
+ *    printed to stderr and -1 is returned. The callback does not get
+ *    to ignore or recover from such errors. Instead, the config line
+ *    should be fixed to be syntactically correct/understood.
  */
 int Cinic_parse(
         const char *path,    /* path to .ini config file */
@@ -112,14 +246,625 @@ int Cinic_parse(
         );
 
 /*
- * Initialize various internal Cinic variables.
+ * Like Cinic_parse(), but parse according to the configuration in ctx
+ * instead of the process-wide defaults set by Cinic_init(), and never
+ * print anything.
+ *
+ * Returns 0 on success, -1 if the config could not be read or is not
+ * valid, or else the non-zero value the callback returned. If diag is
+ * not NULL, it is filled in with the details in every case: in
+ * particular, diag->code tells a callback that returned -1 apart from
+ * a parsing failure.
+ *
+ * This function is reentrant: any number of threads can call it
+ * concurrently, with the same or different contexts.
+ */
+int Cinic_parse_ex(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *path,            /* path to .ini config file */
+        config_cb cb,
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * Like Cinic_parse_ex(), but parse the config held in the LEN bytes
+ * at DATA (e.g. received over the network or embedded in the program)
+ * instead of reading it from a file.
+ *
+ * DATA does not need to be NUL-terminated and is never modified.
+ */
+int Cinic_parse_buffer(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *data,            /* .ini config text */
+        size_t len,                  /* length of data in bytes */
+        config_cb cb,
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * A length-delimited reference to a string that lives elsewhere
+ * (typically a token within a line being parsed). The string is
+ * NOT necessarily NUL-terminated.
+ */
+struct cinic_view{
+    const char *s;
+    size_t len;
+};
+
+/*
+ * Callback to be called by Cinic_parse_views() (and
+ * Cinic_parse_buffer_views()) on the same entries as config_cb, but
+ * with the user pointer ud given to the parser and with the section,
+ * key and value as views rather than NUL-terminated strings.
+ *
+ * The key and value of a record, and list entries, point straight into
+ * the config text: nothing is copied or measured on their account.
+ * None of the views are NUL-terminated and all of them are only valid
+ * until the callback returns. Returning non-zero stops parsing, as for
+ * config_cb.
+ */
+typedef
+int (* config_view_cb)(
+        void *ud,                          /* user pointer given to the parser */
+        uint32_t ln,                       /* line number in the config file, starting from 1 */
+        enum cinic_list_state list,        /* used for dealing with lists; see `enum cinic_list_state` */
+        const struct cinic_view *section,  /* ini config section */
+        const struct cinic_view *k,        /* section key (if !list) / list name (if list > 0) */
+        const struct cinic_view *v         /* section value (if !list) / list entry (if list > 0) */
+        );
+
+/*
+ * Like Cinic_parse_ex(), but call cb, with ud, on every relevant
+ * entry; see config_view_cb. Any number of threads can parse at the
+ * same time, each into structures of its own given as ud.
+ */
+int Cinic_parse_views(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *path,            /* path to .ini config file */
+        config_view_cb cb,
+        void *ud,                    /* passed to cb */
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * Like Cinic_parse_views(), but parse the config held in the LEN bytes
+ * at DATA.
+ */
+int Cinic_parse_buffer_views(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *data,            /* .ini config text */
+        size_t len,                  /* length of data in bytes */
+        config_view_cb cb,
+        void *ud,                    /* passed to cb */
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * What the parser found, as reported to a cinic_event_cb.
+ */
+enum cinic_event{
+    CINIC_EV_SECTION = 0,   /* section title k */
+    CINIC_EV_RECORD,        /* record k = v */
+    CINIC_EV_LIST_HEAD,     /* list head k (start of a list) */
+    CINIC_EV_LIST_ITEM      /* list item v, in the list k last started */
+};
+
+/*
+ * Callback to be called by Cinic_parse_events() (and
+ * Cinic_parse_buffer_events()) on everything the parser finds: unlike
+ * config_cb, it is also called on section titles and list heads, so
+ * that e.g. empty sections and lists can be told apart from absent
+ * ones, and it gets the user pointer ud given to the parser, so that
+ * it needs no globals.
+ *
+ * k and v are NUL-terminated; v is NULL for section titles and list
+ * heads. They are only valid until the callback returns. Returning
+ * non-zero stops parsing, as for config_cb.
+ */
+typedef
+int (* cinic_event_cb)(
+        void *ud,                   /* user pointer given to the parser */
+        enum cinic_event ev,        /* what was found; see `enum cinic_event` */
+        uint32_t ln,                /* line number in the config file, starting from 1 */
+        enum cinic_list_state list, /* used for dealing with lists; see `enum cinic_list_state` */
+        const char *k,              /* section title, record key or list name */
+        const char *v               /* record value or list entry */
+        );
+
+/*
+ * Like Cinic_parse_ex(), but call cb, with ud, on every event; see
+ * cinic_event_cb. This is the interface the language bindings build
+ * on.
+ */
+int Cinic_parse_events(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *path,            /* path to .ini config file */
+        cinic_event_cb cb,
+        void *ud,                    /* passed to cb */
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * Like Cinic_parse_events(), but parse the config held in the LEN
+ * bytes at DATA.
+ */
+int Cinic_parse_buffer_events(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *data,            /* .ini config text */
+        size_t len,                  /* length of data in bytes */
+        cinic_event_cb cb,
+        void *ud,                    /* passed to cb */
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * Check the .ini config file specified by path is valid according to
+ * ctx, and report ALL the errors in it rather than just the first one.
+ *
+ * The parser resynchronizes after each error -- at the next section
+ * title, record, list head or closing list bracket -- so each mistake
+ * is reported once. No callback gets called.
+ *
+ * On return, *diags points to an array of *ndiags diagnostics, in the
+ * order found, which the caller must free(). Returns 0 if the whole
+ * config was checked (*ndiags is then 0 iff it is valid), or -1 if it
+ * could not be read (the last diagnostic says why) or memory ran out.
+ */
+int Cinic_lint(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *path,            /* path to .ini config file */
+        struct cinic_diag **diags,   /* set to the diagnostics found */
+        size_t *ndiags               /* set to the number of diagnostics found */
+        );
+
+/*
+ * Like Cinic_lint(), but check the config held in the LEN bytes at DATA.
+ */
+int Cinic_lint_buffer(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *data,            /* .ini config text */
+        size_t len,                  /* length of data in bytes */
+        struct cinic_diag **diags,   /* set to the diagnostics found */
+        size_t *ndiags               /* set to the number of diagnostics found */
+        );
+
+/*
+ * A parsed config, held in memory and indexed for lookups;
+ * see Cinic_load(). Opaque.
+ */
+struct cinic_doc;
+
+/*
+ * Parse the .ini config file specified by path according to ctx, and
+ * return all of it as a document, for callers that would rather look
+ * values up than be called back for each one.
+ *
+ * Where the same key appears more than once in a section, the last
+ * record or list wins.
+ *
+ * Returns NULL if the config could not be read or is not valid, or
+ * memory ran out; diag, if not NULL, is filled in as for
+ * Cinic_parse_ex(). The document must be freed with Cinic_doc_free().
+ */
+struct cinic_doc *Cinic_load(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *path,            /* path to .ini config file */
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * Like Cinic_load(), but load the config held in the LEN bytes at DATA.
+ */
+struct cinic_doc *Cinic_load_buffer(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *data,            /* .ini config text */
+        size_t len,                  /* length of data in bytes */
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * Load each of the n config files at paths[] as by Cinic_load(), with
+ * up to ctx->threads threads at once (the calling one included), e.g.
+ * to load all of a conf.d directory at startup.
+ *
+ * docs[i] is set to the document of paths[i], or NULL if it could not
+ * be loaded, in which case diags[i], if diags is not NULL, says why.
+ * Returns the number of files that could not be loaded. Each document
+ * must be freed with Cinic_doc_free(), as with Cinic_load(). With
+ * ctx->intern set, the documents share their titles and keys.
+ */
+size_t Cinic_load_many(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *const *paths,    /* paths to .ini config files */
+        size_t n,                    /* number of paths */
+        struct cinic_doc **docs,     /* n documents; set */
+        struct cinic_diag *diags     /* n error details; may be NULL */
+        );
+
+/* What became of a section or entry when reloading; see Cinic_reparse() */
+enum cinic_change_kind{
+    CINIC_ADDED = 0,
+    CINIC_REMOVED,
+    CINIC_MODIFIED      /* a different value, list items or kind of entry */
+};
+
+struct cinic_change{
+    enum cinic_change_kind kind;
+    const char *section;        /* full title; "" for the global section */
+    const char *key;            /* NULL if about the section as a whole */
+};
+
+/*
+ * Bring doc up to date with the LEN bytes at DATA, the new text of the
+ * config it was loaded from, according to ctx (which must be as when
+ * doc was loaded), and report what changed.
+ *
+ * The text is cut into blocks at section titles and each block hashed;
+ * only the sections whose blocks differ from last time are parsed
+ * again, so that reloading a big config after a small edit costs about
+ * as much as hashing it. The first reparse of a document, and any with
+ * ctx->includes set, parses all of the text. Include directives are
+ * relative to the file doc was loaded from by Cinic_load(), as they
+ * were then.
+ *
+ * On return, *changes points to an array of *nchanges changes, which
+ * the caller must free() (the strings it refers to are part of it).
+ * The changes are sorted by section title, then key; the change to a
+ * section itself -- added, removed, or modified if any entry in it
+ * was -- comes before those to its entries. A section is only there
+ * while it has entries, as for
+ * Cinic_has_section(). Returns 0 on success, or -1 if the new text is
+ * not valid or memory ran out, in which case diag, if not NULL, is
+ * filled in as for Cinic_load() and doc is left as it was.
+ *
+ * doc must not be one got from a cache.
+ */
+int Cinic_reparse(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        struct cinic_doc *doc,       /* document to update */
+        const char *data,            /* new .ini config text */
+        size_t len,                  /* length of data in bytes */
+        struct cinic_change **changes,  /* set to the changes found */
+        size_t *nchanges,            /* set to the number of changes found */
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * Free doc and everything it holds. doc may be NULL.
+ */
+void Cinic_doc_free(struct cinic_doc *doc);
+
+/*
+ * Return the value of key in section of doc, or NULL if there is no
+ * such record (lists are only returned by Cinic_get_list()).
+ *
+ * The section is given by its full title e.g. "a.b.c"; NULL or ""
+ * refer to the global records. Lookups take constant time and never
+ * allocate. The string returned lives as long as doc.
+ */
+const char *Cinic_get(const struct cinic_doc *doc, const char *section, const char *key);
+
+/*
+ * Return the items of list key in section of doc, and store their
+ * number in *nitems; or return NULL if there is no such list. An empty
+ * list gives a non-NULL array and *nitems = 0.
+ *
+ * Otherwise as for Cinic_get().
+ */
+const char *const *Cinic_get_list(const struct cinic_doc *doc, const char *section, const char *key, size_t *nitems);
+
+/*
+ * Return true if doc has any records or lists in section, or in any
+ * section nested in it: with the default namespace separator, "a" and
+ * "a.b" are both there if "a.b.c" has entries. NULL or "" refer to the
+ * global section, which is always there.
+ */
+bool Cinic_has_section(const struct cinic_doc *doc, const char *section);
+
+/*
+ * A document compiled to a binary image, mapped into memory and
+ * queried in place; see Cinic_compile(). Opaque.
+ */
+struct cinic_snapshot;
+
+/*
+ * Compile the .ini config file at ini_path, parsed according to ctx,
+ * to a snapshot written to out_path (replacing any file there in one
+ * go), e.g. `foo.ini` to `foo.cinicb`.
+ *
+ * A snapshot holds what Cinic_load() would, laid out so that it can be
+ * used without parsing anything or allocating per entry. It also
+ * records a checksum of the config compiled, and which files and
+ * directories it included (see cinic_ctx.includes); see
+ * Cinic_snapshot_stale(). Snapshots can only be read on machines with
+ * the same byte order as the one that compiled them.
+ *
+ * Returns 0 on success, or -1 on error; diag, if not NULL, is filled
+ * in as for Cinic_parse_ex() (CINIC_IO also covers writing out_path).
+ */
+int Cinic_compile(
+        const struct cinic_ctx *ctx, /* parser configuration; see Cinic_ctx_init() */
+        const char *ini_path,        /* path to .ini config file */
+        const char *out_path,        /* path to write the snapshot to */
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * Map the snapshot at path into memory for querying.
+ *
+ * Returns NULL on error; diag->code is then CINIC_IO if path could not
+ * be read, or CINIC_BAD_SNAPSHOT if it is not a snapshot, it is
+ * damaged, or it was compiled by an incompatible version of the library
+ * or on a machine with a different byte order. The snapshot must be
+ * closed with Cinic_snapshot_close().
+ */
+struct cinic_snapshot *Cinic_snapshot_open(
+        const char *path,            /* path to snapshot */
+        struct cinic_diag *diag      /* error details; may be NULL */
+        );
+
+/*
+ * Unmap snap and free it. snap may be NULL.
+ */
+void Cinic_snapshot_close(struct cinic_snapshot *snap);
+
+/*
+ * Like Cinic_get(), but look the record up in snap. The string returned
+ * lives as long as snap is open.
+ */
+const char *Cinic_snapshot_get(const struct cinic_snapshot *snap, const char *section, const char *key);
+
+/*
+ * Look up list key in section of snap (see Cinic_get() for section).
+ *
+ * Returns false if there is no such list. Otherwise, stores up to
+ * *nitems of its items in items, sets *nitems to the number of items
+ * in the list (which may be more), and returns true.
+ */
+bool Cinic_snapshot_get_list(const struct cinic_snapshot *snap, const char *section, const char *key,
+                             const char **items, size_t *nitems);
+
+/*
+ * Tell whether snap is out of date with respect to the .ini config file
+ * at ini_path, by comparing the checksum of the file with that of the
+ * config snap was compiled from, and by checking none of the files and
+ * directories it included has changed since (by device, inode, size
+ * and modification time, as Cinic_cache_get() does). Included files
+ * are looked for where they were when compiled: a relative ini_path
+ * given to Cinic_compile() makes their paths relative too.
+ *
+ * Returns 0 if the two match, 1 if they do not (snap is stale), or -1
+ * if ini_path could not be read.
+ */
+int Cinic_snapshot_stale(const struct cinic_snapshot *snap, const char *ini_path);
+
+/*
+ * Documents of config files kept around so that files that have not
+ * changed need not be parsed again; see Cinic_cache_new(). Opaque.
+ *
+ * A file is taken to be unchanged if it is still the same file (device
+ * and inode) with the same size and modification time, so a lookup
+ * costs a stat() when the document is cached. A cache can be used from
+ * any number of threads at the same time.
+ */
+struct cinic_cache;
+
+/*
+ * Return a new, empty cache of documents loaded according to ctx (which
+ * is copied), or NULL if out of memory.
+ *
+ * The cache keeps at most max_docs documents, of config files adding up
+ * to at most max_bytes bytes; 0 means no limit. Once over either limit,
+ * the least recently used documents are dropped.
+ */
+struct cinic_cache *Cinic_cache_new(const struct cinic_ctx *ctx, size_t max_docs, size_t max_bytes);
+
+/*
+ * Return the document of the config file at path: the one in cache if
+ * the file has not changed since it was loaded, or else a new one,
+ * loaded as by Cinic_load() and kept in cache.
+ *
+ * Returns NULL if the file could not be read or is not valid, or memory
+ * ran out; diag, if not NULL, is filled in as for Cinic_load(). Each
+ * document returned must be handed back with Cinic_cache_release() --
+ * not Cinic_doc_free() -- once no longer needed. Until then it remains
+ * valid, even if it gets dropped from the cache in the meantime.
+ */
+const struct cinic_doc *Cinic_cache_get(struct cinic_cache *cache, const char *path, struct cinic_diag *diag);
+
+/*
+ * Hand back doc, as returned by Cinic_cache_get() on cache.
+ */
+void Cinic_cache_release(struct cinic_cache *cache, const struct cinic_doc *doc);
+
+/*
+ * Drop the document of the config file at path from cache, so that it
+ * is loaded afresh next time; or drop all of them if path is NULL.
+ * For when a file may have changed without its size or modification
+ * time changing.
+ */
+void Cinic_cache_invalidate(struct cinic_cache *cache, const char *path);
+
+/*
+ * Store in *hits and *misses the number of Cinic_cache_get() calls on
+ * cache that did and did not find the document in it. Either may be
+ * NULL.
+ */
+void Cinic_cache_stats(struct cinic_cache *cache, uint64_t *hits, uint64_t *misses);
+
+/*
+ * Free cache and its documents. cache may be NULL. All the documents
+ * got from cache must have been released first.
+ */
+void Cinic_cache_free(struct cinic_cache *cache);
+
+/*
+ * Document of a config file that is loaded again, on a thread of its
+ * own, whenever the file or any file it includes changes; see
+ * Cinic_watch_new(). Opaque. Linux only, as it relies on inotify(7).
+ *
+ * Readers are never held up by a reload: they keep using the document
+ * they got while the next one is loaded, which then takes its place in
+ * one go. A watcher can be used from any number of threads at the same
+ * time.
+ */
+struct cinic_watch;
+
+/*
+ * Callback called by a watcher after each attempt at reloading its
+ * config: diag->code is CINIC_SUCCESS if the new document is the one
+ * now handed out, or else why the config could not be loaded, in which
+ * case the last good document still is. CINIC_IO, with errnum set, is
+ * also what is reported when the config was loaded but could not be
+ * watched anymore, e.g. while its directory is being replaced; the
+ * watcher then keeps watching what it was. Once the config itself is
+ * no longer watched, reloading is tried again every second until it
+ * is. It is called on the thread of the watcher, so must not call
+ * Cinic_watch_free().
+ */
+typedef
+void (* watch_cb)(
+        void *ud,                       /* user pointer given to Cinic_watch_new() */
+        const struct cinic_diag *diag   /* outcome of the reload */
+        );
+
+/*
+ * Load the config file at path according to ctx (which is copied), as
+ * by Cinic_load(), and return a watcher that loads it again whenever
+ * it or any file or directory it includes changes.
+ *
+ * Saving a file often comes as a burst of changes -- writing, renaming
+ * over the old one, setting its mode -- so a reload only happens once
+ * nothing has changed for debounce_ms milliseconds. cb, if not NULL,
+ * is then called with ud; see watch_cb.
+ *
+ * Returns NULL if the config could not be loaded or watched, or memory
+ * ran out; diag, if not NULL, is filled in as for Cinic_load(), with
+ * CINIC_IO if watching failed (errnum is ENOSYS if not on Linux).
+ */
+struct cinic_watch *Cinic_watch_new(const struct cinic_ctx *ctx, const char *path, unsigned debounce_ms,
+                                    watch_cb cb, void *ud, struct cinic_diag *diag);
+
+/*
+ * Return the latest document w loaded. It must be handed back with
+ * Cinic_watch_release() once no longer needed, and remains valid until
+ * then, however many times the config is reloaded in the meantime. A
+ * reader that wants to see changes gets the document again now and
+ * then, e.g. for each request it handles. Never returns NULL.
+ */
+const struct cinic_doc *Cinic_watch_get(struct cinic_watch *w);
+
+/*
+ * Hand back doc, as returned by Cinic_watch_get() on w.
+ */
+void Cinic_watch_release(struct cinic_watch *w, const struct cinic_doc *doc);
+
+/*
+ * Stop watching and free w along with its documents. w may be NULL.
+ * All the documents got from w must have been released first.
+ */
+void Cinic_watch_free(struct cinic_watch *w);
+
+/*
+ * Region of memory that allocations are made from in turn and that is
+ * only released as a whole; see Cinic_arena_new(). Opaque.
+ *
+ * Arenas suit keeping copies of what the parser hands to a config_cb:
+ * the copies are packed together in a few large blocks rather than
+ * each being malloc-ed, and are all freed by a single call. Documents
+ * (see Cinic_load()) are built the same way.
+ */
+struct cinic_arena;
+
+/*
+ * Return a new, empty arena, or NULL if out of memory.
+ */
+struct cinic_arena *Cinic_arena_new(void);
+
+/*
+ * Return size bytes allocated from arena a, aligned for any type, or
+ * NULL if out of memory. The memory lives until a is freed.
+ */
+void *Cinic_arena_alloc(struct cinic_arena *a, size_t size);
+
+/*
+ * Return a copy of the string s allocated from arena a, or NULL if out
+ * of memory.
+ */
+char *Cinic_arena_strdup(struct cinic_arena *a, const char *s);
+
+/*
+ * Free arena a and everything allocated from it. a may be NULL.
+ */
+void Cinic_arena_free(struct cinic_arena *a);
+
+/*
+ * Table holding a single copy of each distinct string added to it, so
+ * that equal strings are represented by the same pointer; see
+ * Cinic_intern_new(). Opaque.
+ *
+ * Programs that load many configs with the same section titles and
+ * keys can share one table between them (see cinic_ctx.intern) to
+ * hold each title and key once, however many documents use it. A
+ * table can be used from any number of threads at the same time.
+ */
+struct cinic_intern;
+
+/*
+ * Return a new, empty intern table, or NULL if out of memory.
+ */
+struct cinic_intern *Cinic_intern_new(void);
+
+/*
+ * Return the copy of the string s held in intern table t, adding one
+ * first if there is none; or NULL if out of memory. The same pointer
+ * is returned for equal strings, until t is freed.
+ */
+const char *Cinic_intern(struct cinic_intern *t, const char *s);
+
+/*
+ * Free intern table t and all the strings in it. t may be NULL. Any
+ * document loaded using t must be freed first.
+ */
+void Cinic_intern_free(struct cinic_intern *t);
+
+/*
+ * Initialize the parser context ctx.
+ *
+ * The meaning of each parameter is as for Cinic_init(). If list_brackets
+ * is NULL, the default square brackets are used; otherwise it must be
+ * a 2-char string made up of the opening and closing bracket, in
+ * that order.
+ *
+ * Returns 0 on success, or CINIC_BAD_OPTION if section_delim or
+ * list_brackets is not valid, in which case ctx is left untouched.
+ */
+int Cinic_ctx_init(struct cinic_ctx *ctx,
+                   bool allow_globals,
+                   bool allow_empty_lists,
+                   const char *section_delim,
+                   const char *list_brackets
+        );
+
+/*
+ * Return a string describing the error errnum.
+ */
+const char *Cinic_err2str(enum cinic_error errnum);
+
+/*
+ * Initialize the default parser context used by Cinic_parse().
  *
  * These allow customization of the parser as described
- * in the comments.
+ * in the comments. Note this modifies process-wide state and is
+ * therefore not thread-safe; concurrent users should each set up
+ * a struct cinic_ctx and call Cinic_parse_ex() instead.
+ *
+ * Returns 0 on success, or CINIC_BAD_OPTION if section_delim is not
+ * valid, in which case the defaults are left unchanged.
  */
-void Cinic_init(bool allow_globals,       /* consider key-value pairs that appear before any section title legal */
-                bool allow_empty_lists,   /* consider lists without any list items to be legal */
-                const char *section_delim /* char that represents section nesting e.g. a.b.c; see SECTION_NS_SEP in cinic.c */
+int Cinic_init(bool allow_globals,       /* consider key-value pairs that appear before any section title legal */
+               bool allow_empty_lists,   /* consider lists without any list items to be legal */
+               const char *section_delim /* char that represents section nesting e.g. a.b.c; see struct cinic_ctx */
         );
 
 #endif
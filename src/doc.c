@@ -0,0 +1,1426 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cinic.h"
+#include "utils__.h"
+
+/*
+ * In-memory representation of a parsed config (see Cinic_load() and
+ * struct cinic_doc in utils__.h).
+ *
+ * Everything is kept in a handful of large blocks rather than a tree
+ * of individually allocated nodes:
+ *  - all strings (section titles, keys, values, list items) are copied
+ *    back to back into an arena, which is released in one go;
+ *  - records and lists are entries in one array, in the order they
+ *    first appear in the config (until reparsed: see Cinic_reparse());
+ *  - the items of all lists are stored in another array, each list's
+ *    items next to each other;
+ *  - entries are looked up through an open-addressing hash table,
+ *    keyed by (section title, key).
+ *
+ * If the context used to load a document has an intern table, section
+ * titles and keys are taken from it instead of the arena. Entries can
+ * then be told apart by comparing pointers.
+ *
+ * The titles of the sections with entries, and of the namespaces they
+ * are nested in, are kept in a hash set of their own, so that whether
+ * a section (or a namespace) is there can be told without going
+ * through the entries; see Cinic_has_section().
+ */
+
+/*
+ * Grow the array *a of *cap elements of size sz so it can hold at least
+ * n elements. Return 0 on success, or -1 if out of memory; the array is
+ * then left as it was.
+ */
+static int grow(void **a, size_t *cap, size_t sz, size_t n){
+    if (n <= *cap) return 0;
+
+    size_t newcap = *cap ? 2 * *cap : 64;
+    if (newcap < n) newcap = n;
+
+    void *p = realloc(*a, newcap * sz);
+    if (!p) return -1;
+    *a = p;
+    *cap = newcap;
+    return 0;
+}
+
+/* true if the NUL-terminated string a is the len bytes at s */
+static inline bool doc_streq(const char *a, const char *s, size_t len){
+    return (!memcmp(a, s, len) && a[len] == '\0');
+}
+
+/*
+ * Look up the entry for key k in section s. Interned strings compare
+ * equal by pointer; others are compared in full.
+ *
+ * Return the index slot holding it or, if there is no such entry, the
+ * free slot where it would go. The index must have at least one free
+ * slot.
+ */
+static size_t doc_slot(const struct cinic_doc *doc, uint32_t hash,
+                       const char *s, size_t slen, const char *k, size_t klen)
+{
+    size_t mask = doc->index_cap - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask){
+        uint32_t e = doc->index[i];
+        if (!e) return i;
+
+        const struct doc_entry *entry = &doc->entries[e - 1];
+        if (entry->hash != hash) continue;
+        if (entry->key == k && entry->section == s) return i;
+        if (doc_streq(entry->key, k, klen) && doc_streq(entry->section, s, slen)){
+            return i;
+        }
+    }
+}
+
+/*
+ * Double the number of index slots and reinsert all entries.
+ * Return 0 on success, or -1 if out of memory.
+ */
+static int doc_rehash(struct cinic_doc *doc){
+    size_t cap = doc->index_cap ? 2 * doc->index_cap : 64;
+    uint32_t *index = calloc(cap, sizeof(*index));
+    if (!index) return -1;
+
+    free(doc->index);
+    doc->index = index;
+    doc->index_cap = cap;
+
+    for (size_t e = 0; e < doc->nentries; ++e){
+        size_t i = doc->entries[e].hash & (cap - 1);
+        while (index[i]) i = (i + 1) & (cap - 1);
+        index[i] = e + 1;
+    }
+    return 0;
+}
+
+/*
+ * Get the entry for key k in the current section, creating it if it
+ * does not exist yet: a key that appears more than once in a section
+ * is overwritten by the last occurrence. Return NULL if out of memory.
+ */
+static struct doc_entry *doc_entry(struct cinic_doc *doc, const struct cinic_view *k){
+    uint32_t kh = str_hash(k->s, k->len);
+    uint32_t hash = doc_hash(doc->section_hash, kh);
+    const char *key = k->s;
+
+    if (doc->intern && !(key = intern_view(doc->intern, k->s, k->len, kh))){
+        return NULL;
+    }
+
+    /* keep the load factor under 3/4 */
+    if (4 * (doc->nentries + 1) > 3 * doc->index_cap && doc_rehash(doc)){
+        return NULL;
+    }
+
+    size_t slot = doc_slot(doc, hash, doc->section, doc->section_len, key, k->len);
+    if (doc->index[slot]){
+        return &doc->entries[doc->index[slot] - 1];
+    }
+
+    if (grow((void **)&doc->entries, &doc->entries_cap, sizeof(*doc->entries), doc->nentries + 1)){
+        return NULL;
+    }
+    if (!doc->intern && !(key = arena_strndup(doc->strings, k->s, k->len))){
+        return NULL;
+    }
+
+    struct doc_entry *entry = &doc->entries[doc->nentries];
+    memset(entry, 0, sizeof(*entry));
+    entry->hash = hash;
+    entry->section = doc->section;
+    entry->key = key;
+    doc->index[slot] = ++doc->nentries;
+    return entry;
+}
+
+/*
+ * Return the slot of doc->sections holding the title made of the len
+ * bytes at s, whose str_hash() is hash, or else the free slot where it
+ * would go. There must be at least one free slot.
+ */
+static size_t doc_section_slot(const struct cinic_doc *doc, uint32_t hash, const char *s, size_t len){
+    size_t mask = doc->sections_cap - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask){
+        const struct doc_section *sect = &doc->sections[i];
+        if (!sect->title) return i;
+        if (sect->hash == hash && sect->len == len && !memcmp(sect->title, s, len)) return i;
+    }
+}
+
+/*
+ * Make room in the sections of doc for n more titles, keeping the load
+ * factor under 3/4, so that adding them cannot fail. Return 0 on
+ * success, or -1 if out of memory; the sections are then left as they
+ * were.
+ */
+static int doc_sections_reserve(struct cinic_doc *doc, size_t n){
+    if (4 * (doc->nsections + n) <= 3 * doc->sections_cap) return 0;
+
+    size_t cap = doc->sections_cap ? 2 * doc->sections_cap : 64;
+    while (4 * (doc->nsections + n) > 3 * cap) cap *= 2;
+    struct doc_section *sections = calloc(cap, sizeof(*sections));
+    if (!sections) return -1;
+
+    for (size_t i = 0; i < doc->sections_cap; ++i){
+        if (!doc->sections[i].title) continue;
+        size_t j = doc->sections[i].hash & (cap - 1);
+        while (sections[j].title) j = (j + 1) & (cap - 1);
+        sections[j] = doc->sections[i];
+    }
+    free(doc->sections);
+    doc->sections = sections;
+    doc->sections_cap = cap;
+    return 0;
+}
+
+/*
+ * Add the first len bytes of title, whose str_hash() is hash, to the
+ * sections of doc, unless already there. title must outlive doc.
+ * Return 0 on success, or -1 if out of memory.
+ */
+static int doc_section_add(struct cinic_doc *doc, const char *title, size_t len, uint32_t hash){
+    if (doc_sections_reserve(doc, 1)) return -1;
+
+    struct doc_section *sect = &doc->sections[doc_section_slot(doc, hash, title, len)];
+    if (!sect->title){
+        sect->hash = hash;
+        sect->len = len;
+        sect->title = title;
+        ++doc->nsections;
+    }
+    return 0;
+}
+
+/*
+ * Add the current section of doc to its sections, along with all the
+ * namespaces it is nested in, e.g. "a" and "a.b" for "a.b.c". Return 0
+ * on success, or -1 if out of memory.
+ */
+static int doc_section_seen(struct cinic_doc *doc){
+    const char *title = doc->section;
+    uint32_t hash = str_hash(title, 0);
+    size_t from = 0;
+
+    doc->section_seen = true;
+    if (!doc->section_len) return 0;   /* the global section is always there */
+
+    for (size_t i = 0; i < doc->section_len; ++i){
+        if (title[i] != doc->ns_sep) continue;
+        hash = str_hash_more(hash, title + from, i - from);
+        if (doc_section_add(doc, title, i, hash)) return -1;
+        from = i;
+    }
+    return doc_section_add(doc, title, doc->section_len, doc->section_hash);
+}
+
+/*
+ * Parser event sink (see cinic_sink) that adds what is found to the
+ * document ud.
+ */
+static int doc_add(void *ud, enum cinic_event ev, uint32_t ln, enum cinic_list_state list,
+                   const struct cinic_view *k, const struct cinic_view *v)
+{
+    struct cinic_doc *doc = ud;
+    struct doc_entry *entry;
+    const char *str;
+    UNUSED(ln);
+
+    /* for caches to tell whether any of them changed; see cache.c */
+    if ((int)ev == CINIC_EV_INCLUDE){
+        if (grow((void **)&doc->sources, &doc->sources_cap, sizeof(*doc->sources), doc->nsources + 1)) goto nomem;
+        if (!(str = arena_strndup(doc->strings, k->s, k->len))) goto nomem;
+        doc->sources[doc->nsources].path = str;
+        memcpy(&doc->sources[doc->nsources++].id, v->s, sizeof(struct file_id));
+        return 0;
+    }
+
+    /* for Cinic_reparse() to tell whether a block after the last would be nested */
+    if ((int)ev == CINIC_EV_END){
+        doc->list_open = (list != NOLIST);
+        return 0;
+    }
+
+    switch(ev){
+    case CINIC_EV_SECTION:
+        doc->section_hash = str_hash(k->s, k->len);
+        doc->section_len = k->len;
+        str = doc->intern ? intern_view(doc->intern, k->s, k->len, doc->section_hash)
+                          : arena_strndup(doc->strings, k->s, k->len);
+        if (!str) goto nomem;
+        doc->section = str;
+        doc->section_seen = false;
+        break;
+
+    case CINIC_EV_RECORD:
+        if (!doc->section_seen && doc_section_seen(doc)) goto nomem;
+        if (!(entry = doc_entry(doc, k))) goto nomem;
+        if (!(str = arena_strndup(doc->strings, v->s, v->len))) goto nomem;
+        entry->kind = DOC_RECORD;
+        entry->value = str;
+        entry->nitems = 0;
+        break;
+
+    case CINIC_EV_LIST_HEAD:
+        if (!doc->section_seen && doc_section_seen(doc)) goto nomem;
+        if (!(entry = doc_entry(doc, k))) goto nomem;
+        entry->kind = DOC_LIST;
+        entry->value = NULL;
+        entry->first = doc->nitems;
+        entry->nitems = 0;
+        doc->list = entry - doc->entries;
+        break;
+
+    case CINIC_EV_LIST_ITEM:
+        if (grow((void **)&doc->items, &doc->items_cap, sizeof(*doc->items), doc->nitems + 1)) goto nomem;
+        if (!(str = arena_strndup(doc->strings, v->s, v->len))) goto nomem;
+        doc->items[doc->nitems++] = str;
+        doc->entries[doc->list].nitems++;
+        break;
+    }
+    return 0;
+
+nomem:
+    doc->nomem = true;
+    return -1;
+}
+
+/*
+ * Return a new, empty document to be loaded according to ctx from the
+ * file at path (NULL if not from a file), or NULL if out of memory. */
+static struct cinic_doc *doc_new(const struct cinic_ctx *ctx, const char *path){
+    struct cinic_doc *doc = calloc(1, sizeof(*doc));
+    if (!doc) return NULL;
+    if (path && !(doc->path = strdup(path))){
+        free(doc);
+        return NULL;
+    }
+
+    /* records before any section title are in the 'global' section */
+    doc->intern = ctx->intern;
+    doc->ns_sep = ctx->section_ns_sep[0];
+    doc->section = "";
+    doc->section_hash = str_hash("", 0);
+    if (!(doc->strings = Cinic_arena_new()) || doc_rehash(doc)){
+        Cinic_doc_free(doc);
+        return NULL;
+    }
+    return doc;
+}
+
+/*
+ * Finish loading doc, once the parser returned rc. Return doc, or
+ * NULL (with diag filled in) if loading failed.
+ */
+static struct cinic_doc *doc_finish(struct cinic_doc *doc, int rc, struct cinic_diag *diag){
+    if (!rc) return doc;
+
+    if (doc->nomem){
+        diag->code = CINIC_NOMEM;
+    }
+    Cinic_doc_free(doc);
+    return NULL;
+}
+
+/*
+ * Parse the .ini config file found at PATH according to CTX, and
+ * return its contents as a document that can be queried with
+ * Cinic_get() and Cinic_get_list().
+ *
+ * Return NULL on error; see Cinic_parse_ex() for what counts as one.
+ * The details are stored in DIAG, if not NULL. The document must be
+ * released with Cinic_doc_free().
+ *
+ * NOTES:
+ *  - ctx and path must not be NULL; diag may be NULL
+ */
+struct cinic_doc *Cinic_load(const struct cinic_ctx *ctx, const char *path, struct cinic_diag *diag){
+    assert(ctx && path);
+
+    struct cinic_diag dummy;
+    if (!diag) diag = &dummy;
+
+    struct cinic_doc *doc = doc_new(ctx, path);
+    if (!doc){
+        memset(diag, 0, sizeof(*diag));
+        diag->code = CINIC_NOMEM;
+        return NULL;
+    }
+
+    return doc_finish(doc, parse_file_events(ctx, path, doc_add, doc, diag), diag);
+}
+
+/*
+ * Like Cinic_load(), but parse the config held in the LEN bytes at DATA.
+ * The document does not refer to DATA once loaded.
+ *
+ * NOTES:
+ *  - ctx must not be NULL; data may only be NULL if len is 0; diag
+ *    may be NULL
+ */
+struct cinic_doc *Cinic_load_buffer(const struct cinic_ctx *ctx, const char *data, size_t len, struct cinic_diag *diag){
+    return doc_load_buffer(ctx, data, len, NULL, diag);
+}
+
+/*
+ * Like Cinic_load_buffer(), but with DATA read from the file at PATH,
+ * if not NULL, which include directives are then relative to; see
+ * parse_buffer_events().
+ */
+struct cinic_doc *doc_load_buffer(const struct cinic_ctx *ctx, const char *data, size_t len, const char *path,
+                                  struct cinic_diag *diag)
+{
+    assert(ctx && (data || !len));
+
+    struct cinic_diag dummy;
+    if (!diag) diag = &dummy;
+
+    struct cinic_doc *doc = doc_new(ctx, path);
+    if (!doc){
+        memset(diag, 0, sizeof(*diag));
+        diag->code = CINIC_NOMEM;
+        return NULL;
+    }
+
+    return doc_finish(doc, parse_buffer_events(ctx, data, len, path, doc_add, doc, diag), diag);
+}
+
+/*
+ * Loading many files at once; see Cinic_load_many().
+ *
+ * The threads, the calling one included, share a cursor into the list
+ * of files: each takes the next file not yet taken whenever done with
+ * one, so the work balances itself however uneven the files are. Each
+ * has its own copy of the context, with threads set to 0 so that big
+ * files are not split across further threads.
+ */
+struct load_many{
+    struct cinic_ctx ctx;
+    const char *const *paths;
+    size_t n;
+    struct cinic_doc **docs;
+    struct cinic_diag *diags;       /* may be NULL */
+    size_t next;                    /* next file to load */
+    size_t failed;                  /* number of files that could not be */
+    pthread_mutex_t lock;
+};
+
+static void *load_worker(void *arg){
+    struct load_many *lm = arg;
+    struct cinic_ctx ctx = lm->ctx;
+    size_t failed = 0;
+
+    for (;;){
+        pthread_mutex_lock(&lm->lock);
+        size_t i = lm->next < lm->n ? lm->next++ : lm->n;
+        pthread_mutex_unlock(&lm->lock);
+        if (i == lm->n) break;
+
+        lm->docs[i] = Cinic_load(&ctx, lm->paths[i], lm->diags ? &lm->diags[i] : NULL);
+        failed += !lm->docs[i];
+    }
+
+    pthread_mutex_lock(&lm->lock);
+    lm->failed += failed;
+    pthread_mutex_unlock(&lm->lock);
+    return NULL;
+}
+
+/*
+ * Load each of the N config files at PATHS as by Cinic_load(), with
+ * up to CTX->threads threads at once, into DOCS; see cinic.h.
+ *
+ * Return the number of files that could not be loaded.
+ *
+ * NOTES:
+ *  - ctx, paths and docs must not be NULL, nor any of paths[]; diags
+ *    may be NULL
+ */
+size_t Cinic_load_many(const struct cinic_ctx *ctx, const char *const *paths, size_t n,
+                       struct cinic_doc **docs, struct cinic_diag *diags)
+{
+    assert(ctx && paths && docs);
+
+    struct load_many lm = {
+        .ctx = *ctx,
+        .paths = paths,
+        .n = n,
+        .docs = docs,
+        .diags = diags
+    };
+    lm.ctx.threads = 0;
+    if (pthread_mutex_init(&lm.lock, NULL)){
+        for (size_t i = 0; i < n; ++i){
+            docs[i] = Cinic_load(&lm.ctx, paths[i], diags ? &diags[i] : NULL);
+            lm.failed += !docs[i];
+        }
+        return lm.failed;
+    }
+
+    /* no more threads than files; the calling thread is one of them */
+    size_t nthreads = ctx->threads > 1 ? ctx->threads : 1;
+    if (nthreads > n) nthreads = n ? n : 1;
+    pthread_t *tids = nthreads > 1 ? calloc(nthreads - 1, sizeof(*tids)) : NULL;
+
+    size_t started = 0;
+    while (tids && started < nthreads - 1 && !pthread_create(&tids[started], NULL, load_worker, &lm)){
+        ++started;
+    }
+    load_worker(&lm);
+    for (size_t i = 0; i < started; ++i){
+        pthread_join(tids[i], NULL);
+    }
+
+    free(tids);
+    pthread_mutex_destroy(&lm.lock);
+    return lm.failed;
+}
+
+/*
+ * Release all memory held by doc, but not doc itself. */
+static void doc_release(struct cinic_doc *doc){
+    Cinic_arena_free(doc->strings);
+    free(doc->entries);
+    free(doc->items);
+    free(doc->index);
+    free(doc->sections);
+    free(doc->sources);
+    free(doc->parts);
+    free(doc->path);
+}
+
+/*
+ * Release all memory held by doc. doc may be NULL. */
+void Cinic_doc_free(struct cinic_doc *doc){
+    if (!doc) return;
+    doc_release(doc);
+    free(doc);
+}
+
+/*
+ * Return the entry for key in section of doc, or NULL if there is no
+ * such entry. A NULL section stands for the global section. */
+static const struct doc_entry *doc_lookup(const struct cinic_doc *doc, const char *section, const char *key){
+    assert(doc && key);
+
+    if (!section) section = "";
+    size_t slen = strlen(section), klen = strlen(key);
+    uint32_t hash = doc_hash(str_hash(section, slen), str_hash(key, klen));
+    uint32_t e = doc->index[doc_slot(doc, hash, section, slen, key, klen)];
+
+    return e ? &doc->entries[e - 1] : NULL;
+}
+
+/*
+ * Return the value of the record key in section of doc, or NULL if
+ * there is no such record (or it is a list).
+ *
+ * The section title is given whole, e.g. "a.b.c"; NULL or "" stands
+ * for the global section. The string returned belongs to doc.
+ */
+const char *Cinic_get(const struct cinic_doc *doc, const char *section, const char *key){
+    const struct doc_entry *entry = doc_lookup(doc, section, key);
+    if (!entry || entry->kind != DOC_RECORD) return NULL;
+    return entry->value;
+}
+
+/*
+ * Return the items of the list key in section of doc, in order, and
+ * store their number in *nitems; or return NULL if there is no such
+ * list (or it is a record). An empty list is not NULL.
+ *
+ * See Cinic_get() for section. The array returned belongs to doc.
+ */
+const char *const *Cinic_get_list(const struct cinic_doc *doc, const char *section, const char *key, size_t *nitems){
+    assert(nitems);
+
+    const struct doc_entry *entry = doc_lookup(doc, section, key);
+    if (!entry || entry->kind != DOC_LIST) return NULL;
+
+    /* an empty list gets a valid (if unused) pointer, even with no items at all */
+    static const char *const none[1];
+    *nitems = entry->nitems;
+    return entry->nitems ? doc->items + entry->first : none;
+}
+
+/*
+ * Return true if doc has records or lists in section, or in a section
+ * nested in it; see cinic.h. */
+bool Cinic_has_section(const struct cinic_doc *doc, const char *section){
+    assert(doc);
+
+    if (!section || !*section) return true;
+    if (!doc->nsections) return false;
+
+    size_t len = strlen(section);
+    return doc->sections[doc_section_slot(doc, str_hash(section, len), section, len)].title != NULL;
+}
+
+
+/*
+ * Reloading a document in place; see Cinic_reparse().
+ *
+ * The new text is cut into blocks at section title lines -- the first
+ * block being whatever comes before the first title -- and the blocks
+ * under each title are hashed together, to be compared with the hash
+ * of the same section last time (see struct doc_part). Only the blocks
+ * of the sections that differ are parsed, into a scratch document that
+ * shares the arena of doc for its strings. Its entries are compared
+ * with those of the same sections in doc, and doc is patched to match:
+ * entries modified are updated in place, those added are appended, and
+ * those removed are replaced with the last entry.
+ *
+ * A block only depends on those before it through the list it may
+ * leave open, which makes the title starting the next block an error.
+ * Each block parsed is parsed along with the next title line, so that
+ * this is caught; the others cannot leave a list open, unless the text
+ * last ended inside one (see doc->list_open), since the title of the
+ * block after them would have been an error then.
+ *
+ * Strings no longer used stay in the arena, as do list items in
+ * doc->items. Once they add up to more than the text (see doc->stale),
+ * or on the first reparse of a document, or with includes, or if its
+ * text ended inside a list, the whole text is parsed into a new
+ * document instead, which is compared with doc and then takes its
+ * place.
+ */
+
+/* what every text_hash() starts from */
+#define TEXT_HASH_SEED 14695981039346656037ULL
+
+/*
+ * Carry on working out the hash of some text: h is the hash of what
+ * came before the len bytes at s. Unlike str_hash(), eight bytes are
+ * taken at a time, since all of a config is hashed on every reparse.
+ */
+static uint64_t text_hash(uint64_t h, const char *s, size_t len){
+    uint64_t w;
+
+    for (; len >= 8; s += 8, len -= 8){
+        memcpy(&w, s, 8);
+        h = (h ^ w) * 1099511628211ULL;
+        h ^= h >> 32;
+    }
+    w = 0;
+    if (len) memcpy(&w, s, len);
+    h = (h ^ w) * 1099511628211ULL;
+    h ^= h >> 32;
+    return (h ^ len) * 1099511628211ULL;
+}
+
+/*
+ * Return the slot of doc->parts holding the title made of the len bytes
+ * at s, whose str_hash() is hash, or else the free slot where it would
+ * go. There must be at least one free slot.
+ */
+static size_t doc_part_slot(const struct cinic_doc *doc, uint32_t hash, const char *s, size_t len){
+    size_t mask = doc->parts_cap - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask){
+        const struct doc_part *part = &doc->parts[i];
+        if (!part->title) return i;
+        if (part->hash == hash && part->len == len && !memcmp(part->title, s, len)) return i;
+    }
+}
+
+/* What became of a part in the new text */
+enum part_state{
+    PART_GONE = 0,
+    PART_SAME,
+    PART_CHANGED
+};
+
+/* A run of lines of the new text, from a section title on */
+struct text_block{
+    size_t off, len;        /* of the text of the block */
+    size_t head;            /* length of its title line; 0 for the first block */
+    uint32_t ln;            /* line number of its first line */
+    size_t part;            /* slot + 1 of its part in doc->parts, or 0 */
+    size_t title;           /* index in reparse.titles, if not in a part */
+};
+
+/* A section whose entries are compared: one that changed, or any of
+ * them on a full reparse */
+struct reparse_title{
+    const char *s;          /* not NUL-terminated if from the new text */
+    uint32_t len;
+    uint32_t hash;          /* str_hash() of s */
+    size_t part;            /* slot + 1 of its part in doc->parts, or 0 */
+    bool in_text;           /* there are blocks under it in the new text */
+    uint64_t sig;           /* text_hash() of those blocks */
+    size_t old_entries;     /* number of entries in it, in doc */
+    size_t new_entries;     /* number of entries in it, in the new text */
+    const char *kept;       /* title of one of the latter */
+    size_t nchanges;        /* number of its entries that changed */
+    const char *copy;       /* see reparse_report() */
+};
+
+/* A changed entry */
+struct reparse_change{
+    enum cinic_change_kind kind;
+    size_t title;                   /* index in reparse.titles */
+    size_t old;                     /* index in doc->entries, unless added */
+    const struct doc_entry *entry;  /* in the fresh document, unless removed */
+};
+
+struct reparse{
+    const struct cinic_ctx *ctx;
+    struct cinic_doc *doc;
+    struct cinic_doc *fresh;        /* scratch or new document */
+    bool full;                      /* fresh is a new document */
+
+    uint8_t *seen;                  /* enum part_state of each slot of doc->parts */
+    uint64_t *sigs;                 /* text_hash() of the blocks of each part seen */
+    size_t nseen;
+
+    struct reparse_title *titles;
+    size_t ntitles, titles_cap;
+    uint32_t *slots;                /* title index + 1 for each used slot, 0 for free ones */
+    size_t slots_cap;               /* number of slots; always a power of 2 */
+    size_t nadded;                  /* number of titles with no part */
+    size_t nremoved;                /* number of parts not in the new text */
+
+    struct text_block *blocks;
+    size_t nblocks, blocks_cap;
+    bool list_open;                 /* the new text ends inside a list */
+
+    struct reparse_change *changes;
+    size_t nchanges, changes_cap;
+    size_t added;                   /* number of entries added */
+    size_t waste;                   /* bytes of strings of the fresh document not used */
+
+    const char *last;               /* see entry_title() */
+    size_t last_title;
+};
+
+/*
+ * Return the index in r->titles of the title made of the len bytes at
+ * s, whose str_hash() is hash, or SIZE_MAX if it is not there.
+ */
+static size_t reparse_find(const struct reparse *r, const char *s, size_t len, uint32_t hash){
+    if (!r->slots_cap) return SIZE_MAX;
+
+    size_t mask = r->slots_cap - 1;
+    for (size_t i = hash & mask; r->slots[i]; i = (i + 1) & mask){
+        const struct reparse_title *rt = &r->titles[r->slots[i] - 1];
+        if (rt->hash == hash && rt->len == len && !memcmp(rt->s, s, len)) return r->slots[i] - 1;
+    }
+    return SIZE_MAX;
+}
+
+/*
+ * Add the title made of the len bytes at s, whose str_hash() is hash,
+ * to r->titles; it must not be there yet, and s must outlive r. Return
+ * its index, or SIZE_MAX if out of memory.
+ */
+static size_t reparse_add(struct reparse *r, const char *s, size_t len, uint32_t hash){
+    /* keep the load factor under 3/4 */
+    if (4 * (r->ntitles + 1) > 3 * r->slots_cap){
+        size_t cap = r->slots_cap ? 2 * r->slots_cap : 64;
+        uint32_t *slots = calloc(cap, sizeof(*slots));
+        if (!slots) return SIZE_MAX;
+
+        for (size_t t = 0; t < r->ntitles; ++t){
+            size_t i = r->titles[t].hash & (cap - 1);
+            while (slots[i]) i = (i + 1) & (cap - 1);
+            slots[i] = t + 1;
+        }
+        free(r->slots);
+        r->slots = slots;
+        r->slots_cap = cap;
+    }
+    if (grow((void **)&r->titles, &r->titles_cap, sizeof(*r->titles), r->ntitles + 1)){
+        return SIZE_MAX;
+    }
+
+    size_t mask = r->slots_cap - 1, i = hash & mask;
+    while (r->slots[i]) i = (i + 1) & mask;
+    r->slots[i] = r->ntitles + 1;
+
+    struct reparse_title *rt = &r->titles[r->ntitles];
+    memset(rt, 0, sizeof(*rt));
+    rt->s = s;
+    rt->len = len;
+    rt->hash = hash;
+    return r->ntitles++;
+}
+
+/* Like reparse_add(), but return the title already there, if any */
+static size_t reparse_title(struct reparse *r, const char *s, size_t len, uint32_t hash){
+    size_t t = reparse_find(r, s, len, hash);
+    return t != SIZE_MAX ? t : reparse_add(r, s, len, hash);
+}
+
+/*
+ * Return the index in r->titles of section, the title of an entry, or
+ * SIZE_MAX if it is not there. On a full reparse all of them are, so
+ * titles are added as found, and SIZE_MAX means out of memory. Entries
+ * of the same section mostly come one after the other and share the
+ * same copy of its title, which is only looked up once.
+ */
+static size_t entry_title(struct reparse *r, const char *section){
+    if (section != r->last){
+        size_t len = strlen(section);
+        uint32_t hash = str_hash(section, len);
+
+        r->last_title = r->full ? reparse_title(r, section, len, hash) : reparse_find(r, section, len, hash);
+        r->last = (r->last_title == SIZE_MAX && r->full) ? NULL : section;
+    }
+    return r->last_title;
+}
+
+/*
+ * Return true if the len-byte line at line is a section title, storing
+ * the title in *title. Only lines whose first non-blank character is a
+ * '[' are lexed, and lines too long are not titles, as for
+ * is_split_line() in cinic.c.
+ */
+static bool is_title_line(const struct cinic_ctx *ctx, const char *line, size_t len, struct cinic_view *title){
+    struct cinic_lexeme lx;
+    size_t i = 0;
+
+    while (i < len && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r' || line[i] == '\v' || line[i] == '\f')){
+        ++i;
+    }
+    if (i == len || line[i] != '[') return false;
+    if (ctx->max_line_len && len > ctx->max_line_len) return false;
+
+    lex_line(ctx, line, len, &lx);
+    if (lx.type != LEX_SECTION) return false;
+    *title = lx.k;
+    return true;
+}
+
+/*
+ * Add a block starting at offset off of the new text, on line ln, with
+ * a head-byte title line naming title. Return 0, or -1 if out of memory.
+ */
+static int reparse_block(struct reparse *r, size_t off, size_t head, uint32_t ln, const struct cinic_view *title){
+    const struct cinic_doc *doc = r->doc;
+    uint32_t hash = str_hash(title->s, title->len);
+
+    if (grow((void **)&r->blocks, &r->blocks_cap, sizeof(*r->blocks), r->nblocks + 1)) return -1;
+    struct text_block *blk = &r->blocks[r->nblocks];
+    blk->off = off;
+    blk->len = 0;
+    blk->head = head;
+    blk->ln = ln;
+    blk->part = 0;
+
+    if (!r->full){
+        size_t slot = doc_part_slot(doc, hash, title->s, title->len);
+        if (doc->parts[slot].title) blk->part = slot + 1;
+    }
+    if (!blk->part && (blk->title = reparse_title(r, title->s, title->len, hash)) == SIZE_MAX){
+        return -1;
+    }
+    r->nblocks++;
+    return 0;
+}
+
+/*
+ * Cut the LEN bytes at DATA into blocks, and hash the blocks under each
+ * title. Unless reparsing all of it, find the parts of doc that changed
+ * or are gone, and add their titles to r->titles, along with those of
+ * the sections new to the text. Return 0, or -1 if out of memory.
+ */
+static int reparse_split(struct reparse *r, const char *data, size_t len){
+    const struct cinic_doc *doc = r->doc;
+    struct cinic_view title = { "", 0 };
+    uint32_t ln = 1;
+
+    if (!r->full){
+        r->seen = calloc(doc->parts_cap, sizeof(*r->seen));
+        r->sigs = malloc(doc->parts_cap * sizeof(*r->sigs));
+        if (!r->seen || !r->sigs) return -1;
+    }
+
+    if (reparse_block(r, 0, 0, ln, &title)) return -1;
+    for (size_t off = 0; off < len; ++ln){
+        const char *eol = memchr(data + off, '\n', len - off);
+        size_t n = eol ? (size_t)(eol - (data + off)) + 1 : len - off;
+
+        if (is_title_line(r->ctx, data + off, n, &title)){
+            r->blocks[r->nblocks - 1].len = off - r->blocks[r->nblocks - 1].off;
+            if (reparse_block(r, off, n, ln, &title)) return -1;
+        }
+        off += n;
+    }
+    r->blocks[r->nblocks - 1].len = len - r->blocks[r->nblocks - 1].off;
+
+    for (size_t b = 0; b < r->nblocks; ++b){
+        const struct text_block *blk = &r->blocks[b];
+        uint64_t *sig;
+
+        if (blk->part){
+            size_t i = blk->part - 1;
+            if (!r->seen[i]){
+                r->seen[i] = PART_SAME;
+                r->sigs[i] = TEXT_HASH_SEED;
+                r->nseen++;
+            }
+            sig = &r->sigs[i];
+        }else{
+            struct reparse_title *rt = &r->titles[blk->title];
+            if (!rt->in_text){
+                rt->in_text = true;
+                rt->sig = TEXT_HASH_SEED;
+            }
+            sig = &rt->sig;
+        }
+        *sig = text_hash(*sig, data + blk->off, blk->len);
+    }
+    if (r->full) return 0;
+
+    /* so far, only the titles of sections new to the text */
+    r->nadded = r->ntitles;
+
+    for (size_t b = 0; b < r->nblocks; ++b){
+        size_t i = r->blocks[b].part - 1;
+        if (!r->blocks[b].part || r->seen[i] != PART_SAME || r->sigs[i] == doc->parts[i].sig) continue;
+
+        size_t t = reparse_add(r, doc->parts[i].title, doc->parts[i].len, doc->parts[i].hash);
+        if (t == SIZE_MAX) return -1;
+        r->seen[i] = PART_CHANGED;
+        r->titles[t].part = i + 1;
+        r->titles[t].in_text = true;
+        r->titles[t].sig = r->sigs[i];
+    }
+
+    for (size_t i = 0; r->nseen < doc->nparts && i < doc->parts_cap; ++i){
+        if (!doc->parts[i].title || r->seen[i]) continue;
+
+        size_t t = reparse_add(r, doc->parts[i].title, doc->parts[i].len, doc->parts[i].hash);
+        if (t == SIZE_MAX) return -1;
+        r->titles[t].part = i + 1;
+        r->nremoved++;
+    }
+    return 0;
+}
+
+/*
+ * Fill in diag after the parser returned non-zero while loading doc,
+ * with the lines of the text parsed starting on line ln. Return -1.
+ */
+static int reparse_error(const struct cinic_doc *doc, uint32_t ln, struct cinic_diag *diag){
+    if (doc->nomem){
+        memset(diag, 0, sizeof(*diag));
+        diag->code = CINIC_NOMEM;
+    }else if (diag->ln){
+        diag->ln += ln - 1;
+    }
+    return -1;
+}
+
+/*
+ * Parse the blocks of the changed sections of the new text at DATA into
+ * a scratch document. Each block is parsed along with the title line of
+ * the block after it, so that a list left open is caught as it would be
+ * when parsing the whole text; one left open by the last block is
+ * noted in r->list_open. Return 0, or -1 with diag filled in.
+ */
+static int reparse_blocks(struct reparse *r, const char *data, struct cinic_diag *diag){
+    struct cinic_doc *fresh = r->fresh = doc_new(r->ctx, NULL);
+    if (!fresh) return -1;
+    Cinic_arena_free(fresh->strings);
+    fresh->strings = r->doc->strings;
+
+    for (size_t b = 0; b < r->nblocks; ++b){
+        const struct text_block *blk = &r->blocks[b];
+        size_t len = blk->len + (b + 1 < r->nblocks ? r->blocks[b + 1].head : 0);
+
+        if (!blk->len || (blk->part && r->seen[blk->part - 1] != PART_CHANGED)) continue;
+        if (parse_buffer_events(r->ctx, data + blk->off, len, NULL, doc_add, fresh, diag)){
+            return reparse_error(fresh, blk->ln, diag);
+        }
+        if (b + 1 == r->nblocks) r->list_open = fresh->list_open;
+    }
+    return 0;
+}
+
+/*
+ * Parse all of the LEN bytes at DATA into a new document. Return 0, or
+ * -1 with diag filled in.
+ */
+static int reparse_all(struct reparse *r, const char *data, size_t len, struct cinic_diag *diag){
+    struct cinic_doc *fresh = r->fresh = doc_new(r->ctx, NULL);
+    if (!fresh) return -1;
+
+    /* include directives are relative to the file doc was loaded from */
+    if (parse_buffer_events(r->ctx, data, len, r->doc->path, doc_add, fresh, diag)){
+        return reparse_error(fresh, 1, diag);
+    }
+    return 0;
+}
+
+/* true if entry x of a has the same contents as entry y of b */
+static bool entry_same(const struct cinic_doc *a, const struct doc_entry *x,
+                       const struct cinic_doc *b, const struct doc_entry *y)
+{
+    if (x->kind != y->kind) return false;
+    if (x->kind == DOC_RECORD) return !strcmp(x->value, y->value);
+    if (x->nitems != y->nitems) return false;
+
+    for (size_t i = 0; i < x->nitems; ++i){
+        if (strcmp(a->items[x->first + i], b->items[y->first + i])) return false;
+    }
+    return true;
+}
+
+/* Return the entry of doc with the same section and key as x, from
+ * another document, or NULL if there is none */
+static const struct doc_entry *entry_match(const struct cinic_doc *doc, const struct doc_entry *x){
+    size_t slot = doc_slot(doc, x->hash, x->section, strlen(x->section), x->key, strlen(x->key));
+    return doc->index[slot] ? &doc->entries[doc->index[slot] - 1] : NULL;
+}
+
+/* Return about how many bytes entry x of doc takes up in doc */
+static size_t entry_size(const struct cinic_doc *doc, const struct doc_entry *x){
+    size_t size = doc->intern ? 0 : strlen(x->key) + 1;
+
+    if (x->kind == DOC_RECORD) return size + strlen(x->value) + 1;
+    for (size_t i = 0; i < x->nitems; ++i){
+        size += sizeof(*doc->items) + strlen(doc->items[x->first + i]) + 1;
+    }
+    return size;
+}
+
+/*
+ * Note that an entry of section r->titles[t] changed, as kind says:
+ * entry old of doc and entry y of the fresh document are the entry
+ * before and after. Return 0, or -1 if out of memory.
+ */
+static int reparse_change(struct reparse *r, enum cinic_change_kind kind, size_t t, size_t old, const struct doc_entry *y){
+    if (grow((void **)&r->changes, &r->changes_cap, sizeof(*r->changes), r->nchanges + 1)) return -1;
+
+    struct reparse_change *c = &r->changes[r->nchanges++];
+    c->kind = kind;
+    c->title = t;
+    c->old = old;
+    c->entry = y;
+    r->titles[t].nchanges++;
+    r->added += (kind == CINIC_ADDED);
+    return 0;
+}
+
+/*
+ * Compare the entries of the sections in r->titles in doc and in the
+ * fresh document. Return 0, or -1 if out of memory.
+ */
+static int reparse_diff(struct reparse *r){
+    const struct cinic_doc *doc = r->doc, *fresh = r->fresh;
+
+    for (size_t e = 0; e < doc->nentries; ++e){
+        const struct doc_entry *x = &doc->entries[e];
+        size_t t = entry_title(r, x->section);
+        if (t == SIZE_MAX){
+            if (r->full) return -1;
+            continue;
+        }
+
+        r->titles[t].old_entries++;
+        const struct doc_entry *y = entry_match(fresh, x);
+        if (!y){
+            if (reparse_change(r, CINIC_REMOVED, t, e, NULL)) return -1;
+        }else if (!entry_same(doc, x, fresh, y)){
+            if (reparse_change(r, CINIC_MODIFIED, t, e, y)) return -1;
+        }else{
+            r->waste += entry_size(fresh, y);
+        }
+    }
+
+    for (size_t e = 0; e < fresh->nentries; ++e){
+        const struct doc_entry *y = &fresh->entries[e];
+        size_t t = entry_title(r, y->section);
+        if (t == SIZE_MAX) return -1;   /* only ever from sections changed */
+
+        r->titles[t].new_entries++;
+        r->titles[t].kept = y->section;
+        if (!entry_match(doc, y) && reparse_change(r, CINIC_ADDED, t, SIZE_MAX, y)) return -1;
+    }
+    return 0;
+}
+
+/* Return what became of section rt as a whole, or -1 if nothing did */
+static int section_change(const struct reparse_title *rt){
+    if (!rt->old_entries) return rt->new_entries ? CINIC_ADDED : -1;
+    if (!rt->new_entries) return CINIC_REMOVED;
+    return rt->nchanges ? CINIC_MODIFIED : -1;
+}
+
+/* qsort() comparator: by section title, then key, sections first */
+static int compare_changes(const void *a, const void *b){
+    const struct cinic_change *x = a, *y = b;
+    int rc = strcmp(x->section, y->section);
+    if (rc || x->key == y->key) return rc;
+    if (!x->key || !y->key) return x->key ? 1 : -1;
+    return strcmp(x->key, y->key);
+}
+
+/*
+ * Set *changes to the changes found, in a single block of memory along
+ * with the strings they refer to, and *n to their number; see
+ * Cinic_reparse(). Return 0, or -1 if out of memory.
+ */
+static int reparse_report(struct reparse *r, struct cinic_change **changes, size_t *n){
+    const struct cinic_doc *doc = r->doc;
+    size_t count = r->nchanges, size = 0;
+
+    for (size_t t = 0; t < r->ntitles; ++t){
+        const struct reparse_title *rt = &r->titles[t];
+        int kind = section_change(rt);
+        if (kind < 0 && !rt->nchanges) continue;
+        count += (kind >= 0);
+        size += rt->len + 1;
+    }
+    if (!count) return 0;
+    for (size_t c = 0; c < r->nchanges; ++c){
+        const struct reparse_change *rc = &r->changes[c];
+        size += strlen(rc->entry ? rc->entry->key : doc->entries[rc->old].key) + 1;
+    }
+
+    struct cinic_change *out = malloc(count * sizeof(*out) + size);
+    if (!out) return -1;
+    char *str = (char *)(out + count);
+    size_t pos = 0;
+
+    for (size_t t = 0; t < r->ntitles; ++t){
+        struct reparse_title *rt = &r->titles[t];
+        int kind = section_change(rt);
+        if (kind < 0 && !rt->nchanges) continue;
+
+        memcpy(str, rt->s, rt->len);
+        str[rt->len] = '\0';
+        rt->copy = str;
+        str += rt->len + 1;
+        if (kind >= 0){
+            out[pos].kind = kind;
+            out[pos].section = rt->copy;
+            out[pos++].key = NULL;
+        }
+    }
+
+    for (size_t c = 0; c < r->nchanges; ++c){
+        const struct reparse_change *rc = &r->changes[c];
+        const char *key = rc->entry ? rc->entry->key : doc->entries[rc->old].key;
+        size_t len = strlen(key);
+
+        memcpy(str, key, len + 1);
+        out[pos].kind = rc->kind;
+        out[pos].section = r->titles[rc->title].copy;
+        out[pos++].key = str;
+        str += len + 1;
+    }
+
+    qsort(out, count, sizeof(*out), compare_changes);
+    *changes = out;
+    *n = count;
+    return 0;
+}
+
+/* Return a copy of title rt kept by doc, or NULL if out of memory */
+static const char *title_dup(struct cinic_doc *doc, const struct reparse_title *rt){
+    return doc->intern ? intern_view(doc->intern, rt->s, rt->len, rt->hash)
+                       : arena_strndup(doc->strings, rt->s, rt->len);
+}
+
+/* Put part in the first free slot for it in the cap slots of parts */
+static void part_put(struct doc_part *parts, size_t cap, const struct doc_part *part){
+    size_t i = part->hash & (cap - 1);
+    while (parts[i].title) i = (i + 1) & (cap - 1);
+    parts[i] = *part;
+}
+
+/*
+ * Return a new set of the parts of the new text, with the titles of
+ * those that are new kept by owner, and store its number of parts and
+ * of slots in *n and *cap. Return NULL if out of memory.
+ */
+static struct doc_part *reparse_parts(struct reparse *r, struct cinic_doc *owner, size_t *n, size_t *cap){
+    const struct cinic_doc *doc = r->doc;
+    size_t count = r->full ? 0 : doc->nparts - r->nremoved;
+
+    for (size_t t = 0; t < r->ntitles; ++t){
+        count += (r->titles[t].in_text && !r->titles[t].part);
+    }
+    *n = count;
+    *cap = 64;
+    while (4 * (count + 1) > 3 * *cap) *cap *= 2;
+
+    struct doc_part *parts = calloc(*cap, sizeof(*parts));
+    if (!parts) return NULL;
+
+    for (size_t i = 0; !r->full && i < doc->parts_cap; ++i){
+        if (!doc->parts[i].title || r->seen[i] == PART_GONE) continue;
+        struct doc_part part = doc->parts[i];
+        part.sig = r->sigs[i];
+        part_put(parts, *cap, &part);
+    }
+    for (size_t t = 0; t < r->ntitles; ++t){
+        const struct reparse_title *rt = &r->titles[t];
+        if (!rt->in_text || rt->part) continue;
+
+        struct doc_part part = { .sig = rt->sig, .hash = rt->hash, .len = rt->len, .title = title_dup(owner, rt) };
+        if (!part.title){
+            free(parts);
+            return NULL;
+        }
+        part_put(parts, *cap, &part);
+    }
+    return parts;
+}
+
+/* Make entry x of doc the same as entry y of the fresh document;
+ * there must be room in doc->items for its items */
+static void entry_set(struct cinic_doc *doc, struct doc_entry *x, const struct cinic_doc *fresh, const struct doc_entry *y){
+    x->kind = y->kind;
+    x->value = y->value;
+    x->first = doc->nitems;
+    x->nitems = y->nitems;
+    if (y->nitems){
+        memcpy(doc->items + doc->nitems, fresh->items + y->first, y->nitems * sizeof(*doc->items));
+        doc->nitems += y->nitems;
+    }
+}
+
+/* Return the index slot of entry e of doc */
+static size_t entry_slot(const struct cinic_doc *doc, size_t e){
+    size_t mask = doc->index_cap - 1, i = doc->entries[e].hash & mask;
+    while (doc->index[i] != e + 1) i = (i + 1) & mask;
+    return i;
+}
+
+/*
+ * Remove entry e of doc, moving the last entry in its place. Entries
+ * that probed past the index slot freed are shifted back into it, so
+ * that lookups still find them.
+ */
+static void entry_remove(struct cinic_doc *doc, size_t e){
+    size_t mask = doc->index_cap - 1, last = doc->nentries - 1;
+    size_t i = entry_slot(doc, e);
+
+    for (size_t j = (i + 1) & mask; doc->index[j]; j = (j + 1) & mask){
+        size_t home = doc->entries[doc->index[j] - 1].hash & mask;
+        /* leave those whose own slot is (cyclically) in (i, j] */
+        if (i < j ? (home > i && home <= j) : (home > i || home <= j)) continue;
+        doc->index[i] = doc->index[j];
+        i = j;
+    }
+    doc->index[i] = 0;
+
+    if (e != last){
+        doc->index[entry_slot(doc, last)] = e + 1;
+        doc->entries[e] = doc->entries[last];
+    }
+    doc->nentries--;
+}
+
+/*
+ * Add the len-byte title, whose str_hash() is hash, and the namespaces
+ * it is nested in, to the sections of doc; see doc_section_seen().
+ * Return 0, or -1 if out of memory.
+ */
+static int section_seen(struct cinic_doc *doc, const char *title, size_t len, uint32_t hash){
+    doc->section = title;
+    doc->section_len = len;
+    doc->section_hash = hash;
+    return doc_section_seen(doc);
+}
+
+/*
+ * Patch doc to match the entries of the sections changed, and update
+ * its parts. Room is made for everything first: doc is left as it was
+ * unless this succeeds. Return 0, or -1 if out of memory.
+ */
+static int reparse_merge(struct reparse *r){
+    struct cinic_doc *doc = r->doc;
+    const struct cinic_doc *fresh = r->fresh;
+    struct cinic_doc sections = { .ns_sep = doc->ns_sep };     /* only its sections are used */
+    struct doc_part *parts = NULL;
+    size_t nparts = 0, parts_cap = 0;
+    bool rebuild = false;       /* some section has no entries left */
+    size_t gained = 0;          /* most sections added, namespaces included */
+
+    for (size_t t = 0; t < r->ntitles; ++t){
+        const struct reparse_title *rt = &r->titles[t];
+        rebuild = rebuild || (rt->old_entries && !rt->new_entries);
+        if (rt->old_entries || !rt->new_entries) continue;
+        for (size_t i = 0; i < rt->len; ++i) gained += (rt->s[i] == doc->ns_sep);
+        gained++;
+    }
+
+    if ((r->nadded || r->nremoved) && !(parts = reparse_parts(r, doc, &nparts, &parts_cap))) goto nomem;
+    while (4 * (doc->nentries + r->added + 1) > 3 * doc->index_cap){
+        if (doc_rehash(doc)) goto nomem;
+    }
+    if (grow((void **)&doc->entries, &doc->entries_cap, sizeof(*doc->entries), doc->nentries + r->added)) goto nomem;
+    if (grow((void **)&doc->items, &doc->items_cap, sizeof(*doc->items), doc->nitems + fresh->nitems)) goto nomem;
+
+    if (rebuild){
+        /* the sections of entries kept, then those of entries added */
+        const char *prev = NULL;
+        for (size_t e = 0; e < doc->nentries; ++e){
+            const char *title = doc->entries[e].section;
+            if (title == prev) continue;
+            prev = title;
+
+            size_t t = entry_title(r, title), len = strlen(title);
+            if (t != SIZE_MAX && !r->titles[t].new_entries) continue;
+            if (section_seen(&sections, title, len, str_hash(title, len))) goto nomem;
+        }
+        for (size_t t = 0; t < r->ntitles; ++t){
+            const struct reparse_title *rt = &r->titles[t];
+            if (rt->new_entries && section_seen(&sections, rt->kept, rt->len, rt->hash)) goto nomem;
+        }
+    }else if (doc_sections_reserve(doc, gained)){
+        goto nomem;
+    }
+
+    /* nothing can fail from here on */
+    for (size_t c = 0; c < r->nchanges; ++c){
+        const struct reparse_change *rc = &r->changes[c];
+        struct doc_entry *x;
+
+        switch(rc->kind){
+        case CINIC_MODIFIED:
+            x = &doc->entries[rc->old];
+            doc->stale += entry_size(doc, x);
+            entry_set(doc, x, fresh, rc->entry);
+            break;
+
+        case CINIC_ADDED:
+            x = &doc->entries[doc->nentries];
+            *x = *rc->entry;
+            entry_set(doc, x, fresh, rc->entry);
+            doc->index[doc_slot(doc, x->hash, x->section, strlen(x->section), x->key, strlen(x->key))] = ++doc->nentries;
+            break;
+
+        case CINIC_REMOVED:
+            break;
+        }
+    }
+
+    /* last first, so that no entry still to remove gets moved */
+    for (size_t c = r->nchanges; c-- > 0; ){
+        if (r->changes[c].kind != CINIC_REMOVED) continue;
+        doc->stale += entry_size(doc, &doc->entries[r->changes[c].old]);
+        entry_remove(doc, r->changes[c].old);
+    }
+    doc->stale += r->waste;
+    doc->list_open = r->list_open;
+
+    if (rebuild){
+        free(doc->sections);
+        doc->sections = sections.sections;
+        doc->nsections = sections.nsections;
+        doc->sections_cap = sections.sections_cap;
+    }else{
+        for (size_t t = 0; t < r->ntitles; ++t){
+            const struct reparse_title *rt = &r->titles[t];
+            if (!rt->old_entries && rt->new_entries) section_seen(doc, rt->kept, rt->len, rt->hash);
+        }
+    }
+
+    if (parts){
+        free(doc->parts);
+        doc->parts = parts;
+        doc->nparts = nparts;
+        doc->parts_cap = parts_cap;
+    }else{
+        for (size_t t = 0; t < r->ntitles; ++t){
+            if (r->titles[t].part) doc->parts[r->titles[t].part - 1].sig = r->titles[t].sig;
+        }
+    }
+    return 0;
+
+nomem:
+    free(parts);
+    free(sections.sections);
+    return -1;
+}
+
+/*
+ * Put the new document in place of doc, along with the parts of the new
+ * text. Return 0, or -1 if out of memory.
+ */
+static int reparse_replace(struct reparse *r){
+    struct cinic_doc *doc = r->doc, *fresh = r->fresh;
+    size_t nparts, parts_cap;
+
+    struct doc_part *parts = reparse_parts(r, fresh, &nparts, &parts_cap);
+    if (!parts) return -1;
+
+    char *path = doc->path;
+    doc->path = NULL;
+    doc_release(doc);
+    *doc = *fresh;
+    doc->path = path;
+    doc->parts = parts;
+    doc->nparts = nparts;
+    doc->parts_cap = parts_cap;
+    free(fresh);
+    r->fresh = NULL;
+    return 0;
+}
+
+/*
+ * Update doc to the LEN bytes at DATA, parsed according to CTX, and
+ * set *CHANGES to what changed; see cinic.h.
+ *
+ * Return 0 on success, or -1 on error, with the details in DIAG.
+ *
+ * NOTES:
+ *  - ctx, doc, changes and nchanges must not be NULL; data may only be
+ *    NULL if len is 0; diag may be NULL
+ */
+int Cinic_reparse(const struct cinic_ctx *ctx, struct cinic_doc *doc, const char *data, size_t len,
+                  struct cinic_change **changes, size_t *nchanges, struct cinic_diag *diag)
+{
+    assert(ctx && doc && !doc->cached && (data || !len) && changes && nchanges);
+
+    struct cinic_diag dummy;
+    if (!diag) diag = &dummy;
+    memset(diag, 0, sizeof(*diag));
+    *changes = NULL;
+    *nchanges = 0;
+
+    struct reparse r = {
+        .ctx = ctx,
+        .doc = doc,
+        .full = !doc->nparts || ctx->includes || doc->nsources || doc->list_open || doc->stale > len
+    };
+
+    /* with no title to look at, nothing changed */
+    int rc = reparse_split(&r, data, len);
+    if (!rc && r.ntitles){
+        rc = r.full ? reparse_all(&r, data, len, diag) : reparse_blocks(&r, data, diag);
+        if (!rc) rc = reparse_diff(&r);
+        if (!rc) rc = reparse_report(&r, changes, nchanges);
+        if (!rc) rc = r.full ? reparse_replace(&r) : reparse_merge(&r);
+    }
+
+    if (rc){
+        if (!diag->code) diag->code = CINIC_NOMEM;
+        free(*changes);
+        *changes = NULL;
+        *nchanges = 0;
+    }
+    if (r.fresh && !r.full) r.fresh->strings = NULL;   /* doc's */
+    Cinic_doc_free(r.fresh);
+    free(r.seen);
+    free(r.sigs);
+    free(r.titles);
+    free(r.slots);
+    free(r.blocks);
+    free(r.changes);
+    return rc ? -1 : 0;
+}
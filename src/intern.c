@@ -0,0 +1,137 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cinic.h"
+#include "utils__.h"
+
+/*
+ * Intern table: keeps a single copy of each distinct string it is
+ * given, so that equal strings are represented by the same pointer.
+ *
+ * The copies are kept in an arena and found through an open-addressing
+ * hash table. Lookups, by far the common case once a table is warm,
+ * only take the lock for reading, so any number of threads can intern
+ * strings concurrently.
+ */
+
+struct intern_slot{
+    uint32_t hash;          /* see str_hash() */
+    const char *s;          /* NULL if the slot is free */
+};
+
+struct cinic_intern{
+    pthread_rwlock_t lock;
+    struct cinic_arena *strings;
+    struct intern_slot *slots;
+    size_t nslots;          /* always a power of 2 */
+    size_t n;               /* number of strings held */
+};
+
+#define INTERN_MIN_SLOTS 256
+
+/*
+ * Return a new, empty intern table, or NULL if out of memory. */
+struct cinic_intern *Cinic_intern_new(void){
+    struct cinic_intern *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+
+    t->nslots = INTERN_MIN_SLOTS;
+    t->slots = calloc(t->nslots, sizeof(*t->slots));
+    t->strings = Cinic_arena_new();
+    if (!t->slots || !t->strings || pthread_rwlock_init(&t->lock, NULL)){
+        Cinic_arena_free(t->strings);
+        free(t->slots);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+/*
+ * Free intern table t and all the strings in it. t may be NULL. */
+void Cinic_intern_free(struct cinic_intern *t){
+    if (!t) return;
+    pthread_rwlock_destroy(&t->lock);
+    Cinic_arena_free(t->strings);
+    free(t->slots);
+    free(t);
+}
+
+/*
+ * Return the slot holding the len bytes at s, whose hash is hash, or
+ * else the free slot where they would go. t must be locked. */
+static size_t intern_slot(const struct cinic_intern *t, const char *s, size_t len, uint32_t hash){
+    size_t mask = t->nslots - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask){
+        const struct intern_slot *slot = &t->slots[i];
+        if (!slot->s) return i;
+        if (slot->hash == hash && !memcmp(slot->s, s, len) && slot->s[len] == '\0'){
+            return i;
+        }
+    }
+}
+
+/*
+ * Double the number of slots of t. t must be locked for writing.
+ * Return 0 on success, or -1 if out of memory. */
+static int intern_grow(struct cinic_intern *t){
+    size_t nslots = 2 * t->nslots;
+    struct intern_slot *slots = calloc(nslots, sizeof(*slots));
+    if (!slots) return -1;
+
+    for (size_t i = 0; i < t->nslots; ++i){
+        if (!t->slots[i].s) continue;
+        size_t j = t->slots[i].hash & (nslots - 1);
+        while (slots[j].s) j = (j + 1) & (nslots - 1);
+        slots[j] = t->slots[i];
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->nslots = nslots;
+    return 0;
+}
+
+/*
+ * Return the copy in t of the len bytes at s, whose hash (see
+ * str_hash()) is hash, adding it first if there is none. Return NULL
+ * if out of memory.
+ */
+const char *intern_view(struct cinic_intern *t, const char *s, size_t len, uint32_t hash){
+    assert(t && (s || !len));
+
+    pthread_rwlock_rdlock(&t->lock);
+    const char *found = t->slots[intern_slot(t, s, len, hash)].s;
+    pthread_rwlock_unlock(&t->lock);
+    if (found) return found;
+
+    /* someone else may have added it in the meantime: look again */
+    pthread_rwlock_wrlock(&t->lock);
+    size_t i = intern_slot(t, s, len, hash);
+    if (!(found = t->slots[i].s)){
+        /* keep the load factor under 3/4 */
+        if (4 * (t->n + 1) > 3 * t->nslots){
+            if (intern_grow(t)) goto out;
+            i = intern_slot(t, s, len, hash);
+        }
+        if ( (found = arena_strndup(t->strings, s, len)) ){
+            t->slots[i].hash = hash;
+            t->slots[i].s = found;
+            ++t->n;
+        }
+    }
+out:
+    pthread_rwlock_unlock(&t->lock);
+    return found;
+}
+
+/*
+ * Return the copy of the string s held in intern table t, adding it
+ * first if there is none; or NULL if out of memory. */
+const char *Cinic_intern(struct cinic_intern *t, const char *s){
+    assert(s);
+    size_t len = strlen(s);
+    return intern_view(t, s, len, str_hash(s, len));
+}
@@ -0,0 +1,580 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cinic.h"
+#include "utils__.h"
+
+/*
+ * Snapshots: documents (see doc.c) compiled to a binary image that is
+ * mapped into memory and queried in place.
+ *
+ * The image is made up of a header followed by five tables, at the
+ * offsets the header gives:
+ *  - sources: one struct snap_source per file or directory included
+ *    by the config, as it was when compiled;
+ *  - entries: one struct snap_entry per record or list, in the same
+ *    order as in the document;
+ *  - index: the open-addressing hash table of the document, as is
+ *    (entry number + 1 per used slot, 0 for free ones);
+ *  - items: the string offset of each list item; each list's items
+ *    are next to each other;
+ *  - strings: all strings, NUL-terminated.
+ * Everything refers to everything else by offset or index, so an image
+ * can be mapped anywhere. Numbers are stored in the byte order of the
+ * machine that compiled the image; other machines reject it.
+ *
+ * An image is checked when opened, in time proportional to the number
+ * of entries and list items but without looking at the strings, so
+ * that a damaged one cannot make a lookup read out of bounds.
+ */
+
+#define SNAP_MAGIC      "CINICSNP"
+#define SNAP_VERSION    2U
+#define SNAP_BYTE_ORDER 0x01020304U
+
+struct snap_header{
+    char magic[8];          /* SNAP_MAGIC, not NUL-terminated */
+    uint32_t version;       /* SNAP_VERSION */
+    uint32_t byte_order;    /* SNAP_BYTE_ORDER */
+    uint64_t size;          /* of the whole image, in bytes */
+    uint64_t source_sum;    /* snap_sum() of the config compiled */
+    uint64_t source_len;    /* length of the config compiled */
+    uint32_t nentries;
+    uint32_t index_cap;     /* always a power of 2 */
+    uint32_t nitems;
+    uint32_t strings_len;
+    uint32_t entries_off;   /* offset of each table in the image */
+    uint32_t index_off;
+    uint32_t items_off;
+    uint32_t strings_off;
+    uint32_t nsources;
+    uint32_t sources_off;
+};
+
+/* see struct file_id in utils__.h */
+struct snap_source{
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t path;          /* offset of the path in strings */
+    uint32_t pad;
+};
+
+struct snap_entry{
+    uint32_t hash;          /* see doc_hash() */
+    uint32_t kind;          /* enum doc_kind */
+    uint32_t section;       /* offset of the section title in strings */
+    uint32_t key;           /* offset of the key in strings */
+    uint32_t value;         /* record: offset of the value in strings; list: index of first item in items */
+    uint32_t nitems;        /* list: number of items */
+};
+
+struct cinic_snapshot{
+    const char *base;       /* the image, as mapped */
+    size_t size;
+    const struct snap_header *hdr;
+    const struct snap_source *sources;
+    const struct snap_entry *entries;
+    const uint32_t *index;
+    const uint32_t *items;
+    const char *strings;
+};
+
+/* 64-bit FNV-1a hash of the len bytes at s */
+static uint64_t snap_sum(const char *s, size_t len){
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i){
+        h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/* set diag to report a failure to read or write a file */
+static void io_error(struct cinic_diag *diag, int errnum){
+    memset(diag, 0, sizeof(*diag));
+    diag->code = CINIC_IO;
+    diag->errnum = errnum;
+}
+
+/*
+ * Map the file at path into memory, read-only. On success, set *data
+ * and *len to where it is and how long; an empty file gives a length
+ * of 0. Return 0 on success, or -1 with diag filled in.
+ */
+static int map_file(const char *path, const char **data, size_t *len, struct cinic_diag *diag){
+    struct stat sb;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        io_error(diag, errno);
+        return -1;
+    }
+
+    int errnum = 0;
+    if (fstat(fd, &sb)){
+        errnum = errno;
+    }else if (!S_ISREG(sb.st_mode)){
+        errnum = S_ISDIR(sb.st_mode) ? EISDIR : EINVAL;
+    }else if ((uintmax_t)sb.st_size > SIZE_MAX){
+        errnum = EFBIG;
+    }
+    if (errnum){
+        io_error(diag, errnum);
+        close(fd);
+        return -1;
+    }
+
+    *len = sb.st_size;
+    *data = "";
+    if (*len){
+        void *p = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED){
+            io_error(diag, errno);
+            close(fd);
+            return -1;
+        }
+        *data = p;
+    }
+    close(fd);
+    return 0;
+}
+
+static void unmap_file(const char *data, size_t len){
+    if (len) munmap((void *)data, len);
+}
+
+/*
+ * Copy the string s to the strings of an image being built, at offset
+ * *off, and advance *off past it. Return the offset s was copied to. */
+static uint32_t snap_put(char *strings, uint32_t *off, const char *s){
+    uint32_t at = *off;
+    size_t len = strlen(s) + 1;
+    memcpy(strings + at, s, len);
+    *off += len;
+    return at;
+}
+
+/*
+ * Compile doc to an image, noting it was loaded from the len bytes at
+ * source. On success, return the image, allocated with malloc(), and
+ * store its size in *size. Return NULL if out of memory (*errnum is set
+ * to ENOMEM) or if the image would be too big (EFBIG).
+ */
+static char *snap_build(const struct cinic_doc *doc, const char *source, size_t len, size_t *size, int *errnum){
+    uint64_t nitems = 0, strings_len = 0;
+    const char *section = NULL;
+
+    for (size_t i = 0; i < doc->nsources; ++i){
+        strings_len += strlen(doc->sources[i].path) + 1;
+    }
+
+    /* titles are only stored once per run of entries in the same section */
+    for (size_t e = 0; e < doc->nentries; ++e){
+        const struct doc_entry *entry = &doc->entries[e];
+        if (entry->section != section){
+            section = entry->section;
+            strings_len += strlen(section) + 1;
+        }
+        strings_len += strlen(entry->key) + 1;
+        if (entry->kind == DOC_RECORD){
+            strings_len += strlen(entry->value) + 1;
+            continue;
+        }
+        nitems += entry->nitems;
+        for (size_t i = 0; i < entry->nitems; ++i){
+            strings_len += strlen(doc->items[entry->first + i]) + 1;
+        }
+    }
+
+    uint64_t sources_off = sizeof(struct snap_header);
+    uint64_t entries_off = sources_off + doc->nsources * sizeof(struct snap_source);
+    uint64_t index_off = entries_off + doc->nentries * sizeof(struct snap_entry);
+    uint64_t items_off = index_off + doc->index_cap * sizeof(uint32_t);
+    uint64_t strings_off = items_off + nitems * sizeof(uint32_t);
+    uint64_t total = strings_off + strings_len;
+
+    if (total > UINT32_MAX || total > SIZE_MAX){
+        *errnum = EFBIG;
+        return NULL;
+    }
+
+    char *img = calloc(1, total);
+    if (!img){
+        *errnum = ENOMEM;
+        return NULL;
+    }
+
+    struct snap_header *hdr = (struct snap_header *)img;
+    memcpy(hdr->magic, SNAP_MAGIC, sizeof(hdr->magic));
+    hdr->version = SNAP_VERSION;
+    hdr->byte_order = SNAP_BYTE_ORDER;
+    hdr->size = total;
+    hdr->source_sum = snap_sum(source, len);
+    hdr->source_len = len;
+    hdr->nentries = doc->nentries;
+    hdr->index_cap = doc->index_cap;
+    hdr->nitems = nitems;
+    hdr->strings_len = strings_len;
+    hdr->entries_off = entries_off;
+    hdr->index_off = index_off;
+    hdr->items_off = items_off;
+    hdr->strings_off = strings_off;
+    hdr->nsources = doc->nsources;
+    hdr->sources_off = sources_off;
+
+    struct snap_entry *entries = (struct snap_entry *)(img + entries_off);
+    uint32_t *items = (uint32_t *)(img + items_off);
+    char *strings = img + strings_off;
+    uint32_t soff = 0, section_off = 0, nitem = 0;
+
+    struct snap_source *sources = (struct snap_source *)(img + sources_off);
+    for (size_t i = 0; i < doc->nsources; ++i){
+        const struct file_id *id = &doc->sources[i].id;
+        sources[i].dev = id->dev;
+        sources[i].ino = id->ino;
+        sources[i].size = id->size;
+        sources[i].mtime_sec = id->mtime.tv_sec;
+        sources[i].mtime_nsec = id->mtime.tv_nsec;
+        sources[i].path = snap_put(strings, &soff, doc->sources[i].path);
+    }
+
+    section = NULL;
+    for (size_t e = 0; e < doc->nentries; ++e){
+        const struct doc_entry *entry = &doc->entries[e];
+        struct snap_entry *out = &entries[e];
+
+        if (entry->section != section){
+            section = entry->section;
+            section_off = snap_put(strings, &soff, section);
+        }
+        out->hash = entry->hash;
+        out->kind = entry->kind;
+        out->section = section_off;
+        out->key = snap_put(strings, &soff, entry->key);
+
+        if (entry->kind == DOC_RECORD){
+            out->value = snap_put(strings, &soff, entry->value);
+            continue;
+        }
+        /* lists overwritten while loading leave stale items behind: skip them */
+        out->value = nitem;
+        out->nitems = entry->nitems;
+        for (size_t i = 0; i < entry->nitems; ++i){
+            items[nitem++] = snap_put(strings, &soff, doc->items[entry->first + i]);
+        }
+    }
+
+    memcpy(img + index_off, doc->index, doc->index_cap * sizeof(uint32_t));
+    *size = total;
+    return img;
+}
+
+/*
+ * Flush the directory holding path, so that a rename into it is on disk.
+ * Best effort: a failure only loses durability, not the new file. */
+static void sync_parent(const char *path){
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+    if (!dir) return;
+
+    int fd = open(dir, O_RDONLY);
+    if (fd >= 0){
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+}
+
+/*
+ * Write the size bytes at img to path, replacing any file there in one
+ * go: readers see either the old file or the whole new one, even after
+ * a crash. The image goes to a uniquely named file next to path first,
+ * so concurrent writers never share a temporary file. Return 0 on
+ * success, or else an errno value.
+ */
+static int write_file(const char *path, const char *img, size_t size){
+    size_t plen = strlen(path);
+    char *tmp = malloc(plen + sizeof(".XXXXXX"));
+    if (!tmp) return ENOMEM;
+    memcpy(tmp, path, plen);
+    memcpy(tmp + plen, ".XXXXXX", sizeof(".XXXXXX"));
+
+    int rc = 0;
+    int fd = mkstemp(tmp);
+    if (fd < 0){
+        rc = errno;
+        free(tmp);
+        return rc;
+    }
+
+    /* mkstemp() makes the file private; snapshots are meant to be shared */
+    if (fchmod(fd, 0644)) rc = errno;
+
+    while (size && !rc){
+        ssize_t n = write(fd, img, size);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            rc = errno;
+            break;
+        }
+        img += n;
+        size -= n;
+    }
+    if (!rc && fsync(fd)) rc = errno;
+    if (close(fd) && !rc) rc = errno;
+    if (!rc && rename(tmp, path)) rc = errno;
+    if (rc) unlink(tmp);
+    free(tmp);
+    if (!rc) sync_parent(path);
+    return rc;
+}
+
+/*
+ * Compile the .ini config file at INI_PATH, parsed according to CTX,
+ * to a snapshot at OUT_PATH. See Cinic_snapshot_open().
+ *
+ * Return 0 on success, or -1 with the details in DIAG (if not NULL).
+ *
+ * NOTES:
+ *  - ctx, ini_path and out_path must not be NULL; diag may be NULL
+ */
+int Cinic_compile(const struct cinic_ctx *ctx, const char *ini_path, const char *out_path, struct cinic_diag *diag){
+    assert(ctx && ini_path && out_path);
+
+    struct cinic_diag dummy;
+    if (!diag) diag = &dummy;
+
+    const char *data;
+    size_t len;
+    if (map_file(ini_path, &data, &len, diag)) return -1;
+
+    /* by path, for include directives to be relative to it */
+    struct cinic_doc *doc = doc_load_buffer(ctx, data, len, ini_path, diag);
+    if (!doc){
+        unmap_file(data, len);
+        return -1;
+    }
+
+    int errnum = 0;
+    size_t size = 0;
+    char *img = snap_build(doc, data, len, &size, &errnum);
+    Cinic_doc_free(doc);
+    unmap_file(data, len);
+
+    if (img) errnum = write_file(out_path, img, size);
+    free(img);
+
+    if (errnum == ENOMEM){
+        memset(diag, 0, sizeof(*diag));
+        diag->code = CINIC_NOMEM;
+        return -1;
+    }else if (errnum){
+        io_error(diag, errnum);
+        return -1;
+    }
+    return 0;
+}
+
+/* true if the table of n elements of size sz at off fits in an image of size bytes */
+static inline bool snap_fits(uint64_t size, uint64_t off, uint64_t n, uint64_t sz){
+    return (off <= size && n <= (size - off) / sz);
+}
+
+/*
+ * Check the image in snap is one that can be safely queried.
+ * Return true if so. */
+static bool snap_check(struct cinic_snapshot *snap){
+    const struct snap_header *hdr = (const struct snap_header *)snap->base;
+
+    if (snap->size < sizeof(*hdr) ||
+            memcmp(hdr->magic, SNAP_MAGIC, sizeof(hdr->magic)) ||
+            hdr->version != SNAP_VERSION ||
+            hdr->byte_order != SNAP_BYTE_ORDER ||
+            hdr->size != snap->size)
+    {
+        return false;
+    }
+
+    /* tables must be aligned, in bounds, and the index must have a free slot */
+    if (hdr->sources_off % 8 || hdr->entries_off % 4 || hdr->index_off % 4 || hdr->items_off % 4 ||
+            !snap_fits(snap->size, hdr->sources_off, hdr->nsources, sizeof(struct snap_source)) ||
+            !snap_fits(snap->size, hdr->entries_off, hdr->nentries, sizeof(struct snap_entry)) ||
+            !snap_fits(snap->size, hdr->index_off, hdr->index_cap, sizeof(uint32_t)) ||
+            !snap_fits(snap->size, hdr->items_off, hdr->nitems, sizeof(uint32_t)) ||
+            !snap_fits(snap->size, hdr->strings_off, hdr->strings_len, 1) ||
+            !hdr->index_cap || (hdr->index_cap & (hdr->index_cap - 1)) ||
+            hdr->nentries >= hdr->index_cap)
+    {
+        return false;
+    }
+
+    snap->hdr = hdr;
+    snap->sources = (const struct snap_source *)(snap->base + hdr->sources_off);
+    snap->entries = (const struct snap_entry *)(snap->base + hdr->entries_off);
+    snap->index = (const uint32_t *)(snap->base + hdr->index_off);
+    snap->items = (const uint32_t *)(snap->base + hdr->items_off);
+    snap->strings = snap->base + hdr->strings_off;
+
+    /* any offset into the strings then gives a NUL-terminated string */
+    if (hdr->strings_len && snap->strings[hdr->strings_len - 1] != '\0') return false;
+
+    size_t free_slots = 0;
+    for (uint32_t i = 0; i < hdr->index_cap; ++i){
+        if (snap->index[i] > hdr->nentries) return false;
+        free_slots += !snap->index[i];
+    }
+    if (!free_slots) return false;
+
+    for (uint32_t e = 0; e < hdr->nentries; ++e){
+        const struct snap_entry *entry = &snap->entries[e];
+        if (entry->section >= hdr->strings_len || entry->key >= hdr->strings_len) return false;
+        if (entry->kind == DOC_RECORD){
+            if (entry->value >= hdr->strings_len) return false;
+        }else if (entry->kind != DOC_LIST || (uint64_t)entry->value + entry->nitems > hdr->nitems){
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < hdr->nitems; ++i){
+        if (snap->items[i] >= hdr->strings_len) return false;
+    }
+    for (uint32_t i = 0; i < hdr->nsources; ++i){
+        if (snap->sources[i].path >= hdr->strings_len) return false;
+    }
+    return true;
+}
+
+/*
+ * Open the snapshot at PATH, as compiled by Cinic_compile(), for
+ * querying with Cinic_snapshot_get() and Cinic_snapshot_get_list().
+ *
+ * Return NULL on error, with the details in DIAG (if not NULL):
+ * CINIC_IO if the file cannot be read, or CINIC_BAD_SNAPSHOT if it is
+ * not a snapshot this version of the library can read.
+ *
+ * NOTES:
+ *  - path must not be NULL; diag may be NULL
+ */
+struct cinic_snapshot *Cinic_snapshot_open(const char *path, struct cinic_diag *diag){
+    assert(path);
+
+    struct cinic_diag dummy;
+    if (!diag) diag = &dummy;
+
+    struct cinic_snapshot *snap = calloc(1, sizeof(*snap));
+    if (!snap){
+        memset(diag, 0, sizeof(*diag));
+        diag->code = CINIC_NOMEM;
+        return NULL;
+    }
+
+    if (map_file(path, &snap->base, &snap->size, diag)){
+        free(snap);
+        return NULL;
+    }
+    if (!snap_check(snap)){
+        Cinic_snapshot_close(snap);
+        memset(diag, 0, sizeof(*diag));
+        diag->code = CINIC_BAD_SNAPSHOT;
+        return NULL;
+    }
+    memset(diag, 0, sizeof(*diag));
+    return snap;
+}
+
+/*
+ * Unmap snap and free it. snap may be NULL. */
+void Cinic_snapshot_close(struct cinic_snapshot *snap){
+    if (!snap) return;
+    unmap_file(snap->base, snap->size);
+    free(snap);
+}
+
+/*
+ * Return the entry for key in section of snap, or NULL if there is no
+ * such entry. A NULL section stands for the global section. */
+static const struct snap_entry *snap_lookup(const struct cinic_snapshot *snap, const char *section, const char *key){
+    assert(snap && key);
+
+    if (!section) section = "";
+    uint32_t hash = doc_hash(str_hash(section, strlen(section)), str_hash(key, strlen(key)));
+    size_t mask = snap->hdr->index_cap - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask){
+        uint32_t e = snap->index[i];
+        if (!e) return NULL;
+
+        const struct snap_entry *entry = &snap->entries[e - 1];
+        if (entry->hash == hash && !strcmp(snap->strings + entry->key, key) &&
+                !strcmp(snap->strings + entry->section, section))
+        {
+            return entry;
+        }
+    }
+}
+
+/*
+ * Like Cinic_get(), but look the record up in snap. */
+const char *Cinic_snapshot_get(const struct cinic_snapshot *snap, const char *section, const char *key){
+    const struct snap_entry *entry = snap_lookup(snap, section, key);
+    if (!entry || entry->kind != DOC_RECORD) return NULL;
+    return snap->strings + entry->value;
+}
+
+/*
+ * Look up the list key in section of snap; see Cinic_get() for section.
+ *
+ * Return false if there is no such list. Otherwise store up to *nitems
+ * of its items in items, in order, set *nitems to the number of items
+ * in the list, and return true.
+ */
+bool Cinic_snapshot_get_list(const struct cinic_snapshot *snap, const char *section, const char *key,
+                             const char **items, size_t *nitems)
+{
+    assert(nitems && (items || !*nitems));
+
+    const struct snap_entry *entry = snap_lookup(snap, section, key);
+    if (!entry || entry->kind != DOC_LIST) return false;
+
+    for (size_t i = 0; i < entry->nitems && i < *nitems; ++i){
+        items[i] = snap->strings + snap->items[entry->value + i];
+    }
+    *nitems = entry->nitems;
+    return true;
+}
+
+/*
+ * Tell whether snap was compiled from the config currently in the file
+ * at INI_PATH, and from the files and directories it included as they
+ * are now. Return 0 if so, 1 if not (it is stale), or -1 if the file
+ * cannot be read.
+ */
+int Cinic_snapshot_stale(const struct cinic_snapshot *snap, const char *ini_path){
+    assert(snap && ini_path);
+
+    struct cinic_diag diag;
+    const char *data;
+    size_t len;
+    if (map_file(ini_path, &data, &len, &diag)) return -1;
+
+    bool fresh = (len == snap->hdr->source_len && snap_sum(data, len) == snap->hdr->source_sum);
+    unmap_file(data, len);
+
+    /* includes go by identity, as for cached documents: see cache.c */
+    struct file_id id;
+    for (uint32_t i = 0; fresh && i < snap->hdr->nsources; ++i){
+        const struct snap_source *src = &snap->sources[i];
+        fresh = !file_id(snap->strings + src->path, &id) &&
+                (uint64_t)id.dev == src->dev && (uint64_t)id.ino == src->ino && id.size == src->size &&
+                id.mtime.tv_sec == src->mtime_sec && id.mtime.tv_nsec == src->mtime_nsec;
+    }
+    return fresh ? 0 : 1;
+}
@@ -2,6 +2,8 @@
 #define CINIC_UTILS__H
 
 #include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
 
 #include "cinic.h"
 
@@ -25,31 +27,217 @@
 #   define say(...)
 #endif
 
+/*
+ * Use SSE2/AVX2 to scan buffers, when building for x86 with a compiler
+ * that supports per-function target attributes. The instruction set
+ * actually used is chosen at runtime, based on the CPU. Define
+ * CINIC_NO_SIMD to only ever use the portable scalar code.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(CINIC_NO_SIMD)
+#   define CINIC_X86_SIMD
+#   include <immintrin.h>
+#endif
+
+/* number of bytes scan_block_*() look at */
+#define SCAN_BLOCK 64U
+
+/*
+ * Carry on working out a str_hash(): h is the hash of the bytes
+ * preceding the len bytes at s. */
+static inline uint32_t str_hash_more(uint32_t h, const char *s, size_t len){
+    for (size_t i = 0; i < len; ++i){
+        h = (h ^ (unsigned char)s[i]) * 16777619U;
+    }
+    return h;
+}
+
+/* 32-bit FNV-1a hash of the len bytes at s */
+static inline uint32_t str_hash(const char *s, size_t len){
+    return str_hash_more(2166136261U, s, len);
+}
+
+/*
+ * A growable buffer holding a NUL-terminated copy of a token; see
+ * buff_set(). Zero-initialize before first use.
+ */
+struct cinic_buff{
+    char *s;
+    size_t cap;     /* bytes allocated at s */
+};
+
+/* What a lexeme (see lex_line()) is */
+enum cinic_lexeme_type{
+    LEX_NONE = 0,    /* nothing (more) on the line */
+    LEX_SECTION,     /* section title */
+    LEX_RECORD,      /* key = value */
+    LEX_LIST_HEAD,   /* key = (start of list) */
+    LEX_LIST_OPEN,   /* opening list bracket */
+    LEX_LIST_ITEM,   /* list item followed by a comma */
+    LEX_LIST_LAST,   /* last list item */
+    LEX_LIST_CLOSE,  /* closing list bracket */
+    LEX_BAD          /* not valid */
+};
+
+/* A token extracted from a line by lex_line() or lex_list_token() */
+struct cinic_lexeme{
+    enum cinic_lexeme_type type;
+    struct cinic_view k;    /* section title, record key, or list head */
+    struct cinic_view v;    /* record value or list item */
+    size_t pos;             /* offset in the line of the token; for LEX_BAD, of what is wrong */
+    size_t next;            /* offset in the line at which to look for the next list token */
+};
+
+/*
+ * Internal alternative to cinic_event_cb, with the tokens as views
+ * into the line being parsed rather than NUL-terminated copies. See
+ * parse_file_events().
+ */
+typedef int (*cinic_sink)(void *ud,
+                          enum cinic_event ev,
+                          uint32_t ln,
+                          enum cinic_list_state list,
+                          const struct cinic_view *k,
+                          const struct cinic_view *v);
+
+/*
+ * Event only ever handed to sinks, before the parser reads a file or
+ * lists a directory named by an include directive (see
+ * cinic_ctx.includes): k is its path, and v views a struct file_id of
+ * it, as it was just before. Not part of enum cinic_event, so that
+ * public callbacks never see it.
+ */
+#define CINIC_EV_INCLUDE (CINIC_EV_LIST_ITEM + 1)
+
+/*
+ * Event only ever handed to sinks, once all of the config was parsed
+ * without error: list is the list state it ended in, and k and v are
+ * NULL. Included files do not have one of their own.
+ */
+#define CINIC_EV_END (CINIC_EV_INCLUDE + 1)
+
+/* What tells whether a file has changed; see cache.c */
+struct file_id{
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+};
+
+int file_id(const char *path, struct file_id *id);
+
+/* What a document entry is; see doc.c */
+enum doc_kind{
+    DOC_RECORD = 0,
+    DOC_LIST
+};
+
+struct doc_entry{
+    uint32_t hash;          /* of section and key; see doc_hash() */
+    enum doc_kind kind;
+    const char *section;
+    const char *key;
+    const char *value;      /* record only */
+    size_t first;           /* list: index of its first item in items */
+    size_t nitems;          /* list: number of items */
+};
+
+/* A section title, or the part of one naming a namespace; see doc.c */
+struct doc_section{
+    uint32_t hash;          /* str_hash() of the len bytes at title */
+    uint32_t len;
+    const char *title;      /* NULL if the slot is free */
+};
+
+/* A file or directory a document was loaded from, other than the
+ * config itself; see CINIC_EV_INCLUDE */
+struct doc_source{
+    const char *path;
+    struct file_id id;
+};
+
+/* The text of a section -- of all the blocks of the config under its
+ * title -- as of the last Cinic_reparse(); see doc.c */
+struct doc_part{
+    uint64_t sig;           /* text_hash() of its blocks, in order */
+    uint32_t hash;          /* str_hash() of the len bytes at title */
+    uint32_t len;
+    const char *title;      /* NULL if the slot is free */
+};
+
+struct cache_entry;
+
+/* A loaded config; see doc.c */
+struct cinic_doc{
+    struct cinic_arena *strings;
+    struct cinic_intern *intern;    /* not owned; may be NULL */
+
+    struct doc_entry *entries;
+    size_t nentries, entries_cap;
+
+    const char **items;     /* items of all lists */
+    size_t nitems, items_cap;
+
+    uint32_t *index;        /* entry number + 1 for each used slot, 0 for free ones */
+    size_t index_cap;       /* number of slots; always a power of 2 */
+
+    struct doc_section *sections;   /* see Cinic_has_section() */
+    size_t nsections;
+    size_t sections_cap;    /* number of slots; always a power of 2 */
+    char ns_sep;            /* section title namespace separator */
+    struct cache_entry *cached;     /* see cache.c; NULL if not from a cache */
+    char *path;             /* of the config, for Cinic_reparse(); NULL if not from a file */
+    struct doc_source *sources;     /* included files and directories */
+    size_t nsources, sources_cap;
+    struct doc_part *parts;         /* none until first reparsed */
+    size_t nparts;
+    size_t parts_cap;       /* number of slots; always a power of 2 */
+    size_t stale;           /* bytes of strings no longer used, about */
+    bool list_open;         /* the text ended inside a list; see Cinic_reparse() */
+
+    /* only used while loading */
+    const char *section;    /* title of the current section */
+    size_t section_len;
+    uint32_t section_hash;  /* str_hash() of section */
+    size_t list;            /* entry number of the list last started */
+    bool section_seen;      /* the current section is in sections */
+    bool nomem;             /* an allocation failed */
+};
+
+/*
+ * Hash of an entry, made from the str_hash() of its section title, sh,
+ * and of its key, kh. The section title hash only needs working out
+ * once per section.
+ */
+static inline uint32_t doc_hash(uint32_t sh, uint32_t kh){
+    return sh ^ (kh + 0x9e3779b9U + (sh << 6) + (sh >> 2));
+}
+
 /*
  * see source files for coments/docs
  * */
 
-extern const char *SECTION_NS_SEP;
-extern bool ALLOW_GLOBAL_RECORDS;
+enum cinic_error Cinic_get_list_error(const struct cinic_ctx *ctx, enum cinic_list_state prev, enum cinic_list_state next);
 
-const char *Cinic_err2str(enum cinic_error errnum);
-enum cinic_error Cinic_get_list_error(enum cinic_list_state prev, enum cinic_list_state next);
-void Cinic_exit_print(enum cinic_error error, uint32_t ln);
+int parse_file_events(const struct cinic_ctx *ctx, const char *path, cinic_sink sink, void *ud, struct cinic_diag *diag);
+int parse_buffer_events(const struct cinic_ctx *ctx, const char *data, size_t len, const char *path,
+                        cinic_sink sink, void *ud, struct cinic_diag *diag);
+struct cinic_doc *doc_load_buffer(const struct cinic_ctx *ctx, const char *data, size_t len, const char *path,
+                                  struct cinic_diag *diag);
 
-uint32_t read_line(FILE *f, char **buff, size_t *buffsz);
-bool is_empty_line(char *line);
-bool is_comment_line(char *line);
-bool is_section_line(char *line, char name[], size_t buffsz);
-bool is_record_line(char *line, char k[], char v[], size_t buffsz);
-bool is_list_head(char *line, char k[], size_t buffsz);
-bool is_list_start(char *line);
-bool is_list_end(char *line);
-bool is_list_entry(char *line, char v[], size_t buffsz, bool *islast);
-char *get_list_token(char *line, char buff[], size_t buffsz);
-
-char *strip_lws(char *s);
-void strip_tws(char *s);
-void strip_comment(char *s);
+size_t read_line(FILE *f, char **buff, size_t *buffsz);
+int buff_set(struct cinic_buff *b, const struct cinic_view *v);
+const char *buff_str(const struct cinic_buff *b);
+void buff_free(struct cinic_buff *b);
+void lex_line(const struct cinic_ctx *ctx, const char *line, size_t len, struct cinic_lexeme *lx);
+void lex_list_token(const struct cinic_ctx *ctx, const char *line, size_t len, size_t pos, struct cinic_lexeme *lx);
+void *arena_alloc(struct cinic_arena *a, size_t size, size_t align);
+char *arena_strndup(struct cinic_arena *a, const char *s, size_t len);
+const char *intern_view(struct cinic_intern *t, const char *s, size_t len, uint32_t hash);
 
+uint64_t scan_block_scalar(const char *s, char c);
+#ifdef CINIC_X86_SIMD
+uint64_t scan_block_sse2(const char *s, char c);
+uint64_t scan_block_avx2(const char *s, char c);
+#endif
 
 #endif
@@ -0,0 +1,488 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#   include <poll.h>
+#   include <unistd.h>
+#   include <sys/inotify.h>
+#   include <sys/stat.h>
+#endif
+
+#include "cinic.h"
+#include "utils__.h"
+
+/*
+ * Watcher of a config file, reloading it when it changes; see
+ * Cinic_watch_new().
+ *
+ * Editors mostly save a file by writing a new one and renaming it over
+ * the old, so it is the directories files are in that are watched with
+ * inotify, rather than the files themselves, and events about other
+ * files in them are ignored. The directories a config includes whole
+ * (see CINIC_EV_INCLUDE) are watched for any change at all.
+ *
+ * Events are read, and the config loaded again once they stop coming,
+ * on a thread of the watcher's own. Documents are handed out reference
+ * counted, much as by a cache (see cache.c): publishing a new one only
+ * takes swapping a pointer under the lock, and the one it replaces is
+ * freed once the last reader hands it back.
+ */
+
+/* The directories a watcher watches; see struct watch_dir */
+struct watch_set{
+    struct watch_dir *dirs;
+    size_t ndirs, cap;
+};
+
+/* A document of a watcher, as loaded at some point */
+struct watch_doc{
+    struct watch_doc *next;         /* in the list of those replaced */
+    struct cinic_doc *doc;
+    size_t refs;                    /* times handed out and not yet released */
+};
+
+struct cinic_watch{
+    pthread_mutex_t lock;
+    struct watch_doc *current;      /* the latest; never NULL */
+    struct watch_doc *replaced;     /* older ones still in use */
+
+    /* only used by the thread of the watcher, once started */
+    struct cinic_ctx ctx;
+    char *path;
+    unsigned debounce_ms;
+    watch_cb cb;
+    void *ud;
+    int fd;                         /* inotify instance */
+    int stop[2];                    /* pipe whose closing stops the thread */
+    bool started;
+    pthread_t thread;
+    struct watch_set set;           /* what the latest document was loaded from */
+    int config_wd;                  /* of the directory of the config; -1 once no longer watched */
+};
+
+/* Free watched document v */
+static void watch_doc_free(struct watch_doc *v){
+    if (!v) return;
+    Cinic_doc_free(v->doc);
+    free(v);
+}
+
+/*
+ * Make doc the latest document of w. Return 0, or -1 if out of memory,
+ * doc then being left to the caller. */
+static int watch_publish(struct cinic_watch *w, struct cinic_doc *doc){
+    struct watch_doc *v = calloc(1, sizeof(*v)), *old;
+    if (!v) return -1;
+    v->doc = doc;
+
+    pthread_mutex_lock(&w->lock);
+    old = w->current;
+    w->current = v;
+    if (old && old->refs){
+        old->next = w->replaced;
+        w->replaced = old;
+        old = NULL;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    watch_doc_free(old);
+    return 0;
+}
+
+/*
+ * Return the latest document of w; see cinic.h. */
+const struct cinic_doc *Cinic_watch_get(struct cinic_watch *w){
+    assert(w);
+
+    pthread_mutex_lock(&w->lock);
+    struct watch_doc *v = w->current;
+    v->refs++;
+    pthread_mutex_unlock(&w->lock);
+    return v->doc;
+}
+
+/*
+ * Hand back doc, as got from w; see cinic.h. */
+void Cinic_watch_release(struct cinic_watch *w, const struct cinic_doc *doc){
+    assert(w && doc);
+    struct watch_doc *v = NULL;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->current->doc == doc){
+        assert(w->current->refs);
+        w->current->refs--;
+    }else{
+        struct watch_doc **p = &w->replaced;
+        while ((*p)->doc != doc) p = &(*p)->next;
+        assert((*p)->refs);
+        if (!--(*p)->refs){
+            v = *p;
+            *p = v->next;
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    watch_doc_free(v);
+}
+
+#ifdef __linux__
+
+/* what is watched for in each directory */
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE \
+                    | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/* A directory watched */
+struct watch_dir{
+    int wd;                 /* inotify watch descriptor */
+    bool whole;             /* any change in it counts */
+    char **names;           /* of the files in it whose changes count */
+    size_t nnames, names_cap;
+};
+
+/* how long to wait before trying again to reload a config no longer watched, in ms */
+#define WATCH_RETRY_MS 1000
+
+/*
+ * Grow the array *a of *cap elements of size sz so it can hold at least
+ * n elements. Return 0 on success, or -1 if out of memory. */
+static int grow(void **a, size_t *cap, size_t sz, size_t n){
+    if (n <= *cap) return 0;
+
+    size_t c = *cap ? 2 * *cap : 8;
+    while (c < n) c *= 2;
+    void *p = realloc(*a, c * sz);
+    if (!p) return -1;
+    *a = p;
+    *cap = c;
+    return 0;
+}
+
+/* Free what set holds, but not the watches themselves */
+static void set_free(struct watch_set *set){
+    for (size_t i = 0; i < set->ndirs; ++i){
+        struct watch_dir *d = &set->dirs[i];
+        for (size_t j = 0; j < d->nnames; ++j) free(d->names[j]);
+        free(d->names);
+    }
+    free(set->dirs);
+    memset(set, 0, sizeof(*set));
+}
+
+/* Return the directory in set with watch descriptor wd, or NULL */
+static struct watch_dir *set_find(const struct watch_set *set, int wd){
+    for (size_t i = 0; i < set->ndirs; ++i){
+        if (set->dirs[i].wd == wd) return &set->dirs[i];
+    }
+    return NULL;
+}
+
+/*
+ * Stop watching the directories of set that are not in keep, if any;
+ * set itself is left as is. */
+static void set_unwatch(const struct cinic_watch *w, const struct watch_set *set, const struct watch_set *keep){
+    for (size_t i = 0; i < set->ndirs; ++i){
+        if (!set_find(keep, set->dirs[i].wd)) inotify_rm_watch(w->fd, set->dirs[i].wd);
+    }
+}
+
+/*
+ * Watch the directory at dir for changes to the file name in it, or to
+ * anything in it if name is NULL, and add it to set. Return 0, or else
+ * an errno value. */
+static int watch_add(struct cinic_watch *w, struct watch_set *set, const char *dir, const char *name){
+    int wd = inotify_add_watch(w->fd, dir, WATCH_MASK);
+    if (wd < 0) return errno;
+
+    /* the same directory by another path gets the same descriptor */
+    struct watch_dir *d = set_find(set, wd);
+    if (!d){
+        if (grow((void **)&set->dirs, &set->cap, sizeof(*set->dirs), set->ndirs + 1)){
+            if (!set_find(&w->set, wd)) inotify_rm_watch(w->fd, wd);
+            return ENOMEM;
+        }
+        d = &set->dirs[set->ndirs++];
+        memset(d, 0, sizeof(*d));
+        d->wd = wd;
+    }
+    if (!name){
+        d->whole = true;
+        return 0;
+    }
+
+    for (size_t i = 0; i < d->nnames; ++i){
+        if (!strcmp(d->names[i], name)) return 0;
+    }
+    if (grow((void **)&d->names, &d->names_cap, sizeof(*d->names), d->nnames + 1)) return ENOMEM;
+    if (!(d->names[d->nnames] = strdup(name))) return ENOMEM;
+    d->nnames++;
+    return 0;
+}
+
+/*
+ * Watch the directory the file at path is in for changes to it, and add
+ * it to set. Return 0, or else an errno value. */
+static int watch_file(struct cinic_watch *w, struct watch_set *set, const char *path){
+    const char *slash = strrchr(path, '/');
+    if (!slash) return watch_add(w, set, ".", path);
+    if (slash == path) return watch_add(w, set, "/", path + 1);
+
+    char *dir = strndup(path, slash - path);
+    if (!dir) return ENOMEM;
+    int rc = watch_add(w, set, dir, slash + 1);
+    free(dir);
+    return rc;
+}
+
+/*
+ * Watch the config of w and everything doc, its latest document, was
+ * loaded from; and stop watching directories no longer needed. Return
+ * 0, or else an errno value if the config itself cannot be watched, w
+ * then being left watching what it was. What it includes is watched as
+ * far as possible: changes to files that cannot be are just not
+ * noticed. */
+static int watch_arm(struct cinic_watch *w, const struct cinic_doc *doc){
+    struct watch_set set = {0};
+    struct stat sb;
+
+    /* the new set is built apart, so that the old one is still there to fall back on */
+    int rc = watch_file(w, &set, w->path);
+    if (rc){
+        set_unwatch(w, &set, &w->set);
+        set_free(&set);
+        return rc;
+    }
+    for (size_t i = 0; i < doc->nsources; ++i){
+        const char *path = doc->sources[i].path;
+        if (!stat(path, &sb) && S_ISDIR(sb.st_mode)) watch_add(w, &set, path, NULL);
+        else watch_file(w, &set, path);
+    }
+
+    set_unwatch(w, &w->set, &set);
+    set_free(&w->set);
+    w->set = set;
+    w->config_wd = set.dirs[0].wd;
+    return 0;
+}
+
+/* true if inotify event ev is about something the config of w is loaded from */
+static bool watch_event(const struct cinic_watch *w, const struct inotify_event *ev){
+    /* events were lost */
+    if (ev->mask & IN_Q_OVERFLOW) return true;
+
+    /* a directory no longer watched by w, or else about it as a whole */
+    const struct watch_dir *d = set_find(&w->set, ev->wd);
+    if (!d) return false;
+    if (d->whole || !ev->len) return true;
+    for (size_t i = 0; i < d->nnames; ++i){
+        if (!strcmp(d->names[i], ev->name)) return true;
+    }
+    return false;
+}
+
+/*
+ * Read all pending inotify events of w. Return true if any was about
+ * what its config is loaded from. */
+static bool watch_read(struct cinic_watch *w){
+    union {
+        int wd;             /* aligned as struct inotify_event */
+        char buf[4096];
+    } u;
+    bool changed = false;
+    ssize_t n;
+
+    while ((n = read(w->fd, u.buf, sizeof(u.buf))) > 0){
+        for (const char *p = u.buf; p < u.buf + n; ){
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            changed = changed || watch_event(w, ev);
+
+            /* the directory of the config is gone, or was moved */
+            if ((ev->mask & IN_IGNORED) && ev->wd == w->config_wd) w->config_wd = -1;
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+    return changed;
+}
+
+/*
+ * Load the config of w again and publish the new document, or keep
+ * the last one if it cannot be loaded or watched; then call the
+ * callback of w. Return true if the reload is to be tried again later,
+ * as nothing would trigger it: the config itself is not watched. */
+static bool watch_reload(struct cinic_watch *w){
+    struct cinic_diag diag;
+    struct cinic_doc *doc = Cinic_load(&w->ctx, w->path, &diag);
+    int err = 0;
+
+    /* what is included may have changed; failing that, w is left watching what it was */
+    if (doc && (err = watch_arm(w, doc))){
+        Cinic_doc_free(doc);
+        memset(&diag, 0, sizeof(diag));
+        diag.code = (err == ENOMEM) ? CINIC_NOMEM : CINIC_IO;
+        diag.errnum = err;
+    }else if (doc && watch_publish(w, doc)){
+        Cinic_doc_free(doc);
+        memset(&diag, 0, sizeof(diag));
+        diag.code = CINIC_NOMEM;
+    }
+    if (w->cb) w->cb(w->ud, &diag);
+    return err || w->config_wd < 0;
+}
+
+/* Set *due to ms milliseconds from now */
+static void due_in(struct timespec *due, unsigned ms){
+    clock_gettime(CLOCK_MONOTONIC, due);
+    due->tv_sec += ms / 1000;
+    due->tv_nsec += (ms % 1000) * 1000000L;
+    if (due->tv_nsec >= 1000000000L){
+        due->tv_sec++;
+        due->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Return the number of milliseconds from now until due, 0 if past */
+static int ms_until(const struct timespec *due){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long long ms = (due->tv_sec - now.tv_sec) * 1000LL + (due->tv_nsec - now.tv_nsec) / 1000000;
+    return ms > 0 ? (int)ms : 0;
+}
+
+/*
+ * Body of the thread of the watcher arg: read events, and reload once
+ * debounce_ms went by without any, until stopped. */
+static void *watch_main(void *arg){
+    struct cinic_watch *w = arg;
+    struct timespec due = {0};
+    bool pending = false;       /* something changed since the last reload */
+
+    for (;;){
+        struct pollfd fds[2] = { { w->fd, POLLIN, 0 }, { w->stop[0], POLLIN, 0 } };
+        int rc = poll(fds, 2, pending ? ms_until(&due) : -1);
+
+        if (rc < 0 && errno != EINTR) break;
+        if (fds[1].revents) break;
+        if (fds[0].revents && watch_read(w)){
+            pending = true;
+            due_in(&due, w->debounce_ms);
+        }else if (pending && !ms_until(&due)){
+            if ( (pending = watch_reload(w)) ) due_in(&due, WATCH_RETRY_MS);
+        }
+    }
+    return NULL;
+}
+
+/* Release what w holds, stopping its thread first if started */
+static void watch_destroy(struct cinic_watch *w){
+    if (w->stop[1] >= 0) close(w->stop[1]);
+    if (w->started) pthread_join(w->thread, NULL);
+    if (w->stop[0] >= 0) close(w->stop[0]);
+    if (w->fd >= 0) close(w->fd);
+
+    set_free(&w->set);
+    free(w->path);
+    watch_doc_free(w->current);
+    pthread_mutex_destroy(&w->lock);
+    free(w);
+}
+
+/*
+ * Return a new watcher of the config file at path; see cinic.h.
+ *
+ * NOTES:
+ *  - ctx and path must not be NULL; diag may be NULL
+ */
+struct cinic_watch *Cinic_watch_new(const struct cinic_ctx *ctx, const char *path, unsigned debounce_ms,
+                                    watch_cb cb, void *ud, struct cinic_diag *diag)
+{
+    assert(ctx && path);
+
+    struct cinic_diag dummy;
+    if (!diag) diag = &dummy;
+    memset(diag, 0, sizeof(*diag));
+
+    struct cinic_watch *w = calloc(1, sizeof(*w));
+    if (!w || pthread_mutex_init(&w->lock, NULL)){
+        free(w);
+        diag->code = CINIC_NOMEM;
+        return NULL;
+    }
+    w->ctx = *ctx;
+    w->debounce_ms = debounce_ms;
+    w->cb = cb;
+    w->ud = ud;
+    w->fd = w->stop[0] = w->stop[1] = w->config_wd = -1;
+
+    struct cinic_doc *doc = NULL;
+    if (!(w->path = strdup(path))){
+        diag->code = CINIC_NOMEM;
+        goto fail;
+    }
+    if (!(doc = Cinic_load(ctx, path, diag))) goto fail;
+
+    int err = 0;
+    if ((w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 || pipe(w->stop)){
+        err = errno;
+    }else{
+        err = watch_arm(w, doc);
+    }
+    if (err){
+        diag->code = (err == ENOMEM) ? CINIC_NOMEM : CINIC_IO;
+        diag->errnum = err;
+        goto fail;
+    }
+
+    if (watch_publish(w, doc)){
+        diag->code = CINIC_NOMEM;
+        goto fail;
+    }
+    doc = NULL;
+    if (pthread_create(&w->thread, NULL, watch_main, w)){
+        diag->code = CINIC_NOMEM;
+        goto fail;
+    }
+    w->started = true;
+    return w;
+
+fail:
+    Cinic_doc_free(doc);
+    watch_destroy(w);
+    return NULL;
+}
+
+#else   /* not __linux__ */
+
+struct cinic_watch *Cinic_watch_new(const struct cinic_ctx *ctx, const char *path, unsigned debounce_ms,
+                                    watch_cb cb, void *ud, struct cinic_diag *diag)
+{
+    UNUSED(ctx);
+    UNUSED(path);
+    UNUSED(debounce_ms);
+    UNUSED(cb);
+    UNUSED(ud);
+    if (diag){
+        memset(diag, 0, sizeof(*diag));
+        diag->code = CINIC_IO;
+        diag->errnum = ENOSYS;
+    }
+    return NULL;
+}
+
+static void watch_destroy(struct cinic_watch *w){
+    UNUSED(w);
+}
+
+#endif
+
+/*
+ * Stop watching and free w; see cinic.h. */
+void Cinic_watch_free(struct cinic_watch *w){
+    if (!w) return;
+
+    assert(!w->current->refs && !w->replaced);
+    watch_destroy(w);
+}
@@ -3,6 +3,12 @@
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>   /* mkdir() */
+#include <time.h>       /* nanosleep() */
+#include <unistd.h>     /* rmdir() */
 
 #include "cinic.h"
 #include "utils__.h"
@@ -11,237 +17,1757 @@ static uint32_t tests_run = 0;
 static uint32_t tests_passed = 0;
 static bool passed = false;
 
+/* default parser context */
+static struct cinic_ctx ctx;
+
+/* true if the string referenced by view v is equal to the string s */
+static bool view_matches(const struct cinic_view *v, const char *s){
+    return (v->len == strlen(s) && !memcmp(v->s, s, v->len));
+}
+
 #define run_test(f, ...) \
     tests_run++; \
     passed = f(__VA_ARGS__); \
     printf(" * test %i %s\n", tests_run, passed ? "PASSED" : "FAILED !!!"); \
     if (passed) tests_passed++;
 
-/* check that lines consisting of only a comment are correctly recognized */
-bool test_comment_line(char *s, bool expected){
-    return (is_comment_line(s) == expected);
+/* check line is classified according to the brackets of the context used */
+bool test_lex_brackets(const char *brackets, const char *line, enum cinic_lexeme_type expected){
+    struct cinic_ctx c;
+    struct cinic_lexeme lx;
+    Cinic_ctx_init(&c, false, false, ".", brackets);
+    lex_line(&c, line, strlen(line), &lx);
+    return (lx.type == expected);
 }
 
-/* check that lines consisting only of whitespace are correctly recognized */
-bool test_empty_line(char *s, bool expected){
-    return (is_empty_line(s) == expected);
-}
+/* check line is lexed into the expected sequence of list tokens, as by
+ * lex_line() then lex_list_token(); expected holds the tokens, each
+ * terminated by '|': "k=" for a list head, "[" and "]" for brackets,
+ * "v," and "v" for list items, and "!" for anything not valid */
+bool test_list_tokens(const char *line, const char *expected){
+    char actual[1024] = {0};
+    size_t len = 0, n = strlen(line);
+    struct cinic_lexeme lx;
 
-/* verify that section names are correctly identified in .ini config files
- * s must be a char array NOT a read only a char pointer, otherwise the program
- * will segfault as is_section will try to MANGLE the string*/
-bool test_section_name(char *str, bool expected, char *expected_name){
-    assert(str);
-    char s[strlen(str)+1];
-    memcpy(s, str, strlen(str));
-    s[strlen(str)] = '\0';
+    lex_line(&ctx, line, n, &lx);
+    while (lx.type != LEX_NONE){
+        const struct cinic_view *v = (lx.type == LEX_LIST_HEAD) ? &lx.k : &lx.v;
+        if (len + v->len + 3 > sizeof(actual)) return false;
 
-    char ret_name[MAX_LINE_LEN] = {0};
-    if (is_section_line(s, ret_name, MAX_LINE_LEN) != expected) return false;
-    if (expected){
-        //printf(" --> '%s'\n", ret_name);
-        return matches(ret_name, expected_name);
+        switch(lx.type){
+        case LEX_LIST_HEAD:
+        case LEX_LIST_ITEM:
+        case LEX_LIST_LAST:
+            memcpy(actual + len, v->s, v->len);
+            len += v->len;
+            if (lx.type == LEX_LIST_HEAD) actual[len++] = '=';
+            if (lx.type == LEX_LIST_ITEM) actual[len++] = ',';
+            break;
+        case LEX_LIST_OPEN:  actual[len++] = '['; break;
+        case LEX_LIST_CLOSE: actual[len++] = ']'; break;
+        default:             actual[len++] = '!'; break;
+        }
+        actual[len++] = '|';
+        if (lx.type == LEX_BAD || lx.type == LEX_SECTION || lx.type == LEX_RECORD) break;
+        lex_list_token(&ctx, line, n, lx.next, &lx);
     }
+    return matches(actual, expected);
+}
+
+/* check line is classified as the expected lexeme type and the key
+ * and value (or NULL, if not expected to be set) are extracted */
+bool test_lex_line(const char *line, enum cinic_lexeme_type expected, const char *expk, const char *expv){
+    struct cinic_lexeme lx;
+    lex_line(&ctx, line, strlen(line), &lx);
+    if (lx.type != expected) return false;
+    if (expk && !view_matches(&lx.k, expk)) return false;
+    if (expv && !view_matches(&lx.v, expv)) return false;
     return true;
 }
 
-bool test_kv_line(char *str, bool expected, char *expk, char *expv){
-    assert(str);
-    char s[strlen(str)+1];
-    memcpy(s, str, strlen(str));
-    s[strlen(str)] = '\0';
+/* number of times count_cb has been called */
+static uint32_t cb_calls = 0;
+
+int count_cb(uint32_t ln, enum cinic_list_state list, const char *section, const char *k, const char *v){
+    UNUSED(ln); UNUSED(list); UNUSED(section); UNUSED(k); UNUSED(v);
+    ++cb_calls;
+    return 0;
+}
+
+/* parse the file at path according to c and check the callback got called
+ * the expected number of times */
+bool test_parse_file(const struct cinic_ctx *c, const char *path, uint32_t expected_calls){
+    cb_calls = 0;
+    if (Cinic_parse_ex(c, path, count_cb, NULL)) return false;
+    return (cb_calls == expected_calls);
+}
+
+/* check every available scan_block_*() agrees with the scalar version on
+ * random blocks, both aligned and not */
+bool test_scan_block(char c, unsigned seed){
+    static const char alphabet[] = "ab =,;#[]\n\t\x80\xff";
+    char buff[SCAN_BLOCK * 2];
 
-    char k[MAX_LINE_LEN] = {0};
-    char v[MAX_LINE_LEN] = {0};
-    if (is_record_line(s, k, v, MAX_LINE_LEN) != expected) return false;
-    if (expected){
-        //printf(" --> k='%s', v='%s'\n", k, v);
-        return ( matches(k, expk) && matches(v, expv));
+    srand(seed);
+    for (unsigned round = 0; round < 1000; ++round){
+        for (size_t i = 0; i < sizeof(buff); ++i){
+            buff[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        const char *blk = buff + round % SCAN_BLOCK;
+        uint64_t expected = scan_block_scalar(blk, c);
+        for (unsigned i = 0; i < SCAN_BLOCK; ++i){
+            if ( ((expected >> i) & 1) != (blk[i] == c) ) return false;
+        }
+#ifdef CINIC_X86_SIMD
+        if (scan_block_sse2(blk, c) != expected) return false;
+        if (__builtin_cpu_supports("avx2") && scan_block_avx2(blk, c) != expected) return false;
+#endif
     }
     return true;
 }
 
-bool test_list_header(char *str, bool expected, char *expected_name){
-    assert(str);
-    char s[strlen(str)+1];
-    memcpy(s, str, strlen(str));
-    s[strlen(str)] = '\0';
+/* callback trace, as recorded by trace_cb */
+static char trace[1 << 16];
+static size_t trace_len = 0;
 
-    char ret_name[MAX_LINE_LEN] = {0};
-    if (is_list_head(s, ret_name, MAX_LINE_LEN) != expected) return false;
-    if (expected){
-        //printf(" --> '%s'\n", ret_name);
-        return matches(ret_name, expected_name);
+int trace_cb(uint32_t ln, enum cinic_list_state list, const char *section, const char *k, const char *v){
+    int n = snprintf(trace + trace_len, sizeof(trace) - trace_len, "%u|%d|%s|%s|%s\n", ln, list, section, k, v);
+    if (n < 0 || (size_t)n >= sizeof(trace) - trace_len) return 1;
+    trace_len += n;
+    return 0;
+}
+
+/* read the whole file at path into a malloc-ed buffer; *len is set to its size */
+static char *slurp(const char *path, size_t *len){
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long sz = ftell(f);
+    rewind(f);
+    char *buff = malloc(sz > 0 ? sz : 1);
+    *len = fread(buff, 1, sz, f);
+    fclose(f);
+    return buff;
+}
+
+/* check parsing the file at path from memory produces exactly the same
+ * callbacks as parsing it from the filesystem */
+bool test_parse_buffer(const struct cinic_ctx *c, const char *path){
+    size_t len = 0;
+    char *data = slurp(path, &len);
+    if (!data) return false;
+
+    trace_len = 0;
+    int rc = Cinic_parse_ex(c, path, trace_cb, NULL);
+    char *expected = strndup(trace, trace_len);
+    trace_len = 0;
+    rc |= Cinic_parse_buffer(c, data, len, trace_cb, NULL);
+
+    bool res = (!rc && strlen(expected) == trace_len && !memcmp(expected, trace, trace_len));
+    free(expected);
+    free(data);
+    return res;
+}
+
+/* event trace, built by event_cb in the buffer given as user pointer */
+struct event_trace{
+    char s[1024];
+    size_t len;
+};
+
+int event_cb(void *ud, enum cinic_event ev, uint32_t ln, enum cinic_list_state list, const char *k, const char *v){
+    struct event_trace *t = ud;
+    UNUSED(list);
+    int n = snprintf(t->s + t->len, sizeof(t->s) - t->len, "%u:%d:%s=%s ", ln, ev, k, v ? v : "-");
+    if (n < 0 || (size_t)n >= sizeof(t->s) - t->len) return 1;
+    t->len += n;
+    return 0;
+}
+
+/* check parsing text with an event callback reports exactly the
+ * expected events, from memory and from a file */
+bool test_parse_events(const struct cinic_ctx *c, const char *text, const char *expected){
+    struct event_trace t = {0};
+    if (Cinic_parse_buffer_events(c, text, strlen(text), event_cb, &t, NULL)) return false;
+    if (!matches(t.s, expected)) return false;
+
+    const char *path = "out/tests_events.ini";
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+    fputs(text, f);
+    fclose(f);
+
+    memset(&t, 0, sizeof(t));
+    int rc = Cinic_parse_events(c, path, event_cb, &t, NULL);
+    remove(path);
+    return !rc && matches(t.s, expected);
+}
+
+#define VIEW_THREADS 4
+
+/* callback trace, as recorded by view_cb in the buffer given as user
+ * pointer, in the same format as trace_cb */
+struct view_trace{
+    const struct cinic_ctx *ctx;
+    const char *path;
+    char s[1 << 16];
+    size_t len;
+    int rc;
+};
+
+int view_cb(void *ud, uint32_t ln, enum cinic_list_state list, const struct cinic_view *section, const struct cinic_view *k, const struct cinic_view *v){
+    struct view_trace *t = ud;
+    int n = snprintf(t->s + t->len, sizeof(t->s) - t->len, "%u|%d|%.*s|%.*s|%.*s\n", ln, list,
+                     (int)section->len, section->s, (int)k->len, k->s, (int)v->len, v->s);
+    if (n < 0 || (size_t)n >= sizeof(t->s) - t->len) return 1;
+    t->len += n;
+    return 0;
+}
+
+static void *view_worker(void *arg){
+    struct view_trace *t = arg;
+    t->rc = Cinic_parse_views(t->ctx, t->path, view_cb, t, NULL);
+    return NULL;
+}
+
+/* check nthreads threads parsing the file at path at the same time
+ * with a view callback, each into its own trace, get exactly the same
+ * callbacks as a config_cb does, and so does parsing it from memory */
+bool test_parse_views(const struct cinic_ctx *c, const char *path, int nthreads){
+    static struct view_trace t[VIEW_THREADS];
+    pthread_t tid[VIEW_THREADS];
+    bool res = true;
+
+    trace_len = 0;
+    if (Cinic_parse_ex(c, path, trace_cb, NULL)) return false;
+
+    assert(nthreads <= VIEW_THREADS);
+    for (int i = 0; i < nthreads; ++i){
+        t[i] = (struct view_trace){ .ctx = c, .path = path };
+        if (pthread_create(&tid[i], NULL, view_worker, &t[i])) return false;
     }
-    return true;
+    for (int i = 0; i < nthreads; ++i){
+        pthread_join(tid[i], NULL);
+    }
+    for (int i = 0; i < nthreads && res; ++i){
+        res = (!t[i].rc && t[i].len == trace_len && !memcmp(t[i].s, trace, trace_len));
+    }
+
+    size_t len = 0;
+    char *data = slurp(path, &len);
+    if (!data) return false;
+    t[0].len = 0;
+    res = res && !Cinic_parse_buffer_views(c, data, len, view_cb, &t[0], NULL);
+    res = res && t[0].len == trace_len && !memcmp(t[0].s, trace, trace_len);
+    free(data);
+    return res;
+}
+
+/* digest of the events of a parse, as built by digest_cb in the
+ * struct given as user pointer; the callback aborts on its stop-th
+ * call, unless stop is 0 */
+struct event_digest{
+    uint32_t hash;
+    uint64_t n;
+    uint64_t stop;
+};
+
+int digest_cb(void *ud, enum cinic_event ev, uint32_t ln, enum cinic_list_state list, const char *k, const char *v){
+    struct event_digest *d = ud;
+    char s[32];
+    int n = snprintf(s, sizeof(s), "%u|%d|%d|", ln, ev, list);
+    d->hash = str_hash_more(d->hash, s, n);
+    d->hash = str_hash_more(d->hash, k, strlen(k) + 1);
+    if (v) d->hash = str_hash_more(d->hash, v, strlen(v) + 1);
+    return (++d->n == d->stop);
+}
+
+/* check parsing with nthreads threads calls the callback exactly the
+ * same way, and ends the same way, as parsing with one. The config is
+ * the file at path repeated until PARALLEL_SIZE bytes long, with extra,
+ * if not NULL, inserted half way through; the callback aborts on its
+ * stop-th call, unless stop is 0 */
+#define PARALLEL_SIZE (6U << 20)
+
+bool test_parse_parallel(const struct cinic_ctx *c, const char *path, const char *extra, uint64_t stop, unsigned nthreads){
+    size_t sz = 0;
+    char *file = slurp(path, &sz);
+    if (!file || !sz) return false;
+
+    /* each copy starting on a new line */
+    size_t xlen = extra ? strlen(extra) : 0, len = 0;
+    char *data = malloc(PARALLEL_SIZE + sz + xlen + 1);
+    if (!data) return false;
+    while (len < PARALLEL_SIZE){
+        if (extra && len >= PARALLEL_SIZE / 2){
+            memcpy(data + len, extra, xlen);
+            len += xlen;
+            extra = NULL;
+        }
+        memcpy(data + len, file, sz);
+        len += sz;
+        if (data[len-1] != '\n') data[len++] = '\n';
+    }
+    free(file);
+
+    struct cinic_ctx par = *c;
+    struct event_digest d[2] = { {.stop = stop}, {.stop = stop} };
+    struct cinic_diag diag[2];
+    par.threads = 1;
+    int rc = Cinic_parse_buffer_events(&par, data, len, digest_cb, &d[0], &diag[0]);
+    par.threads = nthreads;
+    int par_rc = Cinic_parse_buffer_events(&par, data, len, digest_cb, &d[1], &diag[1]);
+    free(data);
+
+    bool res = (rc == par_rc && d[0].n == d[1].n && d[0].hash == d[1].hash);
+    res = res && diag[0].code == diag[1].code && diag[0].ln == diag[1].ln && diag[0].col == diag[1].col;
+    return res && (rc || d[0].n > 1000);
+}
+
+/* check parsing text fails with the expected error, at the expected place */
+bool test_parse_error(const struct cinic_ctx *c, const char *text, enum cinic_error code, uint32_t ln, uint32_t col){
+    struct cinic_diag diag;
+    cb_calls = 0;
+    int rc = Cinic_parse_buffer(c, text, strlen(text), count_cb, &diag);
+    return (rc == -1 && diag.code == code && diag.ln == ln && diag.col == col);
+}
+
+/* check the value returned by the callback is handed back and the
+ * line it was called on is recorded */
+int abort_cb(uint32_t ln, enum cinic_list_state list, const char *section, const char *k, const char *v){
+    UNUSED(list); UNUSED(section); UNUSED(k); UNUSED(v);
+    return (ln == 3) ? 42 : 0;
+}
+
+bool test_parse_abort(const char *text, uint32_t ln){
+    struct cinic_diag diag;
+    int rc = Cinic_parse_buffer(&ctx, text, strlen(text), abort_cb, &diag);
+    return (rc == 42 && diag.code == CINIC_ABORTED && diag.ln == ln);
+}
+
+/* check a file that cannot be read is reported as an IO error */
+bool test_parse_io_error(const char *path, int errnum){
+    struct cinic_diag diag;
+    int rc = Cinic_parse_ex(&ctx, path, count_cb, &diag);
+    return (rc == -1 && diag.code == CINIC_IO && diag.errnum == errnum);
+}
+
+/* check linting text finds the expected errors; expected holds
+ * "ln:col:code" for each, in order, each terminated by ' ' */
+bool test_lint(const char *text, const char *expected){
+    struct cinic_diag *diags = NULL;
+    size_t ndiags = 0;
+    char found[1024] = {0};
+    size_t len = 0;
+
+    if (Cinic_lint_buffer(&ctx, text, strlen(text), &diags, &ndiags)) return false;
+    for (size_t i = 0; i < ndiags && len < sizeof(found); ++i){
+        len += snprintf(found + len, sizeof(found) - len, "%u:%u:%d ",
+                diags[i].ln, diags[i].col, diags[i].code);
+    }
+    free(diags);
+    return matches(found, expected);
+}
+
+/* check linting a file that cannot be read */
+bool test_lint_io_error(const char *path){
+    struct cinic_diag *diags = NULL;
+    size_t ndiags = 0;
+    int rc = Cinic_lint(&ctx, path, &diags, &ndiags);
+    bool res = (rc == -1 && ndiags == 1 && diags[0].code == CINIC_IO);
+    free(diags);
+    return res;
+}
+
+/* check n allocations of size bytes each from an arena are aligned,
+ * do not overlap and keep their contents */
+bool test_arena(size_t n, size_t size){
+    struct cinic_arena *a = Cinic_arena_new();
+    unsigned char **p = calloc(n, sizeof(*p));
+    bool res = (a && p);
+
+    for (size_t i = 0; res && i < n; ++i){
+        p[i] = Cinic_arena_alloc(a, size);
+        res = (p[i] && !((uintptr_t)p[i] % sizeof(void *)));
+        if (res) memset(p[i], (int)(i & 0xff), size);
+    }
+    for (size_t i = 0; res && i < n; ++i){
+        for (size_t j = 0; j < size && res; ++j) res = (p[i][j] == (i & 0xff));
+    }
+    char *s = res ? Cinic_arena_strdup(a, "some string") : NULL;
+    res = res && s && !strcmp(s, "some string");
+
+    free(p);
+    Cinic_arena_free(a);
+    return res;
+}
+
+/* check interning n distinct strings, twice, gives one pointer for
+ * each, equal to the string */
+bool test_intern(size_t n){
+    struct cinic_intern *t = Cinic_intern_new();
+    const char **p = calloc(n, sizeof(*p));
+    char s[32];
+    bool res = (t && p);
+
+    for (size_t i = 0; res && i < n; ++i){
+        snprintf(s, sizeof(s), "key%zu", i);
+        res = ( (p[i] = Cinic_intern(t, s)) && p[i] != s && !strcmp(p[i], s));
+    }
+    for (size_t i = 0; res && i < n; ++i){
+        snprintf(s, sizeof(s), "key%zu", i);
+        res = (Cinic_intern(t, s) == p[i]);
+    }
+    free(p);
+    Cinic_intern_free(t);
+    return res;
+}
+
+/* check nthreads threads interning the same strings at the same time
+ * all get the same pointers */
+#define INTERN_THREADS 8
+#define INTERN_STRINGS 2000
+
+static struct cinic_intern *shared_intern;
+
+static void *intern_worker(void *arg){
+    const char **p = arg;
+    char s[32];
+    for (size_t i = 0; i < INTERN_STRINGS; ++i){
+        snprintf(s, sizeof(s), "section.%zu", i);
+        p[i] = Cinic_intern(shared_intern, s);
+    }
+    return NULL;
+}
+
+bool test_intern_threads(int nthreads){
+    static const char *p[INTERN_THREADS][INTERN_STRINGS];
+    pthread_t tid[INTERN_THREADS];
+    bool res = true;
+
+    if (!(shared_intern = Cinic_intern_new())) return false;
+    assert(nthreads <= INTERN_THREADS);
+    for (int i = 0; i < nthreads; ++i){
+        if (pthread_create(&tid[i], NULL, intern_worker, p[i])) return false;
+    }
+    for (int i = 0; i < nthreads; ++i){
+        pthread_join(tid[i], NULL);
+    }
+    for (int i = 0; i < nthreads; ++i){
+        for (size_t j = 0; j < INTERN_STRINGS && res; ++j){
+            res = (p[i][j] && p[i][j] == p[0][j]);
+        }
+    }
+    Cinic_intern_free(shared_intern);
+    return res;
+}
+
+/* check key in section of the document loaded from text has value
+ * expected (NULL if there should be no such record) */
+bool test_doc_get(const struct cinic_ctx *c, const char *text, const char *section, const char *key, const char *expected){
+    struct cinic_doc *doc = Cinic_load_buffer(c, text, strlen(text), NULL);
+    if (!doc) return false;
+    const char *v = Cinic_get(doc, section, key);
+    bool res = expected ? (v && !strcmp(v, expected)) : !v;
+    Cinic_doc_free(doc);
+    return res;
+}
+
+/* check whether the document loaded from text has section */
+bool test_doc_section(const struct cinic_ctx *c, const char *text, const char *section, bool expected){
+    struct cinic_doc *doc = Cinic_load_buffer(c, text, strlen(text), NULL);
+    if (!doc) return false;
+    bool res = (Cinic_has_section(doc, section) == expected);
+    Cinic_doc_free(doc);
+    return res;
+}
+
+/* check list key in section of the document loaded from the file at
+ * path holds the expected items, each terminated by '|'; expected is
+ * NULL if there should be no such list */
+bool test_doc_list(const struct cinic_ctx *c, const char *path, const char *section, const char *key, const char *expected){
+    char found[1024] = {0};
+    size_t len = 0, nitems = 0;
+
+    struct cinic_doc *doc = Cinic_load(c, path, NULL);
+    if (!doc) return false;
+    const char *const *items = Cinic_get_list(doc, section, key, &nitems);
+    for (size_t i = 0; items && i < nitems && len < sizeof(found); ++i){
+        len += snprintf(found + len, sizeof(found) - len, "%s|", items[i]);
+    }
+    Cinic_doc_free(doc);
+    return expected ? (items && matches(found, expected)) : !items;
+}
+
+/* check every record parsed from the file at path can be looked up in
+ * the document loaded from it */
+static struct cinic_doc *lookup_doc;
+
+int lookup_cb(uint32_t ln, enum cinic_list_state list, const char *section, const char *k, const char *v){
+    UNUSED(ln);
+    if (list != NOLIST) return 0;
+    const char *found = Cinic_get(lookup_doc, section, k);
+    return (found && !strcmp(found, v)) ? 0 : 1;
+}
+
+bool test_doc_lookups(const struct cinic_ctx *c, const char *path){
+    if (!(lookup_doc = Cinic_load(c, path, NULL))) return false;
+    int rc = Cinic_parse_ex(c, path, lookup_cb, NULL);
+    Cinic_doc_free(lookup_doc);
+    return !rc;
+}
+
+/* check n records spread over a few sections can all be found */
+bool test_doc_many(size_t n){
+    size_t cap = 64 * n + 64, len = 0;
+    char *text = calloc(cap, 1);
+    char s[32], k[32], v[32];
+    bool res = true;
+    if (!text) return false;
+
+    for (size_t i = 0; i < n; ++i){
+        if (!(i % 100)) len += snprintf(text + len, cap - len, "[s%zu]\n", i / 100);
+        len += snprintf(text + len, cap - len, "k%zu = v%zu\n", i, i);
+    }
+    struct cinic_doc *doc = Cinic_load_buffer(&ctx, text, len, NULL);
+    for (size_t i = 0; doc && i < n && res; ++i){
+        snprintf(s, sizeof(s), "s%zu", i / 100);
+        snprintf(k, sizeof(k), "k%zu", i);
+        snprintf(v, sizeof(v), "v%zu", i);
+        const char *found = Cinic_get(doc, s, k);
+        res = (found && !strcmp(found, v) && !Cinic_get(doc, "s", k));
+    }
+    res = res && doc;
+    Cinic_doc_free(doc);
+    free(text);
+    return res;
+}
+
+/* check loading an invalid config fails like parsing it does */
+bool test_doc_error(const char *text, enum cinic_error code, uint32_t ln){
+    struct cinic_diag diag;
+    struct cinic_doc *doc = Cinic_load_buffer(&ctx, text, strlen(text), &diag);
+    Cinic_doc_free(doc);
+    return (!doc && diag.code == code && diag.ln == ln);
+}
+
+/* check every record and list item parsed from the file at path is
+ * found in the snapshot compiled from it */
+#define SNAPSHOT_PATH "out/tests.cinicb"
+
+static struct cinic_snapshot *lookup_snap;
+static char last_list[64];
+static size_t list_idx;
+
+int snapshot_cb(uint32_t ln, enum cinic_list_state list, const char *section, const char *k, const char *v){
+    UNUSED(ln);
+    if (list == NOLIST){
+        const char *found = Cinic_snapshot_get(lookup_snap, section, k);
+        return (found && !strcmp(found, v)) ? 0 : 1;
+    }
+
+    /* item number list_idx of list k */
+    char key[64];
+    snprintf(key, sizeof(key), "%s/%s", section, k);
+    if (strcmp(key, last_list)){
+        strcpy(last_list, key);
+        list_idx = 0;
+    }
+    const char *items[64];
+    size_t n = 64;
+    if (!Cinic_snapshot_get_list(lookup_snap, section, k, items, &n) || list_idx >= n) return 1;
+    return strcmp(items[list_idx++], v) ? 1 : 0;
+}
+
+bool test_snapshot_lookups(const struct cinic_ctx *c, const char *path){
+    if (Cinic_compile(c, path, SNAPSHOT_PATH, NULL)) return false;
+    if (!(lookup_snap = Cinic_snapshot_open(SNAPSHOT_PATH, NULL))) return false;
+    last_list[0] = '\0';
+    int rc = Cinic_parse_ex(c, path, snapshot_cb, NULL);
+    Cinic_snapshot_close(lookup_snap);
+    return !rc;
+}
+
+/* write the string text to the file at path */
+static bool spit(const char *path, const char *text){
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+    bool res = (fwrite(text, 1, strlen(text), f) == strlen(text));
+    return !fclose(f) && res;
+}
+
+/* check a snapshot of text goes stale when the config changes to changed */
+bool test_snapshot_stale(const char *text, const char *changed){
+    const char *ini = "out/tests.ini";
+    if (!spit(ini, text) || Cinic_compile(&ctx, ini, SNAPSHOT_PATH, NULL)) return false;
+
+    struct cinic_snapshot *snap = Cinic_snapshot_open(SNAPSHOT_PATH, NULL);
+    if (!snap) return false;
+    bool res = (Cinic_snapshot_stale(snap, ini) == 0);
+    res = res && spit(ini, changed) && Cinic_snapshot_stale(snap, ini) == 1;
+    res = res && Cinic_snapshot_stale(snap, "out/does_not_exist.ini") == -1;
+    Cinic_snapshot_close(snap);
+    return res;
+}
+
+/* check opening the first len bytes of a valid snapshot (or the whole
+ * of it, if len is 0) with the byte at offset corrupt xor-ed with 0xff
+ * (none if 0) fails with code, or succeeds if code is CINIC_SUCCESS */
+bool test_snapshot_open(size_t len, size_t corrupt, enum cinic_error code){
+    if (Cinic_compile(&ctx, "samples/nested.ini", SNAPSHOT_PATH, NULL)) return false;
+
+    size_t size = 0;
+    char *img = slurp(SNAPSHOT_PATH, &size);
+    if (!img) return false;
+    if (!len || len > size) len = size;
+    if (corrupt && corrupt < len) img[corrupt] ^= 0xff;
+
+    FILE *f = fopen(SNAPSHOT_PATH, "w");
+    bool res = f && fwrite(img, 1, len, f) == len;
+    if (f) res = !fclose(f) && res;
+    free(img);
+
+    struct cinic_diag diag;
+    struct cinic_snapshot *snap = Cinic_snapshot_open(SNAPSHOT_PATH, &diag);
+    Cinic_snapshot_close(snap);
+    return res && (code == CINIC_SUCCESS ? snap != NULL : (!snap && diag.code == code));
+}
+
+/* check compiling text fails like parsing it does */
+bool test_compile_error(const char *text, enum cinic_error code, uint32_t ln){
+    const char *ini = "out/tests.ini";
+    struct cinic_diag diag;
+    if (!spit(ini, text)) return false;
+    return (Cinic_compile(&ctx, ini, SNAPSHOT_PATH, &diag) == -1 && diag.code == code && diag.ln == ln);
+}
+
+/* check a record with a value n bytes long is parsed whole, with
+ * lines limited to max bytes (0 for no limit) */
+static size_t longest_value = 0;
+
+int longest_cb(uint32_t ln, enum cinic_list_state list, const char *section, const char *k, const char *v){
+    UNUSED(ln); UNUSED(list); UNUSED(section); UNUSED(k);
+    if (strlen(v) > longest_value) longest_value = strlen(v);
+    return 0;
+}
+
+bool test_long_line(size_t n, size_t max, int expected){
+    struct cinic_ctx c;
+    Cinic_ctx_init(&c, false, false, ".", NULL);
+    c.max_line_len = max;
+
+    char *text = malloc(n + 32);
+    if (!text) return false;
+    int len = sprintf(text, "[s]\nk = ");
+    memset(text + len, 'v', n);
+    strcpy(text + len + n, "\nl = [a, b]\n");
+
+    longest_value = 0;
+    int rc = Cinic_parse_buffer(&c, text, strlen(text), longest_cb, NULL);
+    free(text);
+    return (rc == expected && (rc || longest_value == n));
+}
+
+/* check loading nfiles files with nthreads threads gets each its own
+ * document, or the error it has: every bad_every-th file (none, if 0)
+ * has an entry without a section, and one more does not exist */
+#define MANY_FILES 64
+
+bool test_load_many(const struct cinic_ctx *c, unsigned nthreads, size_t nfiles, size_t bad_every){
+    static char names[MANY_FILES + 1][32];
+    const char *paths[MANY_FILES + 1];
+    struct cinic_doc *docs[MANY_FILES + 1];
+    struct cinic_diag diags[MANY_FILES + 1];
+    char text[64];
+    size_t bad = 0;
+    assert(nfiles <= MANY_FILES);
+
+    for (size_t i = 0; i < nfiles; ++i){
+        bool valid = !bad_every || (i + 1) % bad_every;
+        snprintf(names[i], sizeof(names[i]), "out/many%zu.ini", i);
+        snprintf(text, sizeof(text), "%sk = %zu\n", valid ? "[s]\n" : "", i);
+        if (!spit(names[i], text)) return false;
+        paths[i] = names[i];
+        bad += !valid;
+    }
+    paths[nfiles] = "out/does_not_exist.ini";
+
+    struct cinic_ctx par = *c;
+    par.threads = nthreads;
+    size_t failed = Cinic_load_many(&par, paths, nfiles + 1, docs, diags);
+
+    bool res = (failed == bad + 1);
+    for (size_t i = 0; i <= nfiles; ++i){
+        if (i == nfiles){
+            res = res && !docs[i] && diags[i].code == CINIC_IO && diags[i].errnum == ENOENT;
+        }else if (bad_every && !((i + 1) % bad_every)){
+            res = res && !docs[i] && diags[i].code == CINIC_NOSECTION && diags[i].ln == 1;
+        }else{
+            const char *v = docs[i] ? Cinic_get(docs[i], "s", "k") : NULL;
+            res = res && v && (size_t)atoi(v) == i;
+        }
+        Cinic_doc_free(docs[i]);
+    }
+    return res;
+}
+
+/* check the document cache hands back the same document for a file
+ * that has not changed, and a new one, with the new contents, for one
+ * that has; text and changed must differ in length */
+bool test_cache_changed(const char *text, const char *changed){
+    const char *ini = "out/tests.ini";
+    uint64_t hits = 0, misses = 0;
+    if (!spit(ini, text)) return false;
+
+    struct cinic_cache *cache = Cinic_cache_new(&ctx, 0, 0);
+    if (!cache) return false;
+    const struct cinic_doc *a = Cinic_cache_get(cache, ini, NULL);
+    const struct cinic_doc *b = Cinic_cache_get(cache, ini, NULL);
+    bool res = a && a == b;
+    if (b) Cinic_cache_release(cache, b);
+
+    res = res && spit(ini, changed);
+    b = Cinic_cache_get(cache, ini, NULL);
+    res = res && b && b != a && Cinic_get(a, "s", "k") && !strcmp(Cinic_get(a, "s", "k"), "v");
+    res = res && Cinic_get(b, "s", "k") && !strcmp(Cinic_get(b, "s", "k"), "w");
+    Cinic_cache_stats(cache, &hits, &misses);
+    if (a) Cinic_cache_release(cache, a);
+    if (b) Cinic_cache_release(cache, b);
+
+    struct cinic_diag diag;
+    res = res && !Cinic_cache_get(cache, "out/does_not_exist.ini", &diag) && diag.code == CINIC_IO;
+    Cinic_cache_free(cache);
+    return res && hits == 1 && misses == 2;
+}
+
+/* check the document cache keeps to at most max_docs documents of at
+ * most max_bytes bytes in all, dropping the least recently used, and
+ * that documents still in use stay valid when dropped; nfiles files
+ * are loaded round-robin, twice over */
+#define CACHE_FILE_SIZE (sizeof("[s]\nk = 0\n") - 1)
+
+bool test_cache_bounds(unsigned nfiles, size_t max_docs, size_t max_bytes){
+    char path[64], text[64];
+    const struct cinic_doc *docs[32];
+    uint64_t hits = 0, misses = 0;
+    assert(nfiles <= 32);
+
+    struct cinic_cache *cache = Cinic_cache_new(&ctx, max_docs, max_bytes);
+    if (!cache) return false;
+
+    bool res = true;
+    for (unsigned i = 0; i < 2 * nfiles; ++i){
+        snprintf(path, sizeof(path), "out/tests%u.ini", i % nfiles);
+        snprintf(text, sizeof(text), "[s]\nk = %u\n", i % nfiles);
+        if (i < nfiles && !spit(path, text)) res = false;
+
+        const struct cinic_doc *doc = Cinic_cache_get(cache, path, NULL);
+        const char *v = doc ? Cinic_get(doc, "s", "k") : NULL;
+        res = res && v && (unsigned)atoi(v) == i % nfiles;
+
+        /* hold on to the first round, so that dropped documents are in use */
+        if (i < nfiles) docs[i] = doc;
+        else if (doc) Cinic_cache_release(cache, doc);
+    }
+    for (unsigned i = 0; i < nfiles; ++i){
+        const char *v = docs[i] ? Cinic_get(docs[i], "s", "k") : NULL;
+        res = res && v && (unsigned)atoi(v) == i;
+        if (docs[i]) Cinic_cache_release(cache, docs[i]);
+    }
+
+    /* every file fits: all of the second round are hits; otherwise, the
+     * round-robin order means none of them are */
+    size_t fits = nfiles;
+    if (max_docs && max_docs < fits) fits = max_docs;
+    if (max_bytes && max_bytes / CACHE_FILE_SIZE < fits) fits = max_bytes / CACHE_FILE_SIZE;
+    Cinic_cache_stats(cache, &hits, &misses);
+    Cinic_cache_free(cache);
+    return res && hits == (fits == nfiles ? nfiles : 0) && misses == 2 * nfiles - hits;
+}
+
+/* check the document cache can be used from several threads at once:
+ * each thread loads the sample files over and over, with a cache too
+ * small to keep them all, so that documents keep being dropped while
+ * in use by other threads */
+#define CACHE_THREADS 4
+#define CACHE_ROUNDS  200
+
+static struct cinic_cache *shared_cache;
+static const char *cache_samples[] = {
+    "samples/flat.ini", "samples/nested.ini", "samples/lists.ini", "samples/empty.ini"
+};
+
+static void *cache_worker(void *arg){
+    bool *ok = arg;
+    size_t n = sizeof(cache_samples) / sizeof(*cache_samples);
+    *ok = true;
+    for (size_t i = 0; i < CACHE_ROUNDS; ++i){
+        const struct cinic_doc *doc = Cinic_cache_get(shared_cache, cache_samples[i % n], NULL);
+        if (!doc){
+            *ok = false;
+            continue;
+        }
+        *ok = *ok && Cinic_has_section(doc, NULL);
+        Cinic_cache_release(shared_cache, doc);
+    }
+    return NULL;
+}
+
+bool test_cache_threads(int nthreads){
+    pthread_t tid[CACHE_THREADS];
+    bool ok[CACHE_THREADS];
+    bool res = true;
+
+    if (!(shared_cache = Cinic_cache_new(&ctx, 2, 0))) return false;
+    assert(nthreads <= CACHE_THREADS);
+    for (int i = 0; i < nthreads; ++i){
+        if (pthread_create(&tid[i], NULL, cache_worker, &ok[i])) return false;
+    }
+    for (int i = 0; i < nthreads; ++i){
+        pthread_join(tid[i], NULL);
+        res = res && ok[i];
+    }
+    Cinic_cache_free(shared_cache);
+    return res;
+}
+
+/* check a document dropped from the cache explicitly is loaded afresh,
+ * even though its file has not changed; path NULL drops all of them */
+bool test_cache_invalidate(const char *path){
+    uint64_t hits = 0, misses = 0;
+    struct cinic_cache *cache = Cinic_cache_new(&ctx, 0, 0);
+    if (!cache) return false;
+
+    const struct cinic_doc *a = Cinic_cache_get(cache, "samples/flat.ini", NULL);
+    if (a) Cinic_cache_release(cache, a);
+    Cinic_cache_invalidate(cache, path);
+    const struct cinic_doc *b = Cinic_cache_get(cache, "samples/flat.ini", NULL);
+    if (b) Cinic_cache_release(cache, b);
+
+    Cinic_cache_stats(cache, &hits, &misses);
+    Cinic_cache_free(cache);
+    bool dropped = !path || !strcmp(path, "samples/flat.ini");
+    return a && b && hits == !dropped && misses == 1u + dropped;
+}
+
+/* files for the include tests below to include, made once */
+#define INC "out/inc/"
+
+static bool make_include_files(void){
+    static bool made = false;
+    static const char *files[][2] = {
+        { INC "a.ini",            "k = a\n[a]\nx = 1\n" },
+        { INC "b.ini",            "include = a.ini\n[b]\ny = 2\n" },
+        { INC "self.ini",         "include = self.ini\n" },
+        { INC "loop1.ini",        "include = loop2.ini\n" },
+        { INC "loop2.ini",        "[l]\ninclude = loop1.ini\n" },
+        { INC "bad.ini",          "[t]\nk = v\n$ = w\n" },
+        { INC "d.ini",            "[s]\ninclude_dir = conf.d\nafter = 1\n" },
+        { INC "conf.d/10-x.ini",  "[x]\nk = 10\n" },
+        { INC "conf.d/20-x.ini",  "[x]\nk = 20\n" },
+        { INC "conf.d/notes.txt", "not = included\n" },
+    };
+    if (made) return true;
+
+    mkdir(INC, 0755);
+    mkdir(INC "conf.d", 0755);
+    for (size_t i = 0; i < sizeof(files) / sizeof(*files); ++i){
+        if (!spit(files[i][0], files[i][1])) return false;
+    }
+    return (made = true);
 }
 
-bool test_list_end(char *str, bool expected){
-    char rwstr[MAX_LINE_LEN] = {0};
-    strncpy(rwstr, str, MAX_LINE_LEN-1);
-    return (is_list_end(rwstr) == expected);
+/* check parsing text, with includes followed if follow, reports exactly
+ * the expected events; see test_parse_events() */
+bool test_include(const struct cinic_ctx *c, bool follow, const char *text, const char *expected){
+    struct event_trace t = {0};
+    struct cinic_ctx inc = *c;
+    inc.includes = follow;
+    if (!make_include_files()) return false;
+    if (Cinic_parse_buffer_events(&inc, text, strlen(text), event_cb, &t, NULL)) return false;
+    return matches(t.s, expected);
 }
 
-bool test_list_start(char *str, bool expected){
-    char rwstr[MAX_LINE_LEN] = {0};
-    strncpy(rwstr, str, MAX_LINE_LEN-1);
-    return (is_list_start(rwstr) == expected);
+/* check parsing text with includes followed fails with code, at line
+ * ln of the file at path ("" for text itself) */
+bool test_include_error(const char *text, enum cinic_error code, const char *path, uint32_t ln){
+    struct cinic_diag diag;
+    struct cinic_ctx inc = ctx;
+    inc.includes = true;
+    if (!make_include_files()) return false;
+    int rc = Cinic_parse_buffer(&inc, text, strlen(text), count_cb, &diag);
+    return (rc == -1 && diag.code == code && diag.ln == ln && !strcmp(diag.file, path));
 }
 
-bool test_list_entry(char *str, bool expected, bool islast, char *expv){
-    assert(str);
-    char s[strlen(str)+1];
-    memcpy(s, str, strlen(str));
-    s[strlen(str)] = '\0';
+/* check a document loaded with includes has them all merged in, and
+ * that a cached one is loaded again when an included file changes, or
+ * files come or go in an included directory */
+bool test_include_doc(const struct cinic_ctx *c){
+    struct cinic_ctx inc = *c;
+    inc.includes = true;
+    if (!make_include_files()) return false;
 
-    char v[MAX_LINE_LEN] = {0};
-    bool last = false;
-    if (is_list_entry(s, v, MAX_LINE_LEN, &last) != expected) return false;
-    if (expected && last != islast) return false;
+    struct cinic_doc *doc = Cinic_load(&inc, INC "d.ini", NULL);
+    const char *k = doc ? Cinic_get(doc, "x", "k") : NULL;
+    const char *after = doc ? Cinic_get(doc, "s", "after") : NULL;
+    bool res = k && !strcmp(k, "20") && after && !strcmp(after, "1") && !Cinic_get(doc, "x", "after");
+    Cinic_doc_free(doc);
 
-    if (expected){
-        //printf(" --> i='%s', islast='%d'\n", v, islast);
-        return ( matches(v, expv) );
+    uint64_t hits = 0, misses = 0;
+    struct cinic_cache *cache = Cinic_cache_new(&inc, 0, 0);
+    if (!cache) return false;
+    const char *steps[][2] = {
+        { NULL, "20" },                                             /* miss */
+        { NULL, "20" },                                             /* hit */
+        { INC "conf.d/20-x.ini", "[x]\nk = 200\n" },              /* miss */
+        { INC "conf.d/30-x.ini", "[x]\nk = 30\n" },               /* miss */
+    };
+    for (size_t i = 0; i < sizeof(steps) / sizeof(*steps); ++i){
+        if (steps[i][0] && !spit(steps[i][0], steps[i][1])) res = false;
+        const char *want = steps[i][0] ? strchr(steps[i][1], '=') + 2 : steps[i][1];
+        const struct cinic_doc *d = Cinic_cache_get(cache, INC "d.ini", NULL);
+        k = d ? Cinic_get(d, "x", "k") : NULL;
+        res = res && k && !strncmp(k, want, strlen(k)) && strlen(k) == strcspn(want, "\n");
+        if (d) Cinic_cache_release(cache, d);
+    }
+    Cinic_cache_stats(cache, &hits, &misses);
+    Cinic_cache_free(cache);
+
+    /* as they were, for other tests */
+    remove(INC "conf.d/30-x.ini");
+    res = spit(INC "conf.d/20-x.ini", "[x]\nk = 20\n") && res;
+    return res && hits == 1 && misses == 3;
+}
+
+/* check a snapshot of a config with includes has them merged in, with
+ * relative ones found next to the config, and goes stale when an
+ * included file changes */
+bool test_include_snapshot(const struct cinic_ctx *c){
+    struct cinic_ctx inc = *c;
+    inc.includes = true;
+    if (!make_include_files() || Cinic_compile(&inc, INC "b.ini", SNAPSHOT_PATH, NULL)) return false;
+
+    struct cinic_snapshot *snap = Cinic_snapshot_open(SNAPSHOT_PATH, NULL);
+    if (!snap) return false;
+    const char *x = Cinic_snapshot_get(snap, "a", "x");
+    bool res = x && !strcmp(x, "1") && Cinic_snapshot_stale(snap, INC "b.ini") == 0;
+    res = spit(INC "a.ini", "k = a\n[a]\nx = 10\n") && res;
+    res = res && Cinic_snapshot_stale(snap, INC "b.ini") == 1;
+    Cinic_snapshot_close(snap);
+
+    /* as it was, for other tests */
+    return spit(INC "a.ini", "k = a\n[a]\nx = 1\n") && res;
+}
+
+/* true if documents a and b have the same entries and sections */
+static bool docs_same(const struct cinic_doc *a, const struct cinic_doc *b){
+    if (a->nentries != b->nentries || a->nsections != b->nsections) return false;
+
+    for (size_t e = 0; e < a->nentries; ++e){
+        const struct doc_entry *x = &a->entries[e];
+        size_t n;
+        if (x->kind == DOC_RECORD){
+            const char *v = Cinic_get(b, x->section, x->key);
+            if (!v || strcmp(v, x->value)) return false;
+            continue;
+        }
+        const char *const *items = Cinic_get_list(b, x->section, x->key, &n);
+        if (!items || n != x->nitems) return false;
+        for (size_t i = 0; i < n; ++i){
+            if (strcmp(items[i], a->items[x->first + i])) return false;
+        }
+    }
+
+    for (size_t i = 0; i < a->sections_cap; ++i){
+        char title[64];
+        const struct doc_section *sect = &a->sections[i];
+        if (!sect->title || sect->len >= sizeof(title)) continue;
+        memcpy(title, sect->title, sect->len);
+        title[sect->len] = '\0';
+        if (!Cinic_has_section(b, title)) return false;
     }
     return true;
 }
 
+/* reparse doc to text, writing the changes reported to s as
+ * "<+|-|~>section[/key] ..." */
+static bool reparse_trace(const struct cinic_ctx *c, struct cinic_doc *doc, const char *text, char *s, size_t size){
+    struct cinic_change *changes;
+    size_t n;
+    if (Cinic_reparse(c, doc, text, strlen(text), &changes, &n, NULL)) return false;
+
+    *s = '\0';
+    for (size_t i = 0, len = 0; i < n && len < size; ++i){
+        const struct cinic_change *ch = &changes[i];
+        len += snprintf(s + len, size - len, "%c%s%s%s ", "+-~"[ch->kind], ch->section,
+                        ch->key ? "/" : "", ch->key ? ch->key : "");
+    }
+    free(changes);
+    return (n || !changes);
+}
+
+/*
+ * Check reparsing a document loaded from old to text reports the
+ * expected changes, and leaves it as if loaded from text. It is checked
+ * both ways: only the sections changed being parsed again, and all of
+ * the text on the first reparse.
+ */
+bool test_reparse(const struct cinic_ctx *c, const char *old, const char *text, const char *expected){
+    char trace[1024], full[1024];
+    struct cinic_doc *doc = Cinic_load_buffer(c, old, strlen(old), NULL);
+    struct cinic_doc *first = Cinic_load_buffer(c, old, strlen(old), NULL);
+    struct cinic_doc *want = Cinic_load_buffer(c, text, strlen(text), NULL);
+
+    bool res = doc && first && want &&
+        reparse_trace(c, doc, old, trace, sizeof(trace)) && matches(trace, "") &&
+        reparse_trace(c, doc, text, trace, sizeof(trace)) && matches(trace, expected) &&
+        reparse_trace(c, first, text, full, sizeof(full)) && matches(full, expected) &&
+        docs_same(doc, want) && docs_same(want, doc) && docs_same(first, want);
+
+    /* and back again */
+    res = res && reparse_trace(c, doc, old, trace, sizeof(trace)) &&
+        reparse_trace(c, doc, text, full, sizeof(full)) && matches(full, expected) && docs_same(doc, want);
+
+    Cinic_doc_free(doc);
+    Cinic_doc_free(first);
+    Cinic_doc_free(want);
+    return res;
+}
+
+/*
+ * Check reparsing a document loaded from old to text fails with code
+ * on line ln, and leaves the document as it was.
+ */
+bool test_reparse_error(const char *old, const char *text, enum cinic_error code, uint32_t ln){
+    struct cinic_diag diag;
+    struct cinic_change *changes;
+    size_t n;
+    char trace[64];
+    struct cinic_doc *doc = Cinic_load_buffer(&ctx, old, strlen(old), NULL);
+    struct cinic_doc *want = Cinic_load_buffer(&ctx, old, strlen(old), NULL);
+
+    bool res = doc && want && reparse_trace(&ctx, doc, old, trace, sizeof(trace)) &&
+        Cinic_reparse(&ctx, doc, text, strlen(text), &changes, &n, &diag) == -1 &&
+        !changes && !n && diag.code == code && diag.ln == ln && docs_same(doc, want);
+
+    Cinic_doc_free(doc);
+    Cinic_doc_free(want);
+    return res;
+}
+
+/*
+ * Check reparsing a document loaded from the file at path, with
+ * includes followed, to text reports the expected changes: relative
+ * include directives in text are found next to path, as when loaded.
+ */
+bool test_reparse_include(const struct cinic_ctx *c, const char *path, const char *text, const char *expected){
+    char trace[256];
+    struct cinic_ctx inc = *c;
+    inc.includes = true;
+    if (!make_include_files()) return false;
+
+    struct cinic_doc *doc = Cinic_load(&inc, path, NULL);
+    bool res = doc && reparse_trace(&inc, doc, text, trace, sizeof(trace)) && matches(trace, expected);
+    Cinic_doc_free(doc);
+    return res;
+}
+
+/*
+ * Check reparsing a big config after editing one line of it keeps
+ * reporting that one change, including once strings no longer used
+ * pile up and it is parsed whole again.
+ */
+bool test_reparse_edits(const struct cinic_ctx *c, size_t nsections, unsigned nedits){
+    size_t size = nsections * 64 + 1;
+    char *text = malloc(size), trace[128], expected[128];
+    size_t len = 0;
+    if (!text) return false;
+
+    for (size_t i = 0; i < nsections; ++i){
+        len += snprintf(text + len, size - len, "[s%zu]\nk = %08u\nl = [a, b]\n", i, 0U);
+    }
+    struct cinic_doc *doc = Cinic_load_buffer(c, text, len, NULL);
+    bool res = doc && reparse_trace(c, doc, text, trace, sizeof(trace)) && matches(trace, "");
+
+    for (unsigned e = 1; res && e <= nedits; ++e){
+        char section[32], value[16];
+        snprintf(section, sizeof(section), "s%zu", (e * 7919U) % nsections);
+        snprintf(value, sizeof(value), "%08u", e);
+
+        /* values all have the same length, so only this one line changes */
+        char *v = strstr(text, section);
+        while (v[strlen(section)] != ']') v = strstr(v + 1, section);
+        memcpy(strstr(v, "k = ") + 4, value, 8);
+
+        snprintf(expected, sizeof(expected), "~%s ~%s/k ", section, section);
+        const char *k = reparse_trace(c, doc, text, trace, sizeof(trace)) ? Cinic_get(doc, section, "k") : NULL;
+        res = matches(trace, expected) && k && matches(k, value);
+    }
+
+    struct cinic_doc *want = res ? Cinic_load_buffer(c, text, len, NULL) : NULL;
+    res = res && want && docs_same(doc, want) && docs_same(want, doc);
+    Cinic_doc_free(want);
+    Cinic_doc_free(doc);
+    free(text);
+    return res;
+}
+
+/* files for the watcher tests below, and reloads counted as they happen */
+#define WATCH_DIR       "out/watch/"
+#define WATCH_INI       WATCH_DIR "w.ini"
+#define WATCH_DEBOUNCE  50      /* ms */
+
+struct reloads{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned n;
+    enum cinic_error last;      /* outcome of the latest reload */
+};
+
+static void reload_cb(void *ud, const struct cinic_diag *diag){
+    struct reloads *r = ud;
+    pthread_mutex_lock(&r->lock);
+    r->n++;
+    r->last = diag->code;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* wait for r to count n reloads, for up to 5 s; return the outcome of
+ * the latest, or -1 on timeout */
+static int wait_reloads(struct reloads *r, unsigned n){
+    struct timespec due;
+    clock_gettime(CLOCK_REALTIME, &due);
+    due.tv_sec += 5;
+
+    pthread_mutex_lock(&r->lock);
+    int rc = 0;
+    while (r->n < n && !rc) rc = pthread_cond_timedwait(&r->cond, &r->lock, &due);
+    int res = r->n >= n ? (int)r->last : -1;
+    pthread_mutex_unlock(&r->lock);
+    return res;
+}
+
+static void sleep_ms(unsigned ms){
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* write text to the file at path the way editors mostly do: to another
+ * file first, then renamed over it */
+static bool spit_rename(const char *path, const char *text){
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    return spit(tmp, text) && !rename(tmp, path);
+}
+
+/* check the value of key k in section s of the latest document of w */
+static bool watch_value(struct cinic_watch *w, const char *s, const char *k, const char *expected){
+    const struct cinic_doc *doc = Cinic_watch_get(w);
+    const char *v = Cinic_get(doc, s, k);
+    bool res = v && !strcmp(v, expected);
+    Cinic_watch_release(w, doc);
+    return res;
+}
+
+/*
+ * Check a watched config is reloaded once changed, in place or renamed
+ * over (if renamed), and that a document got before the change still
+ * holds the old values.
+ */
+bool test_watch_reload(bool renamed){
+    struct reloads r = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+    mkdir(WATCH_DIR, 0755);
+    if (!spit(WATCH_INI, "[s]\nk = v\n")) return false;
+
+    struct cinic_watch *w = Cinic_watch_new(&ctx, WATCH_INI, WATCH_DEBOUNCE, reload_cb, &r, NULL);
+    if (!w) return false;
+    const struct cinic_doc *old = Cinic_watch_get(w);
+
+    bool res = renamed ? spit_rename(WATCH_INI, "[s]\nk = w\n") : spit(WATCH_INI, "[s]\nk = w\n");
+    res = res && wait_reloads(&r, 1) == CINIC_SUCCESS && watch_value(w, "s", "k", "w");
+    res = res && Cinic_get(old, "s", "k") && !strcmp(Cinic_get(old, "s", "k"), "v");
+    Cinic_watch_release(w, old);
+    Cinic_watch_free(w);
+    return res;
+}
+
+/*
+ * Check a burst of changes to a watched config makes for one reload,
+ * and that changes to other files in the same directory make for none.
+ */
+bool test_watch_debounce(unsigned nwrites){
+    struct reloads r = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+    char text[64], value[16];
+    mkdir(WATCH_DIR, 0755);
+    if (!spit(WATCH_INI, "[s]\nk = 0\n")) return false;
+
+    /* long enough that the burst is over well before */
+    struct cinic_watch *w = Cinic_watch_new(&ctx, WATCH_INI, 10 * WATCH_DEBOUNCE, reload_cb, &r, NULL);
+    if (!w) return false;
+
+    bool res = spit(WATCH_DIR "other.ini", "[o]\nx = 1\n");
+    for (unsigned i = 1; i <= nwrites; ++i){
+        snprintf(text, sizeof(text), "[s]\nk = %u\n", i);
+        res = res && spit_rename(WATCH_INI, text);
+    }
+    snprintf(value, sizeof(value), "%u", nwrites);
+    res = res && wait_reloads(&r, 1) == CINIC_SUCCESS && watch_value(w, "s", "k", value);
+
+    sleep_ms(20 * WATCH_DEBOUNCE);
+    Cinic_watch_free(w);
+    return res && r.n == 1;
+}
+
+/*
+ * Check a watched config that is changed to something not valid keeps
+ * its last good document, and is reloaded once fixed.
+ */
+bool test_watch_error(const char *bad, enum cinic_error code){
+    struct reloads r = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+    mkdir(WATCH_DIR, 0755);
+    if (!spit(WATCH_INI, "[s]\nk = v\n")) return false;
+
+    struct cinic_watch *w = Cinic_watch_new(&ctx, WATCH_INI, WATCH_DEBOUNCE, reload_cb, &r, NULL);
+    if (!w) return false;
+
+    bool res = spit_rename(WATCH_INI, bad) && wait_reloads(&r, 1) == (int)code && watch_value(w, "s", "k", "v");
+    res = res && spit_rename(WATCH_INI, "[s]\nk = w\n") && wait_reloads(&r, 2) == CINIC_SUCCESS;
+    res = res && watch_value(w, "s", "k", "w");
+    Cinic_watch_free(w);
+
+    struct cinic_diag diag;
+    return res && !Cinic_watch_new(&ctx, WATCH_DIR "does_not_exist.ini", 0, NULL, NULL, &diag) && diag.code == CINIC_IO;
+}
+
+/*
+ * Check a watched config whose directory is removed has that reported,
+ * and is watched again once the directory is back.
+ */
+bool test_watch_rearm(const struct cinic_ctx *c){
+    struct reloads r = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+    const char *dir = WATCH_DIR "gone", *ini = WATCH_DIR "gone/w.ini";
+    mkdir(WATCH_DIR, 0755);
+    mkdir(dir, 0755);
+    if (!spit(ini, "[s]\nk = v\n")) return false;
+
+    struct cinic_watch *w = Cinic_watch_new(c, ini, WATCH_DEBOUNCE, reload_cb, &r, NULL);
+    if (!w) return false;
+
+    bool res = !remove(ini) && !rmdir(dir) && wait_reloads(&r, 1) == CINIC_IO;
+
+    /* tried again now and then, failing until it is back */
+    unsigned n = 2;
+    int rc = -1;
+    res = res && !mkdir(dir, 0755) && spit_rename(ini, "[s]\nk = w\n");
+    while (res && (rc = wait_reloads(&r, n)) == CINIC_IO && n < 10) ++n;
+    res = res && rc == CINIC_SUCCESS && watch_value(w, "s", "k", "w");
+
+    res = res && spit_rename(ini, "[s]\nk = x\n") && wait_reloads(&r, n + 1) == CINIC_SUCCESS;
+    res = res && watch_value(w, "s", "k", "x");
+    Cinic_watch_free(w);
+    return res;
+}
+
+/*
+ * Check a watched config is reloaded when a file it includes changes,
+ * and when a file is added to a directory it includes.
+ */
+bool test_watch_includes(const struct cinic_ctx *c){
+    struct reloads r = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+    struct cinic_ctx inc = *c;
+    inc.includes = true;
+    mkdir(WATCH_DIR, 0755);
+    mkdir(WATCH_DIR "conf.d", 0755);
+    remove(WATCH_DIR "conf.d/20-b.ini");
+    if (!spit(WATCH_INI, "[s]\ninclude_dir = conf.d\n") || !spit(WATCH_DIR "conf.d/10-a.ini", "a = 1\n")) return false;
+
+    struct cinic_watch *w = Cinic_watch_new(&inc, WATCH_INI, WATCH_DEBOUNCE, reload_cb, &r, NULL);
+    if (!w) return false;
+
+    bool res = watch_value(w, "s", "a", "1") && spit_rename(WATCH_DIR "conf.d/10-a.ini", "a = 2\n");
+    res = res && wait_reloads(&r, 1) == CINIC_SUCCESS && watch_value(w, "s", "a", "2");
+    res = res && spit(WATCH_DIR "conf.d/20-b.ini", "b = 3\n");
+    res = res && wait_reloads(&r, 2) == CINIC_SUCCESS && watch_value(w, "s", "b", "3");
+    Cinic_watch_free(w);
+    return res;
+}
+
+/*
+ * Check documents can be got from and handed back to a watcher from
+ * several threads while it keeps reloading its config.
+ */
+#define WATCH_THREADS 4
+
+static struct cinic_watch *shared_watch;
+static char watch_last[16];     /* value of the last reload, for the threads to stop at */
+
+static void *watch_worker(void *arg){
+    bool *ok = arg, done = false;
+    *ok = true;
+    for (unsigned long n = 0; *ok && !done && n < 1UL << 24; ++n){
+        const struct cinic_doc *doc = Cinic_watch_get(shared_watch);
+        const char *v = Cinic_get(doc, "s", "k");
+        *ok = v != NULL;
+        done = v && !strcmp(v, watch_last);
+        Cinic_watch_release(shared_watch, doc);
+    }
+    *ok = *ok && done;
+    return NULL;
+}
+
+bool test_watch_threads(int nthreads, unsigned nreloads){
+    struct reloads r = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+    pthread_t tid[WATCH_THREADS];
+    bool ok[WATCH_THREADS];
+    char text[64];
+    bool res = true;
+    assert(nthreads <= WATCH_THREADS);
+
+    mkdir(WATCH_DIR, 0755);
+    if (!spit(WATCH_INI, "[s]\nk = 0\n")) return false;
+    if (!(shared_watch = Cinic_watch_new(&ctx, WATCH_INI, 1, reload_cb, &r, NULL))) return false;
+
+    snprintf(watch_last, sizeof(watch_last), "%u", nreloads);
+    for (int i = 0; i < nthreads; ++i){
+        if (pthread_create(&tid[i], NULL, watch_worker, &ok[i])) return false;
+    }
+    /* the last one is written whatever happens, for the threads to stop */
+    for (unsigned i = 1; i <= nreloads; ++i){
+        snprintf(text, sizeof(text), "[s]\nk = %u\n", i);
+        res = spit_rename(WATCH_INI, text) && wait_reloads(&r, i) == CINIC_SUCCESS && res;
+    }
+    for (int i = 0; i < nthreads; ++i){
+        pthread_join(tid[i], NULL);
+        res = res && ok[i];
+    }
+    Cinic_watch_free(shared_watch);
+    return res;
+}
+
+/* check invalid options are rejected */
+bool test_ctx_init(const char *delim, const char *brackets, int expected){
+    struct cinic_ctx c;
+    return (Cinic_ctx_init(&c, false, false, delim, brackets) == expected);
+}
 
 int main(int argc, char **argv){
     printf(" ~~~~ Running C tests ~~~~ \n");
+    Cinic_ctx_init(&ctx, false, false, ".", NULL);
 
     printf("[ ] Parsing empty lines ... \n");
-    run_test(test_empty_line, " ;", false);
-    run_test(test_empty_line, "\0", true);
-    run_test(test_empty_line, " ", true);
-    run_test(test_empty_line, " waf", false);
-    run_test(test_empty_line, " .", false);
-    run_test(test_empty_line, "# one", false);
-    run_test(test_empty_line, "                    ", true);
-    run_test(test_empty_line, "\t\n\t    \t\n               ", true);
+    run_test(test_lex_line, " ;", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "\0", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " waf", LEX_LIST_LAST, NULL, "waf");
+    run_test(test_lex_line, " .", LEX_LIST_LAST, NULL, ".");
+    run_test(test_lex_line, "# one", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "                    ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "\t\n\t    \t\n               ", LEX_NONE, NULL, NULL);
 
     printf("[ ] Parsing comment-only lines ... \n");
-    run_test(test_comment_line, " ;", true);
-    run_test(test_comment_line, " #   ", true);
-    run_test(test_comment_line, " # bla blah ;", true);
-    run_test(test_comment_line, " ; ;;;", true);
-    run_test(test_comment_line, " #;# ;oneaw;;", true);
-    run_test(test_comment_line, "   ", false);
-    run_test(test_comment_line, " one two three # some", false);
-    run_test(test_comment_line, "fdewfw;", false);
+    run_test(test_lex_line, " ;", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " #   ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " # bla blah ;", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " ; ;;;", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " #;# ;oneaw;;", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "   ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " one two three # some", LEX_LIST_LAST, NULL, "one");
+    run_test(test_lex_line, "fdewfw;", LEX_LIST_LAST, NULL, "fdewfw");
 
     printf("[ ] Parsing section headers ... \n");
-    run_test(test_section_name, " ;", false, NULL);
-    run_test(test_section_name, " [one two;]", false, NULL);
-    run_test(test_section_name, "# [mysection]", false, NULL);
-    run_test(test_section_name, "[mysection]", true, "mysection");
-    run_test(test_section_name, "  [mysection]  ", false, NULL);
-    run_test(test_section_name, "    [mysection  ] ", false, NULL);
-    run_test(test_section_name, "[mysection  ]", true, "mysection");
-    run_test(test_section_name, "[    mysection  ]", true, "mysection");
-    run_test(test_section_name, "    [mysection one]", false, NULL);
-    run_test(test_section_name, "[  sect.subsect  ]", true, "sect.subsect");
-    run_test(test_section_name, " [  sect.subsect  ]", false, NULL);
-    run_test(test_section_name, "[sect.subsect.subsub.sub4]", true, "sect.subsect.subsub.sub4");
-    run_test(test_section_name, " [sect.subsect.subsub.sub4]  # mycomment", false, NULL);
-    run_test(test_section_name, "[ my-sec.sub_1.sub_2.      ]", true, "my-sec.sub_1.sub_2.");
-    run_test(test_section_name, ".[ my-sec.sub_1.sub_2. ];whatever", false, NULL);
-    run_test(test_section_name, "[ .my-sec.sub_1- ]", true, ".my-sec.sub_1-");
-    run_test(test_section_name, "[ .my-sec.sub_1- ] ", false, NULL);
-    run_test(test_section_name, "[]", false, NULL);
-    run_test(test_section_name, "[ ]", false, NULL);
-    run_test(test_section_name, "[.]", true, ".");
-    run_test(test_section_name, "[   _ ]", true, "_");
-    run_test(test_section_name, "[ .   _ ]", false, NULL);
+    run_test(test_lex_line, " ;", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " [one two;]", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "# [mysection]", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "[mysection]", LEX_SECTION, "mysection", NULL);
+    run_test(test_lex_line, "  [mysection]  ", LEX_SECTION, "mysection", NULL);
+    run_test(test_lex_line, "    [mysection  ] ", LEX_SECTION, "mysection", NULL);
+    run_test(test_lex_line, "[mysection  ]", LEX_SECTION, "mysection", NULL);
+    run_test(test_lex_line, "[    mysection  ]", LEX_SECTION, "mysection", NULL);
+    run_test(test_lex_line, "    [mysection one]", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[  sect.subsect  ]", LEX_SECTION, "sect.subsect", NULL);
+    run_test(test_lex_line, " [  sect.subsect  ]", LEX_SECTION, "sect.subsect", NULL);
+    run_test(test_lex_line, "[sect.subsect.subsub.sub4]", LEX_SECTION, "sect.subsect.subsub.sub4", NULL);
+    run_test(test_lex_line, " [sect.subsect.subsub.sub4]  # mycomment", LEX_SECTION, "sect.subsect.subsub.sub4", NULL);
+    run_test(test_lex_line, "[ my-sec.sub_1.sub_2.      ]", LEX_SECTION, "my-sec.sub_1.sub_2.", NULL);
+    run_test(test_lex_line, ".[ my-sec.sub_1.sub_2. ];whatever", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, "[ .my-sec.sub_1- ]", LEX_SECTION, ".my-sec.sub_1-", NULL);
+    run_test(test_lex_line, "[ .my-sec.sub_1- ] ", LEX_SECTION, ".my-sec.sub_1-", NULL);
+    run_test(test_lex_line, "[]", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[ ]", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[.]", LEX_SECTION, ".", NULL);
+    run_test(test_lex_line, "[   _ ]", LEX_SECTION, "_", NULL);
+    run_test(test_lex_line, "[ .   _ ]", LEX_LIST_OPEN, NULL, NULL);
 
 
     printf("[ ] Parsing key=value lines ... \n");
-    run_test(test_kv_line, " ;", false, NULL, NULL);
-    run_test(test_kv_line, "", false, NULL, NULL);
-    run_test(test_kv_line, "= ", false, NULL, NULL);
-    run_test(test_kv_line, ".=", false, NULL, NULL);
-    run_test(test_kv_line, "===", false, NULL, NULL);
-    run_test(test_kv_line, "3=#", false, NULL, NULL);
-    run_test(test_kv_line, "# k=v", false, NULL, NULL);
-    run_test(test_kv_line, "one=[two] ", false, NULL, NULL);
-    run_test(test_kv_line, "one = { ", false, NULL, NULL);
-    run_test(test_kv_line, "one=two=three", false, NULL, NULL);
-    run_test(test_kv_line, " key = val*", false, NULL, NULL);
-    run_test(test_kv_line, "key = val*", true, "key", "val*");
-    run_test(test_kv_line, "key = val* ", true, "key", "val* ");
-    run_test(test_kv_line, " key = val* ", false, NULL, NULL);
-    run_test(test_kv_line, "key = a very long description @@ __ ", true, "key", "a very long description @@ __ ");
-    run_test(test_kv_line, "key = one two three_four five ", true, "key", "one two three_four five ");
-    run_test(test_kv_line, "k=v", true, "k", "v");
-    run_test(test_kv_line, " k=v # ", false, NULL, NULL);
-    run_test(test_kv_line, "one=two", true, "one", "two");
-    run_test(test_kv_line, "mykey     =myval # mycomment, k=v", false, NULL, NULL);
-    run_test(test_kv_line, "mykey     =myval", true, "mykey", "myval");
-    run_test(test_kv_line, "__key__ = ---val.val.val-", true, "__key__", "---val.val.val-");
-    run_test(test_kv_line, "key1-=-2val", true, "key1-", "-2val");
+    run_test(test_lex_line, " ;", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "= ", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, ".=", LEX_LIST_HEAD, ".", NULL);
+    run_test(test_lex_line, "===", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, "3=#", LEX_LIST_HEAD, "3", NULL);
+    run_test(test_lex_line, "# k=v", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "one=[two] ", LEX_LIST_HEAD, "one", NULL);
+    run_test(test_lex_line, "one = { ", LEX_LIST_HEAD, "one", NULL);
+    run_test(test_lex_line, "one=two=three", LEX_LIST_HEAD, "one", NULL);
+    run_test(test_lex_line, " key = val*", LEX_RECORD, "key", "val*");
+    run_test(test_lex_line, "key = val*", LEX_RECORD, "key", "val*");
+    run_test(test_lex_line, "key = val* ", LEX_RECORD, "key", "val*");
+    run_test(test_lex_line, " key = val* ", LEX_RECORD, "key", "val*");
+    run_test(test_lex_line, "key = a very long description @@ __ ", LEX_RECORD, "key", "a very long description @@ __");
+    run_test(test_lex_line, "key = one two three_four five ", LEX_RECORD, "key", "one two three_four five");
+    run_test(test_lex_line, "k=v", LEX_RECORD, "k", "v");
+    run_test(test_lex_line, " k=v # ", LEX_RECORD, "k", "v");
+    run_test(test_lex_line, "one=two", LEX_RECORD, "one", "two");
+    run_test(test_lex_line, "mykey     =myval # mycomment, k=v", LEX_RECORD, "mykey", "myval");
+    run_test(test_lex_line, "mykey     =myval", LEX_RECORD, "mykey", "myval");
+    run_test(test_lex_line, "__key__ = ---val.val.val-", LEX_RECORD, "__key__", "---val.val.val-");
+    run_test(test_lex_line, "key1-=-2val", LEX_RECORD, "key1-", "-2val");
 
     printf("[ ] Parsing list headers ... \n");
-    run_test(test_list_header, " ", false, NULL);
-    run_test(test_list_header, " # one", false, NULL);
-    run_test(test_list_header, " [ ]", false, NULL);
-    run_test(test_list_header, "a=[] ", false, NULL);
-    run_test(test_list_header, " my_list = [. ", false, NULL);
-    run_test(test_list_header, "mylist = [ ", false, NULL);
-    run_test(test_list_header, "mylist = [", false, NULL);
-    run_test(test_list_header, "=[", false, NULL);
-    run_test(test_list_header, "#mylist=[", false, NULL);
-    run_test(test_list_header, "mylist=[=", false, NULL);
-    run_test(test_list_header, "mylist=", true, "mylist");
-    run_test(test_list_header, "mylist =", true, "mylist");
-    run_test(test_list_header, "mylist        =", true, "mylist");
-    run_test(test_list_header, " mylist=", false, NULL);
-    run_test(test_list_header, "mylist =[", false, NULL);
-    run_test(test_list_header, "  mylist      =[  ", false, NULL);
-    run_test(test_list_header, "my.list-=", true, "my.list-");
-    run_test(test_list_header, "__ =", true, "__");
+    run_test(test_lex_line, " ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " # one", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " [ ]", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "a=[] ", LEX_LIST_HEAD, "a", NULL);
+    run_test(test_lex_line, " my_list = [. ", LEX_LIST_HEAD, "my_list", NULL);
+    run_test(test_lex_line, "mylist = [ ", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "mylist = [", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "=[", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, "#mylist=[", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "mylist=[=", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "mylist=", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "mylist =", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "mylist        =", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, " mylist=", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "mylist =[", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "  mylist      =[  ", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "my.list-=", LEX_LIST_HEAD, "my.list-", NULL);
+    run_test(test_lex_line, "__ =", LEX_LIST_HEAD, "__", NULL);
 
     printf("[ ] Parsing closing-bracket lines ... \n");
-    run_test(test_list_end, " ", false);
-    run_test(test_list_end, " # one", false);
-    run_test(test_list_end, " # ]", false);
-    run_test(test_list_end, ";]", false);
-    run_test(test_list_end, "a]", false);
-    run_test(test_list_end, "----]", false);
-    run_test(test_list_end, "   ]", false);
-    run_test(test_list_end, " ]      ", false);
-    run_test(test_list_end, "] ; some comment", false);
-    run_test(test_list_end, "  ] # comment", false);
-    run_test(test_list_end, "]", true);
+    run_test(test_lex_line, " ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " # one", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " # ]", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, ";]", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "a]", LEX_LIST_LAST, NULL, "a");
+    run_test(test_lex_line, "----]", LEX_LIST_LAST, NULL, "----");
+    run_test(test_lex_line, "   ]", LEX_LIST_CLOSE, NULL, NULL);
+    run_test(test_lex_line, " ]      ", LEX_LIST_CLOSE, NULL, NULL);
+    run_test(test_lex_line, "] ; some comment", LEX_LIST_CLOSE, NULL, NULL);
+    run_test(test_lex_line, "  ] # comment", LEX_LIST_CLOSE, NULL, NULL);
+    run_test(test_lex_line, "]", LEX_LIST_CLOSE, NULL, NULL);
 
     printf("[ ] Parsing opening-bracket lines ... \n");
-    run_test(test_list_start, " ", false);
-    run_test(test_list_start, " # one", false);
-    run_test(test_list_start, " #[ ", false);
-    run_test(test_list_start, "[;", false);
-    run_test(test_list_start, "[a", false);
-    run_test(test_list_start, "[----", false);
-    run_test(test_list_start, "[  ", false);
-    run_test(test_list_start, "    [", false);
-    run_test(test_list_start, "[ ; some comment", false);
-    run_test(test_list_start, "  [ # comment", false);
-    run_test(test_list_start, "[", true);
+    run_test(test_lex_line, " ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " # one", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " #[ ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "[;", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[a", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[----", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[  ", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "    [", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[ ; some comment", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "  [ # comment", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[", LEX_LIST_OPEN, NULL, NULL);
 
     printf("[ ] Parsing list item lines ... \n");
-    run_test(test_list_entry, " ", false, false, NULL);
-    run_test(test_list_entry, " # ", false, false, NULL);
-    run_test(test_list_entry, "; some comment ", false, false, NULL);
-    run_test(test_list_entry, " ] ", false, false, NULL);
-    run_test(test_list_entry, " [", false, false, NULL);
-    run_test(test_list_entry, "[ section ]", false, false, NULL);
-    run_test(test_list_entry, ", ", false, false, NULL);
-    run_test(test_list_entry, " ,,", false, false, NULL);
-    run_test(test_list_entry, ",some", false, false, NULL);
-    run_test(test_list_entry, "item ,", true, false, "item");
-    run_test(test_list_entry, "item,", true, false, "item");
-    run_test(test_list_entry, "item", true, true, "item");
-    run_test(test_list_entry, " item", false, false, NULL);
-    run_test(test_list_entry, "some", true, true, "some");
-    run_test(test_list_entry, "item ;", false, false, NULL);
+    run_test(test_lex_line, " ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " # ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "; some comment ", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " ] ", LEX_LIST_CLOSE, NULL, NULL);
+    run_test(test_lex_line, " [", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[ section ]", LEX_SECTION, "section", NULL);
+    run_test(test_lex_line, ", ", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, " ,,", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, ",some", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, "item ,", LEX_LIST_ITEM, NULL, "item");
+    run_test(test_lex_line, "item,", LEX_LIST_ITEM, NULL, "item");
+    run_test(test_lex_line, "item", LEX_LIST_LAST, NULL, "item");
+    run_test(test_lex_line, " item", LEX_LIST_LAST, NULL, "item");
+    run_test(test_lex_line, "some", LEX_LIST_LAST, NULL, "some");
+    run_test(test_lex_line, "item ;", LEX_LIST_LAST, NULL, "item");
+
+    printf("[ ] Splitting lines into list tokens ... \n");
+    run_test(test_list_tokens, "", "");
+    run_test(test_list_tokens, "mylist = [", "mylist=|[|");
+    run_test(test_list_tokens, "l=[one,two ,three]", "l=|[|one,|two,|three|]|");
+    run_test(test_list_tokens, "k = a, b ; c", "k=|a,|b|");
+    run_test(test_list_tokens, "[a", "[|a|");
+    run_test(test_list_tokens, "a b", "a|b|");
+    run_test(test_list_tokens, "   last  ]", "last|]|");
+    run_test(test_list_tokens, "x [", "!|");
+    run_test(test_list_tokens, "item $", "!|");
+
+    printf("[ ] Classifying lines in a single pass ... \n");
+    run_test(test_lex_line, "", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "   \t \n", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, "  ; [not] = a section", LEX_NONE, NULL, NULL);
+    run_test(test_lex_line, " [ top.sub ] # comment\n", LEX_SECTION, "top.sub", NULL);
+    run_test(test_lex_line, "[sect]x", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, "[ a b ]", LEX_LIST_OPEN, NULL, NULL);
+    run_test(test_lex_line, " key = a long value \t ;comment\n", LEX_RECORD, "key", "a long value");
+    run_test(test_lex_line, "k=v", LEX_RECORD, "k", "v");
+    run_test(test_lex_line, "mylist = [one, two]", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "mylist =\n", LEX_LIST_HEAD, "mylist", NULL);
+    run_test(test_lex_line, "k = a, b", LEX_LIST_HEAD, "k", NULL);
+    run_test(test_lex_line, "  first  , # comment", LEX_LIST_ITEM, NULL, "first");
+    run_test(test_lex_line, "fourth\n", LEX_LIST_LAST, NULL, "fourth");
+    run_test(test_lex_line, "five]", LEX_LIST_LAST, NULL, "five");
+    run_test(test_lex_line, "   ] # comment", LEX_LIST_CLOSE, NULL, NULL);
+    run_test(test_lex_line, "k = \"v\"", LEX_LIST_HEAD, "k", NULL);
+    run_test(test_lex_line, "$", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, "= v", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, "caf\xc3\xa9", LEX_BAD, NULL, NULL);
+    run_test(test_lex_line, "k = caf\xc3\xa9", LEX_LIST_HEAD, "k", NULL);
+
+    printf("[ ] Parsing with custom list brackets ... \n");
+    run_test(test_lex_brackets, NULL, "[", LEX_LIST_OPEN);
+    run_test(test_lex_brackets, NULL, "]", LEX_LIST_CLOSE);
+    run_test(test_lex_brackets, "{}", "{", LEX_LIST_OPEN);
+    run_test(test_lex_brackets, "{}", "}", LEX_LIST_CLOSE);
+    run_test(test_lex_brackets, "()", "(", LEX_LIST_OPEN);
+    run_test(test_lex_brackets, "()", ")", LEX_LIST_CLOSE);
+    run_test(test_lex_brackets, "{}", "[sect]", LEX_SECTION);
+    run_test(test_lex_brackets, "{}", "{", LEX_LIST_OPEN);
+    run_test(test_lex_brackets, "{}", "  last }", LEX_LIST_LAST);
+    run_test(test_lex_brackets, "{}", "[", LEX_BAD);
+    run_test(test_lex_brackets, "{}", "]", LEX_BAD);
+    run_test(test_lex_brackets, NULL, "{", LEX_BAD);
+
+    printf("[ ] Scanning blocks for delimiters ... \n");
+    run_test(test_scan_block, '\n', 1);
+    run_test(test_scan_block, ';', 2);
+    run_test(test_scan_block, '\xff', 3);
+
+    printf("[ ] Parsing files with different contexts ... \n");
+    struct cinic_ctx globals_ctx;
+    Cinic_ctx_init(&globals_ctx, true, false, ".", NULL);
+    run_test(test_parse_file, &ctx, "samples/flat.ini", 4);
+    run_test(test_parse_file, &ctx, "/dev/null", 0);  /* not mappable: read as a stream */
+    run_test(test_parse_file, &globals_ctx, "samples/globals.ini", 8);
+    run_test(test_parse_file, &globals_ctx, "samples/lists_from_hell.ini", 30);
+
+    printf("[ ] Reporting errors ... \n");
+    run_test(test_parse_error, &ctx, "k = v\n", CINIC_NOSECTION, 1, 1);
+    run_test(test_parse_error, &ctx, "[s]\n  $ = v\n", CINIC_MALFORMED, 2, 3);
+    run_test(test_parse_error, &ctx, "[s]\nl = [a,\n [t]\n", CINIC_NESTED, 3, 2);
+    run_test(test_parse_error, &ctx, "[s]\nl = [a b]\n", CINIC_MISSING_COMMA, 2, 8);
+    run_test(test_parse_error, &ctx, "[s]\nl = [a,]\n", CINIC_REDUNDANT_COMMA, 2, 8);
+    run_test(test_parse_error, &ctx, "[s]\nl = []\n", CINIC_EMPTY_LIST, 2, 6);
+    run_test(test_parse_error, &ctx, "[s]\n  a,\n", CINIC_NOLIST, 2, 3);
+    run_test(test_parse_error, &ctx, "[s\n", CINIC_NOLIST, 1, 1);
+    run_test(test_parse_abort, "[s]\nk = v\nl = [a, b]\n", 3);
+    run_test(test_parse_io_error, "samples/does_not_exist.ini", ENOENT);
+    run_test(test_parse_io_error, "samples/", EISDIR);
+    run_test(test_ctx_init, ".", NULL, 0);
+    run_test(test_ctx_init, "::", NULL, CINIC_BAD_OPTION);
+    run_test(test_ctx_init, ".", "[", CINIC_BAD_OPTION);
+    run_test(test_ctx_init, ".", "][", CINIC_BAD_OPTION);
+    run_test(test_ctx_init, ".", "ab", CINIC_BAD_OPTION);
+
+    printf("[ ] Parsing long lines ... \n");
+    run_test(test_long_line, 1023, 0, 0);
+    run_test(test_long_line, 4096, 0, 0);
+    run_test(test_long_line, 1 << 20, 0, 0);
+    run_test(test_long_line, 1 << 20, 1 << 21, 0);
+    run_test(test_long_line, 1 << 20, 1024, -1);
+    struct cinic_ctx short_ctx;
+    Cinic_ctx_init(&short_ctx, false, false, ".", NULL);
+    short_ctx.max_line_len = 8;
+    run_test(test_parse_error, &short_ctx, "[s]\nkey = value\n", CINIC_TOOLONG, 2, 9);
+
+    printf("[ ] Linting ... \n");
+    run_test(test_lint, "", "");
+    run_test(test_lint, "[s]\nk = v\nl = [a, b]\n", "");
+    run_test(test_lint, "k = v\n[s]\n$\nw = 1\n", "1:1:1 3:1:2 ");
+    run_test(test_lint, "[s]\nl = [a b, c\n d,\n e]\nx = y\n", "2:8:8 ");
+    run_test(test_lint, "[s]\nm = [a,\n[t]\nn = [1, 2]]\n", "3:1:5 4:11:10 ");
+    run_test(test_lint, "[s]\nz = [\n]\n  ]\nw = 1\n", "3:1:7 4:3:10 ");
+    run_test(test_lint, "[s]\nl = [a,\nk = v\n  b]\n", "3:1:5 4:3:6 ");
+    run_test(test_lint_io_error, "samples/does_not_exist.ini");
+    run_test(test_lint_io_error, "samples/");
+
+    printf("[ ] Parsing from memory ... \n");
+    run_test(test_parse_buffer, &ctx, "samples/empty.ini");
+    run_test(test_parse_buffer, &ctx, "samples/flat.ini");
+    run_test(test_parse_buffer, &ctx, "samples/nested.ini");
+    run_test(test_parse_buffer, &ctx, "samples/lists.ini");
+    run_test(test_parse_buffer, &globals_ctx, "samples/globals.ini");
+    run_test(test_parse_buffer, &globals_ctx, "samples/lists_from_hell.ini");
+
+    printf("[ ] Parsing with an event callback ... \n");
+    run_test(test_parse_events, &ctx, "", "");
+    run_test(test_parse_events, &ctx, "[s]\nk = v\n[t]\n", "1:0:s=- 2:1:k=v 3:0:t=- ");
+    run_test(test_parse_events, &ctx, "[s]\nl = [a,\n b]\n", "1:0:s=- 2:2:l=- 2:3:l=a 3:3:l=b ");
+    run_test(test_parse_events, &globals_ctx, "g = 1\nl = [x]\n", "1:1:g=1 2:2:l=- 2:3:l=x ");
+
+    printf("[ ] Parsing with a view callback ... \n");
+    run_test(test_parse_views, &ctx, "samples/flat.ini", 1);
+    run_test(test_parse_views, &ctx, "samples/nested.ini", 4);
+    run_test(test_parse_views, &ctx, "samples/lists.ini", 4);
+    run_test(test_parse_views, &globals_ctx, "samples/lists_from_hell.ini", 4);
+    run_test(test_parse_views, &ctx, "/dev/null", 1);  /* read as a stream */
+
+    printf("[ ] Parsing in parallel ... \n");
+    run_test(test_parse_parallel, &ctx, "samples/nested.ini", NULL, 0, 2);
+    run_test(test_parse_parallel, &ctx, "samples/lists.ini", NULL, 0, 4);
+    run_test(test_parse_parallel, &globals_ctx, "samples/lists_from_hell.ini", NULL, 0, 4);
+    run_test(test_parse_parallel, &globals_ctx, "samples/lists_from_hell.ini", NULL, 100000, 4);
+    run_test(test_parse_parallel, &globals_ctx, "samples/lists_from_hell.ini", "bad line\n", 0, 3);
+    run_test(test_parse_parallel, &globals_ctx, "samples/lists_from_hell.ini", "l = [\n  a,\n[s]\n", 0, 3);
+    run_test(test_parse_parallel, &ctx, "samples/flat.ini", "[s]\nk = v\n", 0, 8);
+
+    printf("[ ] Allocating from arenas ... \n");
+    run_test(test_arena, 1, 0);
+    run_test(test_arena, 10000, 1);
+    run_test(test_arena, 1000, 100);
+    run_test(test_arena, 10, 3 << 20);  /* bigger than a block */
+
+    printf("[ ] Loading documents ... \n");
+    run_test(test_doc_lookups, &ctx, "samples/flat.ini");
+    run_test(test_doc_lookups, &ctx, "samples/nested.ini");
+    run_test(test_doc_lookups, &globals_ctx, "samples/globals.ini");
+    run_test(test_doc_lookups, &globals_ctx, "samples/lists_from_hell.ini");
+    run_test(test_doc_get, &globals_ctx, "g = 1\n[a.b]\nk = v\n", NULL, "g", "1");
+    run_test(test_doc_get, &globals_ctx, "g = 1\n[a.b]\nk = v\n", "", "g", "1");
+    run_test(test_doc_get, &globals_ctx, "g = 1\n[a.b]\nk = v\n", "a.b", "k", "v");
+    run_test(test_doc_get, &globals_ctx, "g = 1\n[a.b]\nk = v\n", "a.b", "g", NULL);
+    run_test(test_doc_get, &globals_ctx, "g = 1\n[a.b]\nk = v\n", "a", "k", NULL);
+    run_test(test_doc_get, &ctx, "[s]\nk = 1\n[t]\nk = 2\n[s]\nk = 3\n", "s", "k", "3");
+    run_test(test_doc_get, &ctx, "[s]\nk = 1\n[t]\nk = 2\n[s]\nk = 3\n", "t", "k", "2");
+    run_test(test_doc_get, &ctx, "[s]\nk = [a, b]\nk = v\n", "s", "k", "v");
+    run_test(test_doc_get, &ctx, "[s]\nk = v\nk = [a, b]\n", "s", "k", NULL);
+    run_test(test_doc_section, &ctx, "[a.b.c]\nk = v\n", "a", true);
+    run_test(test_doc_section, &ctx, "[a.b.c]\nk = v\n", "a.b", true);
+    run_test(test_doc_section, &ctx, "[a.b.c]\nk = v\n", "a.b.c", true);
+    run_test(test_doc_section, &ctx, "[a.b.c]\nk = v\n", "a.b.c.d", false);
+    run_test(test_doc_section, &ctx, "[a.b.c]\nk = v\n", "b", false);
+    run_test(test_doc_section, &ctx, "[a.b.c]\nk = v\n", "a.b.", false);
+    run_test(test_doc_section, &ctx, "[a.b.c]\nk = v\n[e]\n", "e", false);   /* no entries */
+    run_test(test_doc_section, &ctx, "[e]\n", NULL, true);
+    run_test(test_doc_section, &ctx, "[s]\nl = [a]\n", "s", true);
+    run_test(test_doc_list, &globals_ctx, "samples/lists_from_hell.ini", "lists.multi", "list1", "first|second|third|fourth|");
+    run_test(test_doc_list, &globals_ctx, "samples/lists_from_hell.ini", "lists.single", "list2", "FIRST|second|3|4|5th|");
+    run_test(test_doc_list, &globals_ctx, "samples/lists_from_hell.ini", "lists.single", "length", NULL);
+    run_test(test_doc_list, &globals_ctx, "samples/lists_from_hell.ini", "lists.multi", "nope", NULL);
+    run_test(test_doc_many, 5000);
+
+    printf("[ ] Compiling snapshots ... \n");
+    run_test(test_snapshot_lookups, &ctx, "samples/flat.ini");
+    run_test(test_snapshot_lookups, &ctx, "samples/nested.ini");
+    run_test(test_snapshot_lookups, &ctx, "samples/lists.ini");
+    run_test(test_snapshot_lookups, &globals_ctx, "samples/globals.ini");
+    run_test(test_snapshot_lookups, &globals_ctx, "samples/lists_from_hell.ini");
+    run_test(test_snapshot_lookups, &ctx, "samples/empty.ini");
+    run_test(test_snapshot_stale, "[s]\nk = v\n", "[s]\nk = w\n");
+    run_test(test_snapshot_stale, "[s]\nk = v\n", "[s]\nk = v\n\n");
+    run_test(test_snapshot_open, 0, 0, CINIC_SUCCESS);
+    run_test(test_snapshot_open, 16, 0, CINIC_BAD_SNAPSHOT);     /* truncated header */
+    run_test(test_snapshot_open, 200, 0, CINIC_BAD_SNAPSHOT);    /* truncated tables */
+    run_test(test_snapshot_open, 0, 3, CINIC_BAD_SNAPSHOT);      /* magic */
+    run_test(test_snapshot_open, 0, 8, CINIC_BAD_SNAPSHOT);      /* version */
+    run_test(test_snapshot_open, 0, 44, CINIC_BAD_SNAPSHOT);     /* index size */
+    run_test(test_compile_error, "k = v\n", CINIC_NOSECTION, 1);
+
+    printf("[ ] Interning strings ... \n");
+    run_test(test_intern, 1);
+    run_test(test_intern, 10000);
+    run_test(test_intern_threads, 4);
+    struct cinic_ctx intern_ctx = globals_ctx;
+    intern_ctx.intern = Cinic_intern_new();
+    run_test(test_doc_lookups, &intern_ctx, "samples/nested.ini");
+    run_test(test_doc_lookups, &intern_ctx, "samples/lists_from_hell.ini");
+    run_test(test_doc_lookups, &intern_ctx, "samples/lists_from_hell.ini");  /* all already interned */
+    run_test(test_doc_get, &intern_ctx, "[s]\nk = 1\n[t]\nk = 2\n[s]\nk = 3\n", "s", "k", "3");
+    run_test(test_doc_get, &intern_ctx, "g = 1\n[a.b]\nk = v\n", NULL, "g", "1");
+    run_test(test_doc_list, &intern_ctx, "samples/lists_from_hell.ini", "lists.multi", "list1", "first|second|third|fourth|");
+    run_test(test_load_many, &intern_ctx, 4, MANY_FILES, 0);     /* interning from several threads */
+    Cinic_intern_free(intern_ctx.intern);
+    run_test(test_doc_error, "k = v\n", CINIC_NOSECTION, 1);
+    run_test(test_doc_error, "[s]\nl = [a,\n$\n", CINIC_MALFORMED, 3);
+    run_test(test_load_many, &ctx, 1, 10, 0);
+    run_test(test_load_many, &ctx, 4, 0, 0);
+    run_test(test_load_many, &ctx, 4, MANY_FILES, 0);
+    run_test(test_load_many, &ctx, 4, MANY_FILES, 5);
+    run_test(test_load_many, &ctx, 16, 3, 2);   /* more threads than files */
+
+    printf("[ ] Caching documents ... \n");
+    run_test(test_cache_changed, "[s]\nk = v\n", "[s]\nk = w\n\n");
+    run_test(test_cache_bounds, 8, 0, 0);
+    run_test(test_cache_bounds, 8, 8, 0);
+    run_test(test_cache_bounds, 8, 4, 0);
+    run_test(test_cache_bounds, 8, 1, 0);
+    run_test(test_cache_bounds, 8, 0, 3 * CACHE_FILE_SIZE + 1);
+    run_test(test_cache_invalidate, "samples/flat.ini");
+    run_test(test_cache_invalidate, "samples/nested.ini");
+    run_test(test_cache_invalidate, NULL);
+    run_test(test_cache_threads, 4);
+    printf("[ ] Following includes ... \n");
+    run_test(test_include, &ctx, false, "[s]\ninclude = x\n", "1:0:s=- 2:1:include=x ");
+    run_test(test_include, &ctx, true, "[s]\ninclude = " INC "a.ini\nz = 3\n",
+             "1:0:s=- 1:1:k=a 2:0:a=- 3:1:x=1 2:0:s=- 3:1:z=3 ");
+    run_test(test_include, &globals_ctx, true, "include = " INC "b.ini\n",
+             "1:1:k=a 2:0:a=- 3:1:x=1 1:0:=- 2:0:b=- 3:1:y=2 1:0:=- ");
+    run_test(test_include, &ctx, true, "[s]\ninclude = " INC "d.ini\n",
+             "1:0:s=- 1:0:s=- 1:0:x=- 2:1:k=10 2:0:s=- 1:0:x=- 2:1:k=20 2:0:s=- 3:1:after=1 2:0:s=- ");
+    run_test(test_include, &ctx, true, "[s]\ninclude = " INC "conf.d/*.ini\nz = 1\n",
+             "1:0:s=- 1:0:x=- 2:1:k=10 2:0:s=- 1:0:x=- 2:1:k=20 2:0:s=- 3:1:z=1 ");
+    run_test(test_include, &ctx, true, "[s]\ninclude = " INC "conf.d/*.conf\nz = 1\n", "1:0:s=- 3:1:z=1 ");
+    run_test(test_include_error, "include = " INC "a.ini\n", CINIC_NOSECTION, INC "a.ini", 1);
+    run_test(test_include_error, "[s]\ninclude = " INC "bad.ini\n", CINIC_MALFORMED, INC "bad.ini", 3);
+    run_test(test_include_error, "[s]\n\ninclude = " INC "nope.ini\n", CINIC_IO, "", 3);
+    run_test(test_include_error, "[s]\ninclude_dir = " INC "nope\n", CINIC_IO, "", 2);
+    run_test(test_include_error, "include = " INC "self.ini\n", CINIC_INCLUDE_CYCLE, INC "self.ini", 1);
+    run_test(test_include_error, "include = " INC "loop1.ini\n", CINIC_INCLUDE_CYCLE, INC "loop2.ini", 2);
+    run_test(test_include_doc, &ctx);
+    run_test(test_include_snapshot, &globals_ctx);
+    printf("[ ] Reparsing documents ... \n");
+    run_test(test_reparse, &ctx, "[s]\nk = v\n", "[s]\nk = v\n", "");
+    run_test(test_reparse, &ctx, "[s]\nk = v\n", "[s]\nk = w\n", "~s ~s/k ");
+    run_test(test_reparse, &ctx, "[s]\nk = v\n", "[s]\nk = v\nj = 1\n", "~s +s/j ");
+    run_test(test_reparse, &ctx, "[s]\nk = v\nj = 1\n", "[s]\nj = 1\n", "~s -s/k ");
+    run_test(test_reparse, &ctx, "[s]\nk = v\n", "[s]\nk = v ; note\n\n", "");      /* no entry changed */
+    run_test(test_reparse, &ctx, "[s]\nk = v\n", "[s]\nk = v\n[t]\nx = 1\n", "+t +t/x ");
+    run_test(test_reparse, &ctx, "[s]\nk = v\n[t]\nx = 1\n", "[s]\nk = v\n", "-t -t/x ");
+    run_test(test_reparse, &ctx, "[s]\nk = v\n[t]\nx = 1\n", "[s]\n[t]\nx = 1\n", "-s -s/k ");
+    run_test(test_reparse, &ctx, "[s]\nk = v\n", "", "-s -s/k ");
+    run_test(test_reparse, &ctx, "", "[s]\nk = v\n", "+s +s/k ");
+    run_test(test_reparse, &ctx, "[a]\nx = 1\n[b]\ny = 2\n", "[b]\ny = 2\n[a]\nx = 1\n", "");   /* moved */
+    run_test(test_reparse, &ctx, "[a.b]\nk = 1\n", "[a.c]\nk = 1\n", "-a.b -a.b/k +a.c +a.c/k ");
+    run_test(test_reparse, &ctx, "[s]\nl = [a, b]\n", "[s]\nl = [a,\n c]\n", "~s ~s/l ");
+    run_test(test_reparse, &ctx, "[s]\nl = [a, b]\n", "[s]\nl = [a, b]\n [t]\n", "");
+    run_test(test_reparse, &ctx, "[s]\nl = [x]\n", "[s]\nl = x\n", "~s ~s/l ");
+    run_test(test_reparse, &ctx, "[s]\nk = 1\n[t]\nx = 1\n[s]\nk = 2\n", "[s]\nk = 3\n[t]\nx = 1\n[s]\nk = 2\n", "");
+    run_test(test_reparse, &ctx, "[s]\nk = 1\n[t]\nx = 1\n[s]\nk = 2\n", "[s]\nk = 1\n[t]\nx = 1\n[s]\nk = 3\n", "~s ~s/k ");
+    run_test(test_reparse, &ctx, "[s]\nk = 1\n[t]\nx = 1\n[s]\nj = 2\n", "[s]\nk = 1\n[t]\nx = 1\n", "~s -s/j ");
+    run_test(test_reparse, &globals_ctx, "g = 1\n[s]\nk = v\n", "g = 2\n[s]\nk = v\n", "~ ~/g ");
+    run_test(test_reparse, &globals_ctx, "g = 1\n[s]\nk = v\n", "[s]\nk = v\n", "- -/g ");
+    struct cinic_ctx reparse_ctx = globals_ctx;
+    reparse_ctx.includes = true;
+    run_test(test_reparse, &reparse_ctx, "[s]\nz = 1\n", "[s]\ninclude = " INC "a.ini\nz = 1\n", "+a +a/x ~s +s/k ");
+    run_test(test_reparse_include, &globals_ctx, INC "b.ini", "include = a.ini\n[b]\ny = 3\n", "~b ~b/y ");
+    reparse_ctx.includes = false;
+    reparse_ctx.intern = Cinic_intern_new();
+    run_test(test_reparse, &reparse_ctx, "g = 1\n[s]\nk = v\n[t]\nl = [a]\n", "g = 1\n[s]\nk = w\n[u]\nl = [a]\n",
+             "~s ~s/k -t -t/l +u +u/l ");
+    Cinic_intern_free(reparse_ctx.intern);
+    run_test(test_reparse_error, "[s]\nk = v\n[t]\nx = 1\n", "[s]\nk = v\n[t]\nx = 1\n$ = 2\n", CINIC_MALFORMED, 5);
+    run_test(test_reparse_error, "[s]\nl = [a, b]\n[t]\nx = 1\n", "[s]\nl = [a,\n[t]\nx = 1\n", CINIC_NESTED, 3);
+    run_test(test_reparse_error, "[s]\nk = v\n", "k = v\n[s]\nk = v\n", CINIC_NOSECTION, 1);
+    run_test(test_reparse_error, "[s]\nl = [a,\n", "[s]\nl = [a,\n[t]\nx = 1\n", CINIC_NESTED, 3);
+    run_test(test_reparse_error, "[t]\nx = 1\n[s]\nl = [a,\n", "[s]\nl = [a,\n[t]\nx = 1\n", CINIC_NESTED, 3);
+    run_test(test_reparse_edits, &ctx, 10, 20);
+    run_test(test_reparse_edits, &ctx, 100, 500);     /* parsed whole again now and then */
+    printf("[ ] Watching files ... \n");
+    run_test(test_watch_reload, false);
+    run_test(test_watch_reload, true);
+    run_test(test_watch_debounce, 10);
+    run_test(test_watch_error, "[s]\nk = v\n$ = 1\n", CINIC_MALFORMED);
+    run_test(test_watch_error, "k = v\n", CINIC_NOSECTION);
+    run_test(test_watch_includes, &ctx);
+    run_test(test_watch_rearm, &ctx);
+    run_test(test_watch_threads, 4, 20);
     printf("Passed: %u of %u\n", tests_passed, tests_run);
     return (tests_passed == tests_run) ? 0 : 1;
 }
@@ -206,6 +206,45 @@ local function run(expected, file, allow_globals, sep)
     end
 end
 
+-- check everything in EXPECTED can be found in PROXY, as returned by
+-- cinic.open(); proxies cannot be iterated over, so only one way
+local function proxy_compare(expected, proxy)
+    for k,v in pairs(expected) do
+        local actual = proxy[k]
+        if type(actual) == "userdata" then
+            if not proxy_compare(v, actual) then
+                return false
+            end
+        elseif type(v) == "table" then
+            if not deep_compare(v, actual) then
+                return false
+            end
+        elseif actual ~= v then
+            return false
+        end
+    end
+    return proxy.does_not_exist == nil
+end
+
+-- open file lazily and compare the result with EXPECTED
+local function run_open(expected, file, allow_globals, sep)
+    assert(expected and file)
+    local sep = sep and sep or '.'
+    local globals = allow_globals or false
+    local file = "./samples/" .. file
+    local actual = cinic.open(file, globals, sep)
+
+    tests_run = tests_run+1
+    local passed = proxy_compare(expected, actual)
+                   and not pcall(function() actual.x = 1 end)
+    if passed then
+        tests_passed = tests_passed + 1
+        print(string.format(" ~ Test %s passed  -- %s (open)", tests_run, file))
+    else
+        print(string.format(" ~ Test %s FAILED !!  -- %s (open)", tests_run, file))
+    end
+end
+
 --===============================================================
 --
 print(" ~~~~ Running Lua tests ~~~~ ")
@@ -217,6 +256,14 @@ run(globals, "globals.ini", true)
 run(ns_delim, "ns_delim.ini", false, "/")
 run(lists_from_hell, "lists_from_hell.ini", true)
 
+run_open(empty, "empty.ini")
+run_open(flat, "flat.ini")
+run_open(nested, "nested.ini")
+run_open(lists, "lists.ini")
+run_open(globals, "globals.ini", true)
+run_open(ns_delim, "ns_delim.ini", false, "/")
+run_open(lists_from_hell, "lists_from_hell.ini", true)
+
 
 print(string.format("Tests passed: %s of %s", tests_passed, tests_run))
 if tests_passed ~= tests_run then os.exit(3) end
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cinic.h"
+
+/*
+ * Command-line front end to the library.
+ *
+ *   cinic compile [-g] [-e] [-d delim] [-b brackets] <file.ini> [<out>]
+ *      compile file.ini to a snapshot; out defaults to file.cinicb
+ *   cinic get <snapshot> <section> <key>
+ *      print the value of a record, or the items of a list, one per line
+ *   cinic check <snapshot> <file.ini>
+ *      tell whether the snapshot was compiled from file.ini as it is now
+ *
+ * The compile options are as for Cinic_ctx_init(): -g allows global
+ * records, -e empty lists, -d sets the section delimiter and -b the
+ * list brackets.
+ */
+
+#define SNAPSHOT_EXT ".cinicb"
+
+static void usage(void){
+    fprintf(stderr,
+        "usage: cinic compile [-g] [-e] [-d delim] [-b brackets] <file.ini> [<out>]\n"
+        "       cinic get <snapshot> <section> <key>\n"
+        "       cinic check <snapshot> <file.ini>\n");
+    exit(2);
+}
+
+static void print_diag(const char *path, const struct cinic_diag *diag){
+    if (diag->code == CINIC_IO){
+        fprintf(stderr, "%s: %s -- %s\n", path, Cinic_err2str(diag->code), strerror(diag->errnum));
+    }else if (diag->ln){
+        fprintf(stderr, "%s:%u:%u: %s\n", path, diag->ln, diag->col, Cinic_err2str(diag->code));
+    }else{
+        fprintf(stderr, "%s: %s\n", path, Cinic_err2str(diag->code));
+    }
+}
+
+/* foo.ini -> foo.cinicb; malloc-ed */
+static char *snapshot_path(const char *ini){
+    size_t len = strlen(ini);
+    const char *dot = strrchr(ini, '.');
+    if (dot && !strchr(dot, '/')) len = dot - ini;
+
+    char *out = malloc(len + sizeof(SNAPSHOT_EXT));
+    if (!out){
+        perror("malloc");
+        exit(2);
+    }
+    memcpy(out, ini, len);
+    memcpy(out + len, SNAPSHOT_EXT, sizeof(SNAPSHOT_EXT));
+    return out;
+}
+
+static int compile(int argc, char **argv){
+    bool allow_globals = false, allow_empty_lists = false;
+    const char *delim = ".", *brackets = NULL;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "ged:b:")) != -1){
+        switch(opt){
+        case 'g': allow_globals = true; break;
+        case 'e': allow_empty_lists = true; break;
+        case 'd': delim = optarg; break;
+        case 'b': brackets = optarg; break;
+        default: usage();
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 2) usage();
+
+    struct cinic_ctx ctx;
+    if (Cinic_ctx_init(&ctx, allow_globals, allow_empty_lists, delim, brackets)){
+        fprintf(stderr, "cinic: %s\n", Cinic_err2str(CINIC_BAD_OPTION));
+        return 2;
+    }
+
+    const char *ini = argv[optind];
+    char *out = (argc - optind == 2) ? strdup(argv[optind + 1]) : snapshot_path(ini);
+    struct cinic_diag diag;
+    int rc = Cinic_compile(&ctx, ini, out, &diag);
+    if (rc){
+        if (diag.code == CINIC_IO){
+            fprintf(stderr, "cinic: %s -> %s: %s -- %s\n", ini, out, Cinic_err2str(diag.code), strerror(diag.errnum));
+        }else{
+            print_diag(ini, &diag);
+        }
+    }
+    free(out);
+    return rc ? 1 : 0;
+}
+
+static int get(int argc, char **argv){
+    if (argc != 4) usage();
+
+    struct cinic_diag diag;
+    struct cinic_snapshot *snap = Cinic_snapshot_open(argv[1], &diag);
+    if (!snap){
+        print_diag(argv[1], &diag);
+        return 2;
+    }
+
+    int rc = 0;
+    const char *v = Cinic_snapshot_get(snap, argv[2], argv[3]);
+    if (v){
+        puts(v);
+    }else{
+        size_t n = 0;
+        if (Cinic_snapshot_get_list(snap, argv[2], argv[3], NULL, &n)){
+            const char **items = malloc((n ? n : 1) * sizeof(*items));
+            if (!items){
+                perror("malloc");
+                exit(2);
+            }
+            Cinic_snapshot_get_list(snap, argv[2], argv[3], items, &n);
+            for (size_t i = 0; i < n; ++i) puts(items[i]);
+            free(items);
+        }else{
+            fprintf(stderr, "cinic: no '%s' in section '%s'\n", argv[3], argv[2]);
+            rc = 1;
+        }
+    }
+
+    Cinic_snapshot_close(snap);
+    return rc;
+}
+
+static int check(int argc, char **argv){
+    if (argc != 3) usage();
+
+    struct cinic_diag diag;
+    struct cinic_snapshot *snap = Cinic_snapshot_open(argv[1], &diag);
+    if (!snap){
+        print_diag(argv[1], &diag);
+        return 2;
+    }
+
+    int rc = Cinic_snapshot_stale(snap, argv[2]);
+    Cinic_snapshot_close(snap);
+    if (rc < 0){
+        fprintf(stderr, "%s: %s\n", argv[2], Cinic_err2str(CINIC_IO));
+        return 2;
+    }
+    if (rc) fprintf(stderr, "%s: stale; recompile from %s\n", argv[1], argv[2]);
+    return rc;
+}
+
+int main(int argc, char **argv){
+    if (argc < 2) usage();
+
+    if (!strcmp(argv[1], "compile")) return compile(argc - 1, argv + 1);
+    if (!strcmp(argv[1], "get")) return get(argc - 1, argv + 1);
+    if (!strcmp(argv[1], "check")) return check(argc - 1, argv + 1);
+    usage();
+    return 2;
+}